@@ -1,15 +1,66 @@
 #include "blob.h"
 
+#include <algorithm>
+#include <chrono>
+#include <climits>
 #include <cmath>
 #include <cstring>
 #include <filesystem>
 #include <exception>
+#include <stdexcept>
+#include <thread>
 #include <vector>
 
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 namespace DB36_NS
 {
 
+uint64_t HashKey(const Byte* key, const uint64_t& keyLength) noexcept
+{
+    uint64_t hash = 0x9E3779B97F4A7C15;
+    for (uint64_t offset = 0; offset < keyLength; offset += sizeof(uint64_t))
+    {
+        uint64_t word = 0;
+        std::memcpy(&word, key + offset, std::min<uint64_t>(sizeof(uint64_t), keyLength - offset));
+        hash ^= word;
+        hash ^= hash >> 33;
+        hash *= 0xFF51AFD7ED558CCD;
+        hash ^= hash >> 33;
+    }
+    return hash;
+}
+
+uint64_t MixKey(const Byte* key, const uint64_t& keyLength) noexcept
+{
+    // every word is folded in with a full 128-bit multiply, the high and low halves xored, like wyhash does
+    const auto fold = [](const uint64_t& a, const uint64_t& b)
+    {
+        const auto product = static_cast<unsigned __int128>(a) * b;
+        return uint64_t(product) ^ uint64_t(product >> 64);
+    };
+    uint64_t hash = 0xA0761D6478BD642F ^ keyLength;
+    for (uint64_t offset = 0; offset < keyLength; offset += sizeof(uint64_t))
+    {
+        uint64_t word = 0;
+        std::memcpy(&word, key + offset, std::min<uint64_t>(sizeof(uint64_t), keyLength - offset));
+        hash = fold(hash ^ word, 0xE7037ED1A0B428DB);
+    }
+    return fold(hash ^ 0x8EBC6AF09C88C6E3, 0x589965CC75374CC3);
+}
+
 uint64_t Blob::GetKeyAddress(const Byte* key) const
+{
+    const auto bits = blobOptions.keyHash == BlobKeyHash::Mixed ? MixKey(key, blobKeyLength) : KeyOrder(key);
+    return (bits >> shift) * blobRecordLength;
+}
+
+uint64_t Blob::KeyOrder(const Byte* key) const noexcept
 {
     uint64_t retVal = 0;
     if (blobKeyLength > sizeof(uint64_t))
@@ -22,50 +73,480 @@ uint64_t Blob::GetKeyAddress(const Byte* key) const
         // fill the last blobKeyLength bytes in uint64_t if key is shorter that uint64_t
         std::memcpy(&retVal, key, blobKeyLength);
     }
-    return isShrinked ? (retVal >> shift) * blobRecordLength : retVal >> shift;
+    return retVal;
 }
 
 std::unique_ptr<Byte[]> Blob::ReadBytesFromBlob(const uint64_t &address, const uint64_t &len) const
 {
     auto returnArray = std::make_unique<Byte[]>(len);
-    pread(fileno(file.get()), returnArray.get(), len, address);
+    ReadBytesFromBlob(address, returnArray.get(), len);
     return returnArray;
 }
 
-uint64_t Blob::WriteBytesToBlob(const uint64_t &address, Byte* data, const uint64_t &len)
+bool Blob::ReadFromFile(const uint64_t& address, Byte* data, const uint64_t& len) const noexcept
+{
+    if (pool)
+    {
+        CountIO(BlobCount::ReadCalls, len);
+        return pool->Read(headerLength + address, data, len);
+    }
+    const auto bytesRead = pread(fileno(file.get()), data, len, headerLength + address);
+    CountIO(BlobCount::ReadCalls, std::max<ssize_t>(bytesRead, 0));
+    if (bytesRead < 0)
+        return false;
+    std::memset(data + bytesRead, 0, len - bytesRead);
+    return true;
+}
+
+bool Blob::ReadBytesFromBlob(const uint64_t &address, Byte* data, const uint64_t &len) const noexcept
 {
-    pwrite(fileno(file.get()), data, len, address);
+    if (IsReadInPlace())
+    {
+        std::memcpy(data, MappedAt(address), len);
+        return true;
+    }
+    // writer process may change the records while they are copied
+    if (mapping)
+    {
+        versions->Read(MappedAt(address), address, data, len);
+        return true;
+    }
+    if (!directory)
+        return ReadFromFile(address, data, len);
+    // pages never written read as zeros, pages appended one after another are read with one call
+    for (uint64_t done = 0; done < len;)
+    {
+        const auto page = (address + done) / sparsePageLength;
+        const auto filePage = directory->Find(page);
+        auto runLength = std::min(len - done, (page + 1) * sparsePageLength - (address + done));
+        if (filePage == BlobDirectory::noPage)
+        {
+            std::memset(data + done, 0, runLength);
+            done += runLength;
+            continue;
+        }
+        for (uint64_t next = 1; done + runLength < len && directory->Find(page + next) == filePage + next; ++next)
+            runLength += std::min(len - done - runLength, sparsePageLength);
+        if (!ReadFromFile(filePage * sparsePageLength + (address + done) % sparsePageLength, data + done, runLength))
+            return false;
+        done += runLength;
+    }
+    return true;
+}
+
+uint64_t Blob::WriteBytesToBlob(const uint64_t &address, const Byte* data, const uint64_t &len)
+{
+    if (mapping)
+    {
+        BlobVersionsWrite write(versions.get(), address, len);
+        std::memcpy(MappedAt(address), data, len);
+        return address + len;
+    }
+    const iovec part = {const_cast<Byte*>(data), len};
+    WriteToFile(address, &part, 1);
     return address + len;
 }
 
-uint64_t Blob::GetKeyAddressInShrinkedBlob(const Byte* key) const
+bool Blob::WritePartsToFile(const uint64_t& address, const iovec* parts, const int& count) noexcept
+{
+    uint64_t len = 0;
+    for (int i = 0; i < count; ++i)
+        len += parts[i].iov_len;
+    CountIO(BlobCount::WriteCalls, len);
+    if (pool)
+        return pool->Write(headerLength + address, parts, count);
+    return pwritev(fileno(file.get()), parts, count, headerLength + address) == ssize_t(len);
+}
+
+bool Blob::WriteToFile(const uint64_t& address, const iovec* parts, const int& count) noexcept
 {
-    const auto startAddress = GetKeyAddress(key);
-    uint64_t iter = 0;
-    while (!CompareByteKeys(key, ReadBytesFromBlob(startAddress + iter * blobRecordLength, blobKeyLength).get()))
+    if (!directory)
+        return WritePartsToFile(address, parts, count);
+    uint64_t len = 0;
+    for (int i = 0; i < count; ++i)
+        len += parts[i].iov_len;
+    // parts are cut at the page boundaries, pages that follow each other in the file too are written with one call;
+    // zeros going to a page never written are what it reads as already, so they append no page
+    std::vector<iovec> run;
+    uint64_t runAddress = 0;
+    uint64_t lastFilePage = BlobDirectory::noPage;
+    int part = 0;
+    uint64_t partOffset = 0;
+    for (uint64_t done = 0; done < len;)
     {
-        ++iter;
-        if (startAddress + iter * blobRecordLength > blobCapacitySize)
-            throw std::logic_error("record not found");
+        const auto page = (address + done) / sparsePageLength;
+        const auto chunk = std::min(len - done, (page + 1) * sparsePageLength - (address + done));
+        const auto runSize = run.size();
+        bool isZeros = true;
+        for (uint64_t gathered = 0; gathered < chunk;)
+        {
+            const auto take = std::min(chunk - gathered, parts[part].iov_len - partOffset);
+            const auto base = static_cast<Byte*>(parts[part].iov_base) + partOffset;
+            isZeros = isZeros && std::all_of(base, base + take, [](const Byte b) { return b == 0; });
+            run.push_back({base, take});
+            gathered += take;
+            partOffset += take;
+            if (partOffset == parts[part].iov_len)
+            {
+                ++part;
+                partOffset = 0;
+            }
+        }
+        auto filePage = directory->Find(page);
+        if (filePage == BlobDirectory::noPage && isZeros)
+        {
+            run.resize(runSize);
+            if (!run.empty() && !WritePartsToFile(runAddress, run.data(), run.size()))
+                return false;
+            run.clear();
+            lastFilePage = BlobDirectory::noPage;
+            done += chunk;
+            continue;
+        }
+        if (filePage == BlobDirectory::noPage && (filePage = directory->Allocate(page)) == BlobDirectory::noPage)
+            return false;
+        // the page starts a new run unless it follows the last page of the run in the file
+        const bool isNewRun = runSize == 0 || filePage != lastFilePage + 1 || runSize >= IOV_MAX / 2;
+        if (runSize != 0 && isNewRun)
+        {
+            if (!WritePartsToFile(runAddress, run.data(), runSize))
+                return false;
+            run.erase(run.begin(), run.begin() + runSize);
+        }
+        if (isNewRun)
+            runAddress = filePage * sparsePageLength + (address + done) % sparsePageLength;
+        lastFilePage = filePage;
+        done += chunk;
     }
-    return startAddress + iter * blobRecordLength;
+    return run.empty() || WritePartsToFile(runAddress, run.data(), run.size());
 }
 
-uint64_t Blob::SetKeyAddressInShrinkedBlob(const Byte *key) const
+bool Blob::WriteRecordToBlob(const uint64_t& address, const Byte* key, const Byte* value, const uint64_t& valueLen) noexcept
+{
+    if (mapping)
+    {
+        BlobVersionsWrite write(versions.get(), address, blobKeyLength + valueLen);
+        std::memcpy(MappedAt(address), key, blobKeyLength);
+        std::memcpy(MappedAt(address) + blobKeyLength, value, valueLen);
+        return true;
+    }
+    iovec parts[2] = {
+        {const_cast<Byte*>(key), blobKeyLength},
+        {const_cast<Byte*>(value), valueLen}};
+    return WriteToFile(address, parts, 2);
+}
+
+namespace
+{
+// compare the key with the stored one and check the stored one for zeros in the same pass,
+// stops as soon as the key neither matches nor can be empty
+void CompareStoredKey(const Byte* key, const Byte* stored, const uint64_t& len, bool& isMatch, bool& isEmpty) noexcept
+{
+    uint64_t offset = 0;
+#if defined(__AVX2__)
+    for (; offset + sizeof(__m256i) <= len && (isMatch || isEmpty); offset += sizeof(__m256i))
+    {
+        const auto storedBytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(stored + offset));
+        const auto keyBytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(key + offset));
+        isMatch = isMatch && _mm256_movemask_epi8(_mm256_cmpeq_epi8(storedBytes, keyBytes)) == -1;
+        isEmpty = isEmpty && _mm256_testz_si256(storedBytes, storedBytes);
+    }
+#endif
+#if defined(__SSE2__)
+    for (; offset + sizeof(__m128i) <= len && (isMatch || isEmpty); offset += sizeof(__m128i))
+    {
+        const auto storedBytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(stored + offset));
+        const auto keyBytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key + offset));
+        isMatch = isMatch && _mm_movemask_epi8(_mm_cmpeq_epi8(storedBytes, keyBytes)) == 0xFFFF;
+        isEmpty = isEmpty && _mm_movemask_epi8(_mm_cmpeq_epi8(storedBytes, _mm_setzero_si128())) == 0xFFFF;
+    }
+#endif
+    for (; offset + sizeof(uint64_t) <= len && (isMatch || isEmpty); offset += sizeof(uint64_t))
+    {
+        uint64_t storedWord = 0;
+        uint64_t keyWord = 0;
+        std::memcpy(&storedWord, stored + offset, sizeof(uint64_t));
+        std::memcpy(&keyWord, key + offset, sizeof(uint64_t));
+        isMatch = isMatch && storedWord == keyWord;
+        isEmpty = isEmpty && storedWord == 0;
+    }
+    for (; offset < len && (isMatch || isEmpty); ++offset)
+    {
+        isMatch = isMatch && stored[offset] == key[offset];
+        isEmpty = isEmpty && stored[offset] == 0;
+    }
+}
+}
+
+bool IsTombstoneKey(const Byte* key, const uint64_t& len) noexcept
+{
+    return std::all_of(key, key + len, [](const Byte b) { return b == 0xFF; });
+}
+
+Blob::SlotState Blob::ProbeStoredKey(const Byte* key, const Byte* storedKey) const noexcept
+{
+    bool isMatch = true;
+    bool isEmpty = true;
+    CompareStoredKey(key, storedKey, blobKeyLength, isMatch, isEmpty);
+    // all zeros key matches an empty slot, which is what both Get and Set expect
+    if (isMatch)
+        return IsTombstoneKey(key, blobKeyLength) ? SlotState::Tombstone : SlotState::Match;
+    if (isEmpty)
+        return SlotState::Empty;
+    return IsTombstoneKey(storedKey, blobKeyLength) ? SlotState::Tombstone : SlotState::Occupied;
+}
+
+Blob::SlotState Blob::ProbeSlot(const Byte* key, const uint64_t& address) const noexcept
+{
+    if (IsReadInPlace())
+        return ProbeStoredKey(key, MappedAt(address));
+
+    Byte chunk[keyChunkLength];
+    bool isMatch = true;
+    bool isEmpty = true;
+    bool isTombstone = true;
+    for (uint64_t offset = 0; offset < blobKeyLength && (isMatch || isEmpty || isTombstone); offset += keyChunkLength)
+    {
+        const auto len = std::min(keyChunkLength, blobKeyLength - offset);
+        if (!ReadBytesFromBlob(address + offset, chunk, len))
+            return SlotState::Error;
+        CompareStoredKey(key + offset, chunk, len, isMatch, isEmpty);
+        isTombstone = isTombstone && IsTombstoneKey(chunk, len);
+    }
+    if (isMatch)
+        return isTombstone ? SlotState::Tombstone : SlotState::Match;
+    if (isEmpty)
+        return SlotState::Empty;
+    return isTombstone ? SlotState::Tombstone : SlotState::Occupied;
+}
+
+Blob::SlotState Blob::ScanRecords(const Byte* key, const Byte* records, const uint64_t& count, uint64_t& index,
+                                  uint64_t* tombstone) const noexcept
+{
+    for (index = 0; index < count; ++index)
+    {
+        const auto state = ProbeStoredKey(key, records + index * blobRecordLength);
+        if (state == SlotState::Tombstone && tombstone && *tombstone == noTombstone)
+            *tombstone = index;
+        if (state != SlotState::Occupied && state != SlotState::Tombstone)
+            return state;
+    }
+    return SlotState::Occupied;
+}
+
+Blob::SlotState Blob::ProbeRange(const Byte* key, uint64_t& address, const uint64_t& end, uint64_t* tombstone) const noexcept
+{
+    if (blobRecordLength > probePageLength)
+    {
+        for (; address < end; address += blobRecordLength)
+        {
+            const auto lock = ReadLock(address);
+            const auto state = ProbeSlot(key, address);
+            if (state == SlotState::Tombstone && tombstone && *tombstone == noTombstone)
+                *tombstone = address;
+            if (state != SlotState::Occupied && state != SlotState::Tombstone)
+                return state;
+        }
+        return SlotState::Occupied;
+    }
+
+    // take the records up to the next page boundary at once, so a chain costs one pread and one lock per page
+    alignas(64) Byte page[probePageLength];
+    while (address < end)
+    {
+        const auto pageEnd = (address + probePageLength) / probePageLength * probePageLength;
+        const auto count = std::min(std::max<uint64_t>(1, (pageEnd - address) / blobRecordLength),
+                                    (end - address) / blobRecordLength);
+        const auto lock = ReadLock(address);
+        const Byte* records = IsReadInPlace() ? MappedAt(address) : page;
+        if (!IsReadInPlace() && !ReadBytesFromBlob(address, page, count * blobRecordLength))
+            return SlotState::Error;
+        uint64_t index = 0;
+        uint64_t tombstoneIndex = noTombstone;
+        const auto state = ScanRecords(key, records, count, index, &tombstoneIndex);
+        if (tombstone && *tombstone == noTombstone && tombstoneIndex != noTombstone)
+            *tombstone = address + tombstoneIndex * blobRecordLength;
+        address += index * blobRecordLength;
+        if (state != SlotState::Occupied)
+            return state;
+    }
+    return SlotState::Occupied;
+}
+
+Blob::SlotState Blob::ProbeChain(const Byte* key, uint64_t& address, uint64_t* tombstone) const noexcept
+{
+    const auto home = address;
+    auto state = SlotState::Occupied;
+    if (fingerprints)
+        state = ProbeFingerprints(key, address, tombstone);
+    else
+    {
+        // addresses past the last record are outside of the mapping, so chains wrap around to the first record
+        state = ProbeRange(key, address, blobCapacitySize, tombstone);
+        if (state == SlotState::Occupied && home != 0)
+        {
+            address = 0;
+            state = ProbeRange(key, address, home, tombstone);
+        }
+    }
+    if (stats)
+        stats->AddProbe(state == SlotState::Occupied ? blobRecordsCount
+                                                     : (address + blobCapacitySize - home) % blobCapacitySize / blobRecordLength + 1);
+    return state;
+}
+
+Blob::SlotState Blob::ProbeFingerprints(const Byte* key, uint64_t& address, uint64_t* tombstone) const noexcept
+{
+    const auto fingerprint = FingerprintOf(key);
+    auto slot = address / blobRecordLength;
+    for (uint64_t probed = 0; probed < blobRecordsCount; ++probed, slot = slot + 1 == blobRecordsCount ? 0 : slot + 1)
+    {
+        const auto stored = fingerprints[slot].load(std::memory_order_acquire);
+        address = slot * blobRecordLength;
+        if (stored == 0)
+            return SlotState::Empty;
+        if (stored == tombstoneFingerprint && tombstone && *tombstone == noTombstone)
+            *tombstone = address;
+        if (stored != fingerprint)
+            continue;
+        const auto lock = ReadLock(address);
+        const auto state = CheckSlot(key, address);
+        if (state != SlotState::Occupied && state != SlotState::Tombstone)
+            return state;
+    }
+    return SlotState::Occupied;
+}
+
+Blob::SlotState Blob::CheckSlot(const Byte* key, const uint64_t& address) const noexcept
+{
+    if (!fingerprints)
+        return ProbeSlot(key, address);
+    const auto stored = fingerprints[address / blobRecordLength].load(std::memory_order_acquire);
+    if (stored == 0)
+        return SlotState::Empty;
+    if (stored == tombstoneFingerprint)
+        return SlotState::Tombstone;
+    // taken slot that looks empty holds the all zeros key, which isn't the key unless it matched
+    const auto state = ProbeSlot(key, address);
+    return state == SlotState::Empty ? SlotState::Occupied : state;
+}
+
+void Blob::TakeSlot(const Byte* key, const uint64_t& address) noexcept
+{
+    ++storedRecords.value;
+    if (!fingerprints)
+        return;
+    const auto slot = address / blobRecordLength;
+    fingerprints[slot].store(FingerprintOf(key), std::memory_order_release);
+    if (std::all_of(key, key + blobKeyLength, [](const Byte b) { return b == 0; }))
+    {
+        // rare enough to write the header right away, so the key is found after a crash too
+        zeroKeySlot = slot + 1;
+        WriteHeader(false);
+    }
+}
+
+Byte Blob::FingerprintOf(const Byte* key) const noexcept
+{
+    const Byte fingerprint = HashKey(key, blobKeyLength) >> 56;
+    if (fingerprint == 0)
+        return 1;
+    return fingerprint == tombstoneFingerprint ? tombstoneFingerprint - 1 : fingerprint;
+}
+
+bool Blob::FillBytes(const uint64_t& address, const Byte& fill, const uint64_t& len) noexcept
+{
+    Byte chunk[keyChunkLength];
+    std::memset(chunk, fill, sizeof(chunk));
+    for (uint64_t offset = 0; offset < len; offset += keyChunkLength)
+    {
+        const auto chunkLength = std::min(keyChunkLength, len - offset);
+        const iovec part = {chunk, chunkLength};
+        if (mapping)
+        {
+            BlobVersionsWrite write(versions.get(), address + offset, chunkLength);
+            std::memcpy(MappedAt(address + offset), chunk, chunkLength);
+        }
+        else if (!WriteToFile(address + offset, &part, 1))
+            return false;
+    }
+    return true;
+}
+
+bool Blob::MarkSlot(const uint64_t& address, const SlotState& state) noexcept
+{
+    if (!FillBytes(address, state == SlotState::Tombstone ? 0xFF : 0, blobKeyLength))
+        return false;
+    const auto slot = address / blobRecordLength;
+    if (fingerprints)
+        fingerprints[slot].store(state == SlotState::Tombstone ? tombstoneFingerprint : 0, std::memory_order_release);
+    if (slot + 1 == zeroKeySlot)
+    {
+        zeroKeySlot = 0;
+        WriteHeader(false);
+    }
+    return true;
+}
+
+Blob::SlotState Blob::ReadSlot(const uint64_t& slot, Byte* record) const noexcept
+{
+    if (!ReadBytesFromBlob(slot * blobRecordLength, record, blobRecordLength))
+        return SlotState::Error;
+    if (fingerprints)
+    {
+        const auto stored = fingerprints[slot].load(std::memory_order_acquire);
+        if (stored == 0)
+            return SlotState::Empty;
+        return stored == tombstoneFingerprint ? SlotState::Tombstone : SlotState::Occupied;
+    }
+    if (std::all_of(record, record + blobKeyLength, [](const Byte b) { return b == 0; }) && slot + 1 != zeroKeySlot)
+        return SlotState::Empty;
+    return IsTombstoneKey(record, blobKeyLength) ? SlotState::Tombstone : SlotState::Occupied;
+}
+
+BlobStatus Blob::FindKeyAddressInShrinkedBlob(const Byte* key, uint64_t& address) const noexcept
 {
-    const auto startAddress = GetKeyAddress(key);
-    uint64_t iter = 0;
-    auto iterKey = std::make_unique<Byte[]>(blobKeyLength);
-    const std::unique_ptr<Byte[]> zeros (new Byte[blobKeyLength]{});
-    do
+    address = GetKeyAddress(key);
+    // deleted keys leave tombstones, so the chain of the key still ends at the first empty slot
+    switch (ProbeChain(key, address))
     {
-        std::memcpy (iterKey.get(), ReadBytesFromBlob(startAddress + iter * blobRecordLength, blobKeyLength).get(), blobKeyLength);
-        ++iter;
-        if (startAddress + iter * blobRecordLength > blobCapacitySize)
-            throw std::logic_error("couldn't set address in shrinked blob");
-        
-    } while (!(CompareByteKeys(key, iterKey.get()) || CompareByteKeys(iterKey.get(), zeros.get())));
-    return startAddress + (iter - 1) * blobRecordLength;
+        case SlotState::Match:
+            return BlobStatus::Ok;
+        case SlotState::Error:
+            return BlobStatus::IOError;
+        default:
+            return BlobStatus::NotFound;
+    }
+}
+
+BlobStatus Blob::FindSetAddressInShrinkedBlob(const Byte* key, uint64_t& address) const noexcept
+{
+    switch (ProbeChain(key, address))
+    {
+        case SlotState::Match:
+        case SlotState::Empty:
+            return BlobStatus::Ok;
+        case SlotState::Error:
+            return BlobStatus::IOError;
+        default:
+            return BlobStatus::NoSpace;
+    }
+}
+
+uint64_t Blob::GetKeyAddressInShrinkedBlob(const Byte* key) const
+{
+    uint64_t address = 0;
+    if (FindKeyAddressInShrinkedBlob(key, address) != BlobStatus::Ok)
+        throw std::logic_error("record not found");
+    return address;
+}
+
+uint64_t Blob::SetKeyAddressInShrinkedBlob(const Byte *key) const
+{
+    uint64_t address = GetKeyAddress(key);
+    if (FindSetAddressInShrinkedBlob(key, address) != BlobStatus::Ok)
+        throw std::logic_error("couldn't set address in shrinked blob");
+    return address;
 }
 
 // TODO: Return type?
@@ -75,53 +556,1455 @@ void Blob::Set(Byte* key, Byte* value, const uint64_t& valueLen)
     {
         throw(std::length_error("record value exceeds size"));
     }
+    const auto status = Set(std::span<const Byte>(key, blobKeyLength), std::span<const Byte>(value, valueLen));
+    if (status == BlobStatus::NoSpace)
+        throw std::logic_error("couldn't set address in shrinked blob");
+    if (status != BlobStatus::Ok)
+        throw std::runtime_error("failed to write record");
+}
+
+
+// TODO: return type
+std::unique_ptr<Byte[]> Blob::Get(const Byte* key) const
+{
+    auto value = std::make_unique<Byte[]>(blobValueLength);
+    const auto status = Get(std::span<const Byte>(key, blobKeyLength), std::span<Byte>(value.get(), blobValueLength));
+    if (status == BlobStatus::NotFound)
+        throw std::logic_error("record not found");
+    if (status != BlobStatus::Ok)
+        throw std::runtime_error("failed to read record");
+    return value;
+}
+
+BlobStatus Blob::Set(std::span<const Byte> key, std::span<const Byte> value) noexcept
+{
+    const BlobOperationTimer timer(stats.get(), BlobOperation::Set);
+    const auto status = SetRecord(key, value, false);
+    if (status == BlobStatus::Ok && blobOptions.valueLogGarbageRatio > 0 && ValueLogGarbageRatio() >= blobOptions.valueLogGarbageRatio)
+        CollectValueLog(collectStepBytes);
+    if (status == BlobStatus::Ok)
+        CheckpointLongLog();
+    return status;
+}
+
+BlobStatus Blob::SetRecord(std::span<const Byte> key, std::span<const Byte> value, const bool& isLogged) noexcept
+{
+    if (IsSharedReader())
+        return BlobStatus::ReadOnly;
+    if (key.size() != blobKeyLength || value.size() > blobValueLength)
+        return BlobStatus::InvalidLength;
+    // held from the value log entry and the log entry to the record, so collection can't drop the entry before the slot
+    // points at it, and Checkpoint can't drop the log entry before the record it covers is written
+    const auto updateLock = UpdateLock();
+    if (!valueLog)
+        return StoreRecord(key, value, value, isLogged);
+    // long value is appended before its slot is found, a failed Set leaves it in the log as garbage
+    Byte slotValue[maxSlotValueLength];
+    if (!valueLog->Write(key.data(), value, slotValue))
+        return BlobStatus::IOError;
+    const auto status = StoreRecord(key, value, std::span<const Byte>(slotValue, slotValueLength), isLogged);
+    if (status != BlobStatus::Ok)
+        valueLog->Release(slotValue);
+    return status;
+}
+
+BlobStatus Blob::StoreRecord(std::span<const Byte> key, std::span<const Byte> value, std::span<const Byte> stored,
+                             const bool& isLogged) noexcept
+{
+    uint64_t address = GetKeyAddress(key.data());
     if (!isShrinked)
     {
-        WriteBytesToBlob(GetKeyAddress(key), value, valueLen);
-        return;
+        const auto lock = WriteLock(address);
+        if (!isLogged && !LogUpdate(WalOperation::Set, key.data(), value))
+            return BlobStatus::IOError;
+        if (valueLog && !ReleaseStoredValue(address))
+            return BlobStatus::IOError;
+        WriteBytesToBlob(address, stored.data(), stored.size());
+        UpdateCache(key.data(), stored);
+        return BlobStatus::Ok;
+    }
+    if (grown)
+    {
+        if (!isLogged && !LogUpdate(WalOperation::Set, key.data(), value))
+            return BlobStatus::IOError;
+        UpdateCache(key.data(), value);
+        // shorter value keeps the tail of the stored one, so the stored record has to be moved first
+        if (value.size() < blobValueLength && FindKeyAddressInShrinkedBlob(key.data(), address) == BlobStatus::Ok)
+        {
+            if (!ReadBytesFromBlob(address, growBuffer.data(), blobRecordLength))
+                return BlobStatus::IOError;
+            const auto status = grown->InsertRecord(growBuffer.data());
+            if (status != BlobStatus::Ok)
+                return status;
+        }
+        const auto status = grown->Set(key, value);
+        return status == BlobStatus::Ok ? GrowStep() : status;
     }
     // if we're here, then blob is shrinked
-    const auto address = SetKeyAddressInShrinkedBlob(key);
-    const auto data = std::make_unique<Byte[]>(blobKeyLength + valueLen);
-    memcpy(data.get(), key, blobKeyLength);
-    memcpy(&data.get()[blobKeyLength], value, valueLen);
-    WriteBytesToBlob(address, data.get(), blobKeyLength + valueLen);
+    if (IsTombstoneKey(key.data(), blobKeyLength))
+        return BlobStatus::InvalidLength;
+    for (;;)
+    {
+        // new key takes the first tombstone of its chain, but only once the whole chain is probed for it
+        uint64_t tombstone = noTombstone;
+        auto state = ProbeChain(key.data(), address, &tombstone);
+        if (state == SlotState::Error)
+            return BlobStatus::IOError;
+        if (state != SlotState::Match && tombstone != noTombstone)
+        {
+            address = tombstone;
+            state = SlotState::Tombstone;
+        }
+        if (state == SlotState::Occupied)
+            return BlobStatus::NoSpace;
+        const auto lock = WriteLock(address);
+        // another thread may have claimed the slot after it was probed, then probing goes on from it
+        if (stripes)
+            state = CheckSlot(key.data(), address);
+        if (state == SlotState::Error)
+            return BlobStatus::IOError;
+        if (state == SlotState::Occupied)
+            continue;
+        // logged under the slot lock, so the log keeps the order the updates of the slot are written in
+        if (!isLogged && !LogUpdate(WalOperation::Set, key.data(), value))
+            return BlobStatus::IOError;
+        if (state == SlotState::Match && valueLog && !ReleaseStoredValue(address + blobKeyLength))
+            return BlobStatus::IOError;
+        if (!WriteRecordToBlob(address, key.data(), stored.data(), stored.size()))
+            return BlobStatus::IOError;
+        // under the slot lock, so a reader can't put the old value back after it
+        UpdateCache(key.data(), stored);
+        if (bloom)
+            AddToBloom(key.data());
+        if (state != SlotState::Match)
+        {
+            if (state == SlotState::Tombstone)
+                --tombstoneRecords.value;
+            TakeSlot(key.data(), address);
+            StartGrowth();
+        }
+        return BlobStatus::Ok;
+    }
 }
 
+void Blob::Delete(const Byte* key)
+{
+    const auto status = Delete(std::span<const Byte>(key, blobKeyLength));
+    if (status == BlobStatus::NotFound)
+        throw std::logic_error("record not found");
+    if (status != BlobStatus::Ok)
+        throw std::runtime_error("failed to delete record");
+}
 
-// TODO: return type
-std::unique_ptr<Byte[]> Blob::Get(const Byte* key) const
+BlobStatus Blob::Delete(std::span<const Byte> key) noexcept
+{
+    const BlobOperationTimer timer(stats.get(), BlobOperation::Delete);
+    const auto status = DeleteKey(key);
+    if (status == BlobStatus::Ok)
+        CheckpointLongLog();
+    return status;
+}
+
+BlobStatus Blob::DeleteKey(std::span<const Byte> key) noexcept
 {
+    if (key.size() != blobKeyLength)
+        return BlobStatus::InvalidLength;
+    if (IsSharedReader())
+        return BlobStatus::ReadOnly;
     if (!isShrinked)
-        return ReadBytesFromBlob(GetKeyAddress(key), blobValueLength);
-    // if we're here, blob is shrinked
-    const auto address = GetKeyAddressInShrinkedBlob(key);
-    return ReadBytesFromBlob(address + blobKeyLength, blobValueLength);
+    {
+        // every key has its slot in the direct addressed blob, so only the value is cleared
+        const auto address = GetKeyAddress(key.data());
+        const auto updateLock = UpdateLock();
+        const auto lock = WriteLock(address);
+        if (!LogUpdate(WalOperation::Delete, key.data(), {}))
+            return BlobStatus::IOError;
+        if (cache)
+            cache->Erase(key.data());
+        if (valueLog && !ReleaseStoredValue(address))
+            return BlobStatus::IOError;
+        return FillBytes(address, 0, slotValueLength) ? BlobStatus::Ok : BlobStatus::IOError;
+    }
+    if (grown)
+    {
+        // growth is refused with lock stripes, so there is no compaction mutex and DeleteRecord taking it again is fine
+        const auto updateLock = UpdateLock();
+        if (!LogUpdate(WalOperation::Delete, key.data(), {}))
+            return BlobStatus::IOError;
+        if (cache)
+            cache->Erase(key.data());
+        // key may be in both blobs, a record left here would be moved to the doubled blob again
+        const auto grownStatus = grown->Delete(key);
+        const auto status = DeleteRecord(key.data(), true);
+        if (grownStatus == BlobStatus::IOError || status == BlobStatus::IOError)
+            return BlobStatus::IOError;
+        const auto growStatus = GrowStep();
+        if (growStatus != BlobStatus::Ok)
+            return growStatus;
+        return grownStatus == BlobStatus::Ok ? grownStatus : status;
+    }
+    const auto status = DeleteRecord(key.data(), false);
+    if (status == BlobStatus::Ok && blobOptions.compactTombstoneRatio > 0 && TombstoneRatio() >= blobOptions.compactTombstoneRatio)
+        Compact(compactStepSlots);
+    return status;
 }
 
+BlobStatus Blob::DeleteRecord(const Byte* key, const bool& isLogged) noexcept
+{
+    if (IsTombstoneKey(key, blobKeyLength))
+        return BlobStatus::NotFound;
+    const auto updateLock = UpdateLock();
+    uint64_t address = GetKeyAddress(key);
+    for (;;)
+    {
+        auto state = ProbeChain(key, address);
+        if (state == SlotState::Error)
+            return BlobStatus::IOError;
+        if (state != SlotState::Match)
+            return BlobStatus::NotFound;
+        const auto lock = WriteLock(address);
+        // another thread may have deleted the key after it was probed, then probing goes on from its slot
+        if (stripes)
+            state = CheckSlot(key, address);
+        if (state == SlotState::Error)
+            return BlobStatus::IOError;
+        if (state != SlotState::Match)
+            continue;
+        if (!isLogged && !LogUpdate(WalOperation::Delete, key, {}))
+            return BlobStatus::IOError;
+        if (valueLog && !ReleaseStoredValue(address + blobKeyLength))
+            return BlobStatus::IOError;
+        // without fingerprints the all zeros key is the empty slot it matched, only its value can be cleared
+        if (!fingerprints && std::all_of(key, key + blobKeyLength, [](const Byte b) { return b == 0; }))
+        {
+            if (cache)
+                cache->Erase(key);
+            return FillBytes(address + blobKeyLength, 0, slotValueLength) ? BlobStatus::Ok : BlobStatus::IOError;
+        }
+        // the value is left in place, the slot is taken again by the next key of the chain
+        if (!MarkSlot(address, SlotState::Tombstone))
+            return BlobStatus::IOError;
+        if (cache)
+            cache->Erase(key);
+        --storedRecords.value;
+        ++tombstoneRecords.value;
+        return BlobStatus::Ok;
+    }
+}
 
-void Blob::Init()
+uint64_t Blob::Compact(const uint64_t& maxSlots) noexcept
+{
+    if (!isShrinked || grown || IsSharedReader())
+        return 0;
+    const auto compactionLock = CompactionLock();
+    std::vector<Byte> record(blobRecordLength);
+    uint64_t reclaimed = 0;
+    for (uint64_t visited = 0; visited < maxSlots && tombstoneRecords.value != 0; ++visited)
+    {
+        const auto slot = compactSlot;
+        compactSlot = compactSlot + 1 == blobRecordsCount ? 0 : compactSlot + 1;
+        const auto state = ReadSlot(slot, record.data());
+        if (state == SlotState::Error)
+            break;
+        if (state != SlotState::Tombstone)
+            continue;
+        // readers that probed while records moved see the epoch change and look the key up again
+        const auto epoch = LoadEpoch(std::memory_order_relaxed);
+        StoreEpoch(epoch + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        const auto tombstones = tombstoneRecords.value.load();
+        const bool isReclaimed = ReclaimTombstone(slot, record.data());
+        StoreEpoch(epoch + 2, std::memory_order_release);
+        if (!isReclaimed)
+            break;
+        reclaimed += tombstones - tombstoneRecords.value;
+    }
+    return reclaimed;
+}
+
+bool Blob::ReclaimTombstone(uint64_t hole, Byte* record) noexcept
 {
-    if (blobKeyLength * 8 > blobCapacity)
+    // same as the deletion in linear probing without tombstones: a record moves back into the hole
+    // if the hole is on its chain, the slot it leaves is the next hole, the last hole before an empty slot is cleared
+    auto slot = hole;
+    for (uint64_t probed = 1; probed < blobRecordsCount; ++probed)
     {
-        shift = blobKeyLength * 8 - blobCapacity;
+        slot = slot + 1 == blobRecordsCount ? 0 : slot + 1;
+        const auto state = ReadSlot(slot, record);
+        if (state == SlotState::Error)
+            return false;
+        if (state == SlotState::Empty)
+        {
+            const auto lock = WriteLock(hole * blobRecordLength);
+            if (!MarkSlot(hole * blobRecordLength, SlotState::Empty))
+                return false;
+            --tombstoneRecords.value;
+            return true;
+        }
+        if (state == SlotState::Tombstone)
+            continue;
+        const auto home = GetKeyAddress(record) / blobRecordLength;
+        const auto distance = [&](const uint64_t& to) { return (to + blobRecordsCount - home) % blobRecordsCount; };
+        if (distance(hole) >= distance(slot))
+            continue;
+        {
+            // the record is written to the hole before its old slot is buried, so it is never missing
+            const auto lock = WriteLock(hole * blobRecordLength);
+            if (!WriteRecordToBlob(hole * blobRecordLength, record, record + blobKeyLength, slotValueLength))
+                return false;
+        }
+        if (fingerprints)
+            fingerprints[hole].store(FingerprintOf(record), std::memory_order_release);
+        if (slot + 1 == zeroKeySlot)
+        {
+            zeroKeySlot = hole + 1;
+            WriteHeader(false);
+        }
+        const auto lock = WriteLock(slot * blobRecordLength);
+        if (!MarkSlot(slot * blobRecordLength, SlotState::Tombstone))
+            return false;
+        hole = slot;
+    }
+    // every other slot is taken, the hole stays a tombstone
+    return true;
+}
+
+uint64_t Blob::CollectValueLog(const uint64_t& maxBytes) noexcept
+{
+    if (!valueLog)
+        return 0;
+    const auto compactionLock = CompactionLock();
+    // readers that decoded a slot value while its entry moved see the epoch change and look the key up again
+    const auto epoch = LoadEpoch(std::memory_order_relaxed);
+    StoreEpoch(epoch + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    Byte slotValue[maxSlotValueLength];
+    const auto collected = valueLog->Collect(maxBytes,
+        [&](const Byte* key, const uint64_t& offset, std::span<const Byte> value)
+        {
+            // entry is live only while the slot of its key still points at it
+            uint64_t address = GetKeyAddress(key);
+            if (isShrinked)
+            {
+                const auto status = FindKeyAddressInShrinkedBlob(key, address);
+                if (status != BlobStatus::Ok)
+                    return status == BlobStatus::NotFound ? BlobValueLog::EntryState::Dead : BlobValueLog::EntryState::Failed;
+            }
+            const auto valueAddress = isShrinked ? address + blobKeyLength : address;
+            // under the slot lock, so a reader can't put the old slot value in the cache after it is dropped
+            const auto lock = WriteLock(address);
+            if (!ReadBytesFromBlob(valueAddress, slotValue, slotValueLength))
+                return BlobValueLog::EntryState::Failed;
+            if (!valueLog->PointsAt(slotValue, offset))
+                return BlobValueLog::EntryState::Dead;
+            if (!valueLog->Write(key, value, slotValue))
+                return BlobValueLog::EntryState::Failed;
+            WriteBytesToBlob(valueAddress, slotValue, slotValueLength);
+            if (cache)
+                cache->Erase(key);
+            return BlobValueLog::EntryState::Moved;
+        },
+        // rewritten slots aren't logged, so they reach the disk before the entries they pointed at are punched
+        [this]() { return SyncBlob(); });
+    StoreEpoch(epoch + 2, std::memory_order_release);
+    return collected;
+}
 
+BlobStatus Blob::InsertRecord(const Byte* record) noexcept
+{
+    uint64_t address = GetKeyAddress(record);
+    switch (ProbeChain(record, address))
+    {
+        case SlotState::Match:
+            return BlobStatus::Ok;
+        case SlotState::Empty:
+            if (!WriteRecordToBlob(address, record, record + blobKeyLength, slotValueLength))
+                return BlobStatus::IOError;
+            TakeSlot(record, address);
+            if (bloom)
+                AddToBloom(record);
+            return BlobStatus::Ok;
+        case SlotState::Error:
+            return BlobStatus::IOError;
+        default:
+            return BlobStatus::NoSpace;
     }
+}
+
+void Blob::StartGrowth() noexcept
+{
+    if (grown || blobOptions.growLoadFactor <= 0 || blobCapacity >= std::min<uint64_t>(blobKeyLength * 8, 63)
+        || storedRecords.value < blobOptions.growLoadFactor * blobRecordsCount)
+        return;
+    auto options = blobOptions;
+    options.growLoadFactor = 0;
+    options.cacheBytes = 0;
+    // updates are logged by this blob
+    options.durability = BlobDurability::None;
+    options.asyncQueueDepth = 0;
+    // records moved by the growth are counted by the Set that moves them
+    options.stats = false;
+    try
+    {
+        grown = std::make_unique<Blob>(blobPath + ".grow", blobKeyLength, blobValueLength, blobCapacity + 1, options);
+        growBuffer.resize(std::max<uint64_t>(1, blobOptions.growStepRecords) * blobRecordLength);
+        growAddress = 0;
+    }
+    catch (const std::exception& e)
+    {
+        // blob keeps serving at its size, growth is tried again by the next new key
+        std::cerr << "Blob growth failed: " << e.what() << '\n';
+        grown.reset();
+    }
+}
+
+BlobStatus Blob::GrowStep() noexcept
+{
+    // the doubled blob gets at most one new key per step, so it is never filled before all records are moved
+    const auto count = std::min(growBuffer.size() / blobRecordLength, (blobCapacitySize - growAddress) / blobRecordLength);
+    if (!ReadBytesFromBlob(growAddress, growBuffer.data(), count * blobRecordLength))
+        return BlobStatus::IOError;
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        // keys set since the growth started are newer than the records moved now, so they are kept
+        const auto record = growBuffer.data() + i * blobRecordLength;
+        const auto slot = growAddress / blobRecordLength + i;
+        const auto stored = fingerprints ? fingerprints[slot].load() : Byte(0);
+        const bool isTaken = fingerprints ? stored != 0 && stored != tombstoneFingerprint
+                                          : !std::all_of(record, record + blobKeyLength, [](const Byte b) { return b == 0; })
+                                            && !IsTombstoneKey(record, blobKeyLength);
+        // tombstones stay behind, the doubled blob starts without them
+        if (!isTaken)
+            continue;
+        const auto status = grown->InsertRecord(record);
+        if (status != BlobStatus::Ok)
+            return status;
+    }
+    growAddress += count * blobRecordLength;
+    if (growAddress < blobCapacitySize)
+        return BlobStatus::Ok;
+
+    // log entries older than the growth may be checkpointed already, so moved records have to be on the disk first
+    if (wal && !grown->SyncBlob())
+        return BlobStatus::IOError;
+    // reads in flight probe this file with this capacity
+    if (ring)
+        ring->Drain();
+    if (std::rename((blobPath + ".grow").c_str(), blobPath.c_str()) != 0)
+        return BlobStatus::IOError;
+    file = std::move(grown->file);
+    mapping = std::move(grown->mapping);
+    pool = std::move(grown->pool);
+    blobCapacity = grown->blobCapacity;
+    storedRecords = std::move(grown->storedRecords);
+    tombstoneRecords = std::move(grown->tombstoneRecords);
+    compactSlot = 0;
+    fingerprints = std::move(grown->fingerprints);
+    bloom = std::move(grown->bloom);
+    bloomBits = grown->bloomBits;
+    zeroKeySlot = grown->zeroKeySlot;
+    grown.reset();
+    growBuffer = {};
+    Init();
+    return BlobStatus::Ok;
+}
+
+BlobStatus Blob::Get(std::span<const Byte> key, std::span<Byte> value) const noexcept
+{
+    const BlobOperationTimer timer(stats.get(), BlobOperation::Get);
+    return GetRecord(key, value);
+}
+
+BlobStatus Blob::Get(std::span<const Byte> key, std::span<Byte> value, uint64_t& valueLen) const noexcept
+{
+    const BlobOperationTimer timer(stats.get(), BlobOperation::Get);
+    valueLen = 0;
+    if (!valueLog)
+    {
+        const auto status = GetRecord(key, value);
+        if (status == BlobStatus::Ok)
+            valueLen = blobValueLength;
+        return status;
+    }
+    if (key.size() != blobKeyLength || value.size() < blobValueLength)
+        return BlobStatus::InvalidLength;
+    return GetLoggedValue(key.data(), value.data(), valueLen);
+}
+
+BlobStatus Blob::GetRecord(std::span<const Byte> key, std::span<Byte> value) const noexcept
+{
+    if (key.size() != blobKeyLength || value.size() < blobValueLength)
+        return BlobStatus::InvalidLength;
+    if (valueLog)
+    {
+        uint64_t valueLen = 0;
+        return GetLoggedValue(key.data(), value.data(), valueLen);
+    }
+    if (cache && cache->Get(key.data(), value.data()))
+        return BlobStatus::Ok;
+    if (grown)
+    {
+        // keys set or moved since the growth started are in the doubled blob, the rest are still here
+        const auto status = grown->Get(key, value);
+        if (status == BlobStatus::Ok && cache)
+            cache->Put(key.data(), value.data());
+        if (status != BlobStatus::NotFound)
+            return status;
+    }
+    // most misses end here without touching the records
+    if (bloom && !MayContain(key.data()))
+        return BlobStatus::NotFound;
+    for (;;)
+    {
+        // compaction doesn't wait for readers, the lookup is repeated if it moved records meanwhile
+        const auto epoch = LoadEpoch(std::memory_order_acquire);
+        if (epoch % 2 == 0)
+        {
+            const auto status = ReadValue(key.data(), value.data(), epoch);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (LoadEpoch(std::memory_order_relaxed) == epoch)
+                return status;
+        }
+        std::this_thread::yield();
+    }
+}
+
+BlobStatus Blob::ReadValue(const Byte* key, Byte* value, const uint64_t& epoch) const noexcept
+{
+    uint64_t address = GetKeyAddress(key);
+    if (isShrinked)
+    {
+        if (IsTombstoneKey(key, blobKeyLength))
+            return BlobStatus::NotFound;
+        const auto status = FindKeyAddressInShrinkedBlob(key, address);
+        if (status != BlobStatus::Ok)
+            return status;
+    }
+    // the lock only keeps the value from being read half written, moved keys are caught by the epoch
+    const auto lock = ReadLock(address);
+    const auto valueAddress = isShrinked ? address + blobKeyLength : address;
+    if (!ReadBytesFromBlob(valueAddress, value, slotValueLength))
+        return BlobStatus::IOError;
+    // slot read after compaction moved the key may hold another key by now
+    if (cache && LoadEpoch(std::memory_order_acquire) == epoch)
+        cache->Put(key, value);
+    return BlobStatus::Ok;
+}
+
+BlobStatus Blob::GetLoggedValue(const Byte* key, Byte* value, uint64_t& valueLen) const noexcept
+{
+    if (bloom && !MayContain(key))
+        return BlobStatus::NotFound;
+    Byte slotValue[maxSlotValueLength];
+    for (;;)
+    {
+        // collection moves the log entries and drops the old ones, so the entry read is only valid if it didn't run meanwhile
+        const auto epoch = LoadEpoch(std::memory_order_acquire);
+        if (epoch % 2 == 0)
+        {
+            auto status = cache && cache->Get(key, slotValue) ? BlobStatus::Ok : ReadValue(key, slotValue, epoch);
+            if (status == BlobStatus::Ok && !valueLog->Read(slotValue, value, valueLen))
+                status = BlobStatus::IOError;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (LoadEpoch(std::memory_order_relaxed) == epoch)
+                return status;
+        }
+        std::this_thread::yield();
+    }
+}
+
+bool Blob::ReleaseStoredValue(const uint64_t& valueAddress) noexcept
+{
+    // header and offset are enough to tell the entry, the inline bytes past them aren't read
+    Byte slotValue[BlobValueLog::slotHeaderLength + sizeof(uint64_t)];
+    if (!ReadBytesFromBlob(valueAddress, slotValue, sizeof(slotValue)))
+        return false;
+    valueLog->Release(slotValue);
+    return true;
+}
+
+void Blob::UpdateCache(const Byte* key, std::span<const Byte> value) const noexcept
+{
+    if (!cache)
+        return;
+    if (value.size() == slotValueLength)
+        cache->Put(key, value.data());
+    else
+        cache->Erase(key);
+}
+
+struct Blob::AsyncLookup
+{
+    const Byte* key;
+    Byte* value;
+    std::promise<BlobStatus> promise;
+    uint64_t home;              // address the chain starts at
+    uint64_t address;           // address of the first record being read
+    uint64_t count = 0;         // records being read
+    uint64_t probed = 0;        // records of the chain scanned so far
+    uint64_t epoch;             // compaction epoch the probe started at
+    uint64_t zeroKeySlot;       // taken when the lookup started, so the ring thread doesn't read it under a writer
+    std::vector<Byte> records;
+};
+
+namespace
+{
+std::future<BlobStatus> ReadyFuture(const BlobStatus& status)
+{
+    std::promise<BlobStatus> promise;
+    promise.set_value(status);
+    return promise.get_future();
+}
+}
+
+std::future<BlobStatus> Blob::GetAsync(std::span<const Byte> key, std::span<Byte> value) const
+{
+    if (key.size() != blobKeyLength || value.size() < blobValueLength)
+        return ReadyFuture(BlobStatus::InvalidLength);
+    if (!ring || grown)
+        return ReadyFuture(Get(key, value));
+    if (cache && cache->Get(key.data(), value.data()))
+        return ReadyFuture(BlobStatus::Ok);
+    if (bloom && !MayContain(key.data()))
+        return ReadyFuture(BlobStatus::NotFound);
+    if (isShrinked && IsTombstoneKey(key.data(), blobKeyLength))
+        return ReadyFuture(BlobStatus::NotFound);
+
+    const auto lookup = std::make_shared<AsyncLookup>();
+    lookup->key = key.data();
+    lookup->value = value.data();
+    lookup->home = GetKeyAddress(key.data());
+    lookup->address = lookup->home;
+    lookup->epoch = LoadEpoch(std::memory_order_acquire);
+    lookup->zeroKeySlot = zeroKeySlot;
+    auto future = lookup->promise.get_future();
+    if (!isShrinked)
+    {
+        // direct addressed value is a single read
+        const auto isQueued = ring->Read(fileno(file.get()), headerLength + lookup->address, lookup->value, blobValueLength,
+            [this, lookup](const int64_t& result)
+            {
+                if (result < 0)
+                    return lookup->promise.set_value(BlobStatus::IOError);
+                std::memset(lookup->value + result, 0, blobValueLength - result);
+                lookup->promise.set_value(BlobStatus::Ok);
+            });
+        CountIO(BlobCount::ReadCalls, blobValueLength);
+        if (!isQueued)
+            lookup->promise.set_value(BlobStatus::IOError);
+        return future;
+    }
+    lookup->records.resize(std::max(probePageLength, blobRecordLength));
+    ProbeAsync(lookup);
+    return future;
+}
+
+void Blob::ProbeAsync(const std::shared_ptr<AsyncLookup>& lookup) const
+{
+    // same reads as ProbeRange: records up to the next page boundary, at least one, never past the end of the blob
+    const auto address = lookup->address;
+    const auto pageEnd = (address + probePageLength) / probePageLength * probePageLength;
+    lookup->count = std::min({std::max<uint64_t>(1, (pageEnd - address) / blobRecordLength),
+                              (blobCapacitySize - address) / blobRecordLength, blobRecordsCount - lookup->probed});
+    const auto isQueued = ring->Read(fileno(file.get()), headerLength + address, lookup->records.data(), lookup->count * blobRecordLength,
+        [this, lookup](const int64_t& result) { CompleteProbe(lookup, result); });
+    CountIO(BlobCount::ReadCalls, lookup->count * blobRecordLength);
+    if (!isQueued)
+        lookup->promise.set_value(BlobStatus::IOError);
+}
+
+void Blob::CompleteProbe(const std::shared_ptr<AsyncLookup>& lookup, const int64_t& result) const
+{
+    if (result < 0)
+        return lookup->promise.set_value(BlobStatus::IOError);
+    const auto length = lookup->count * blobRecordLength;
+    std::memset(lookup->records.data() + result, 0, length - result);
+    // compaction moved records under the read, the chain is probed again from its home
+    const auto epoch = LoadEpoch(std::memory_order_acquire);
+    if (epoch != lookup->epoch || epoch % 2 != 0)
+    {
+        lookup->epoch = epoch;
+        lookup->address = lookup->home;
+        lookup->probed = 0;
+        return ProbeAsync(lookup);
+    }
+
+    const auto firstSlot = lookup->address / blobRecordLength;
+    for (uint64_t index = 0; index < lookup->count; ++index)
+    {
+        const auto record = lookup->records.data() + index * blobRecordLength;
+        auto state = ProbeStoredKey(lookup->key, record);
+        // with fingerprints the all zeros key has its own slot, every other slot of zeros is empty
+        if (fingerprints && (state == SlotState::Match || state == SlotState::Empty)
+            && std::all_of(record, record + blobKeyLength, [](const Byte b) { return b == 0; }))
+        {
+            if (firstSlot + index + 1 != lookup->zeroKeySlot)
+                state = SlotState::Empty;
+            else if (state == SlotState::Empty)
+                state = SlotState::Occupied;
+        }
+        if (state != SlotState::Match && state != SlotState::Empty)
+            continue;
+        if (stats)
+            stats->AddProbe(lookup->probed + index + 1);
+        if (state == SlotState::Empty)
+            return lookup->promise.set_value(BlobStatus::NotFound);
+        std::memcpy(lookup->value, record + blobKeyLength, blobValueLength);
+        return lookup->promise.set_value(BlobStatus::Ok);
+    }
+    lookup->probed += lookup->count;
+    lookup->address += length;
+    if (lookup->address == blobCapacitySize)
+        lookup->address = 0;
+    if (lookup->probed == blobRecordsCount)
+    {
+        if (stats)
+            stats->AddProbe(blobRecordsCount);
+        return lookup->promise.set_value(BlobStatus::NotFound);
+    }
+    ProbeAsync(lookup);
+}
+
+std::future<BlobStatus> Blob::SetAsync(std::span<const Byte> key, std::span<const Byte> value)
+{
+    // slot of the shrinked blob depends on the records the earlier Sets wrote, so its Set can't be reordered
+    if (!ring || isShrinked || key.size() != blobKeyLength || value.size() > blobValueLength)
+        return ReadyFuture(Set(key, value));
+    if (!LogUpdate(WalOperation::Set, key.data(), value))
+        return ReadyFuture(BlobStatus::IOError);
+    UpdateCache(key.data(), value);
+    auto promise = std::make_shared<std::promise<BlobStatus>>();
+    auto future = promise->get_future();
+    const auto length = value.size();
+    const auto isQueued = ring->Write(fileno(file.get()), headerLength + GetKeyAddress(key.data()), value.data(), length,
+        [promise, length](const int64_t& result)
+        {
+            promise->set_value(result == int64_t(length) ? BlobStatus::Ok : BlobStatus::IOError);
+        });
+    CountIO(BlobCount::WriteCalls, length);
+    if (!isQueued)
+        promise->set_value(BlobStatus::IOError);
+    CheckpointLongLog();
+    return future;
+}
+
+BlobScanner Blob::Scan() const
+{
+    return BlobScanner(*this, {}, {}, false);
+}
+
+BlobScanner Blob::Scan(std::span<const Byte> from, std::span<const Byte> to) const
+{
+    return BlobScanner(*this, from, to, true);
+}
+
+BlobStats Blob::Stats() const noexcept
+{
+    BlobStats result;
+    result.recordsCount = grown ? grown->RecordsCount() : RecordsCount();
+    result.storedRecords = StoredCount();
+    result.tombstoneRecords = TombstoneCount();
+    // every slot of the direct blob holds a value
+    result.loadFactor = isShrinked ? double(result.storedRecords + result.tombstoneRecords) / result.recordsCount : 1;
+    result.cacheHits = CacheHits();
+    result.cacheMisses = CacheMisses();
+    result.poolHits = PoolHits();
+    result.poolMisses = PoolMisses();
+    if (stats)
+        stats->Snapshot(result);
+    return result;
+}
+
+bool Blob::TryGet(const Byte* key, Byte* value) const noexcept
+{
+    return Get(std::span<const Byte>(key, blobKeyLength), std::span<Byte>(value, blobValueLength)) == BlobStatus::Ok;
+}
+
+std::shared_lock<std::shared_mutex> Blob::ReadLock(const uint64_t& address) const
+{
+    if (!stripes)
+        return {};
+    return std::shared_lock<std::shared_mutex>(stripes[address / probePageLength % blobOptions.lockStripes]);
+}
+
+std::unique_lock<std::shared_mutex> Blob::WriteLock(const uint64_t& address) const
+{
+    if (!stripes)
+        return {};
+    return std::unique_lock<std::shared_mutex>(stripes[address / probePageLength % blobOptions.lockStripes]);
+}
+
+std::shared_lock<std::shared_mutex> Blob::UpdateLock() const
+{
+    if (!compactionMutex)
+        return {};
+    return std::shared_lock<std::shared_mutex>(*compactionMutex);
+}
+
+std::unique_lock<std::shared_mutex> Blob::CompactionLock() const
+{
+    if (!compactionMutex)
+        return {};
+    return std::unique_lock<std::shared_mutex>(*compactionMutex);
+}
+
+namespace
+{
+// split address sorted batch into windows, entries with close addresses share one window;
+// callback gets the entries [first, last) and the window [start, end) in blob bytes
+template <typename Entries, typename Callback>
+void ForEachBatchWindow(const Entries& entries, const uint64_t& tail, const uint64_t& limit,
+                        const uint64_t& gap, const uint64_t& maxLength, Callback callback)
+{
+    for (size_t first = 0; first < entries.size();)
+    {
+        const auto start = entries[first].address;
+        auto end = std::min(limit, start + tail);
+        auto last = first + 1;
+        while (last < entries.size() && entries[last].address <= end + gap
+               && entries[last].address + tail - start <= maxLength)
+        {
+            end = std::min(limit, entries[last].address + tail);
+            ++last;
+        }
+        callback(first, last, start, end);
+        first = last;
+    }
+}
+}
+
+std::vector<Blob::BatchEntry> Blob::SortBatchByAddress(const Byte* keys, const uint64_t& count) const
+{
+    std::vector<BatchEntry> entries(count);
+    for (uint64_t i = 0; i < count; ++i)
+        entries[i] = {GetKeyAddress(keys + i * blobKeyLength), i};
+    std::stable_sort(entries.begin(), entries.end(), [](const BatchEntry& a, const BatchEntry& b) { return a.address < b.address; });
+    return entries;
+}
+
+std::vector<BlobStatus> Blob::MultiGet(std::span<const Byte> keys, std::span<Byte> values) const
+{
+    const BlobOperationTimer timer(stats.get(), BlobOperation::MultiGet);
+    const auto count = keys.size() / blobKeyLength;
+    std::vector<BlobStatus> statuses(count, BlobStatus::InvalidLength);
+    if (keys.size() % blobKeyLength != 0 || values.size() < count * blobValueLength)
+        return statuses;
+
+    const auto keyAt = [&](const uint64_t& index) { return std::span<const Byte>(keys.data() + index * blobKeyLength, blobKeyLength); };
+    const auto valueAt = [&](const uint64_t& index) { return std::span<Byte>(values.data() + index * blobValueLength, blobValueLength); };
+    auto entries = SortBatchByAddress(keys.data(), count);
+    if (bloom && !grown)
+    {
+        // keys the filter rules out need no window
+        std::erase_if(entries, [&](const BatchEntry& entry)
+        {
+            const bool isRuledOut = !MayContain(keyAt(entry.index).data());
+            if (isRuledOut)
+                statuses[entry.index] = BlobStatus::NotFound;
+            return isRuledOut;
+        });
+    }
+    if (cache && !(mapping || stripes || grown || fingerprints || valueLog))
+    {
+        // cached keys need no window either
+        std::erase_if(entries, [&](const BatchEntry& entry)
+        {
+            const bool isCached = cache->Get(keyAt(entry.index).data(), valueAt(entry.index).data());
+            if (isCached)
+                statuses[entry.index] = BlobStatus::Ok;
+            return isCached;
+        });
+    }
+    if (mapping || stripes || grown || fingerprints || valueLog)
+    {
+        // records are accessed in place, under the slot locks, in two blobs, through the fingerprints or hold encoded values,
+        // sorting only makes the accesses sequential
+        for (const auto& entry : entries)
+            statuses[entry.index] = GetRecord(keyAt(entry.index), valueAt(entry.index));
+        return statuses;
+    }
+
+    std::vector<Byte> window;
+    const auto tail = isShrinked ? (batchProbeRecords + 1) * blobRecordLength : blobValueLength;
+    ForEachBatchWindow(entries, tail, blobCapacitySize, batchWindowGap, batchWindowLength,
+        [&](const size_t& first, const size_t& last, const uint64_t& start, const uint64_t& end)
+        {
+            window.resize(end - start);
+            const bool isRead = ReadBytesFromBlob(start, window.data(), end - start);
+            for (auto i = first; i < last; ++i)
+            {
+                const auto& entry = entries[i];
+                if (!isRead)
+                {
+                    statuses[entry.index] = BlobStatus::IOError;
+                    continue;
+                }
+                if (!isShrinked)
+                {
+                    std::memcpy(valueAt(entry.index).data(), window.data() + (entry.address - start), blobValueLength);
+                    statuses[entry.index] = BlobStatus::Ok;
+                    if (cache)
+                        cache->Put(keyAt(entry.index).data(), valueAt(entry.index).data());
+                    continue;
+                }
+                // probe inside the window, chains running past it fall back to a single Get
+                const auto records = window.data() + (entry.address - start);
+                uint64_t index = 0;
+                const auto state = ScanRecords(keyAt(entry.index).data(), records, (end - entry.address) / blobRecordLength, index);
+                if (state == SlotState::Match)
+                {
+                    std::memcpy(valueAt(entry.index).data(), records + index * blobRecordLength + blobKeyLength, blobValueLength);
+                    statuses[entry.index] = BlobStatus::Ok;
+                    if (cache)
+                        cache->Put(keyAt(entry.index).data(), valueAt(entry.index).data());
+                }
+                else
+                    statuses[entry.index] = state == SlotState::Empty ? BlobStatus::NotFound : GetRecord(keyAt(entry.index), valueAt(entry.index));
+            }
+        });
+    return statuses;
+}
+
+std::vector<BlobStatus> Blob::MultiSet(std::span<const Byte> keys, std::span<const Byte> values)
+{
+    const BlobOperationTimer timer(stats.get(), BlobOperation::MultiSet);
+    auto statuses = SetBatch(keys, values);
+    CheckpointLongLog();
+    return statuses;
+}
+
+std::vector<BlobStatus> Blob::SetBatch(std::span<const Byte> keys, std::span<const Byte> values)
+{
+    const auto count = keys.size() / blobKeyLength;
+    std::vector<BlobStatus> statuses(count, BlobStatus::InvalidLength);
+    if (IsSharedReader())
+    {
+        std::fill(statuses.begin(), statuses.end(), BlobStatus::ReadOnly);
+        return statuses;
+    }
+    if (keys.size() % blobKeyLength != 0 || values.size() < count * blobValueLength)
+        return statuses;
+
+    const auto keyAt = [&](const uint64_t& index) { return std::span<const Byte>(keys.data() + index * blobKeyLength, blobKeyLength); };
+    const auto valueAt = [&](const uint64_t& index) { return std::span<const Byte>(values.data() + index * blobValueLength, blobValueLength); };
+    auto entries = SortBatchByAddress(keys.data(), count);
+    // blob used by one thread logs the whole batch and waits for it once, with lock stripes every record is logged
+    // under its slot lock by Set
+    const bool isBatchLogged = wal && !stripes;
+    if (isBatchLogged)
+    {
+        uint64_t lsn = 0;
+        for (uint64_t i = 0; i < count; ++i)
+            lsn = wal->Append(WalOperation::Set, keyAt(i).data(), valueAt(i).data(), blobValueLength);
+        if (blobOptions.durability != BlobDurability::Periodic && !wal->Sync(lsn))
+        {
+            std::fill(statuses.begin(), statuses.end(), BlobStatus::IOError);
+            return statuses;
+        }
+    }
+    if (mapping || stripes || grown || fingerprints || valueLog)
+    {
+        for (const auto& entry : entries)
+            statuses[entry.index] = SetRecord(keyAt(entry.index), valueAt(entry.index), isBatchLogged);
+        return statuses;
+    }
+    // blob is used by one thread here, so the batch keys can be dropped from the cache before they are written
+    if (cache)
+    {
+        for (const auto& entry : entries)
+            cache->Erase(keyAt(entry.index).data());
+    }
+    if (isShrinked)
+    {
+        // tombstone key is left with its InvalidLength status
+        std::erase_if(entries, [&](const BatchEntry& entry) { return IsTombstoneKey(keyAt(entry.index).data(), blobKeyLength); });
+    }
+
+    if (!isShrinked)
+    {
+        // runs of adjacent records go to one pwritev straight from the caller values
+        std::vector<iovec> parts;
+        std::vector<uint64_t> runIndexes;
+        uint64_t runStart = 0;
+        const auto flushRun = [&]()
+        {
+            const bool isWritten = WriteToFile(runStart, parts.data(), parts.size());
+            for (const auto& index : runIndexes)
+                statuses[index] = isWritten ? BlobStatus::Ok : BlobStatus::IOError;
+            parts.clear();
+            runIndexes.clear();
+        };
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            const auto& entry = entries[i];
+            // the last of equal keys wins, earlier ones are overwritten anyway
+            if (i + 1 < entries.size() && entries[i + 1].address == entry.address)
+            {
+                statuses[entry.index] = BlobStatus::Ok;
+                continue;
+            }
+            if (!parts.empty() && (entry.address != runStart + parts.size() * blobValueLength || parts.size() == IOV_MAX))
+                flushRun();
+            if (parts.empty())
+                runStart = entry.address;
+            parts.push_back({const_cast<Byte*>(valueAt(entry.index).data()), blobValueLength});
+            runIndexes.push_back(entry.index);
+        }
+        if (!parts.empty())
+            flushRun();
+        return statuses;
+    }
+
+    // records are placed in the window copy and written back with one pwrite per window,
+    // keys whose chains run past the window are set one by one after all windows are written
+    std::vector<Byte> window;
+    std::vector<uint64_t> unresolved;
+    ForEachBatchWindow(entries, (batchProbeRecords + 1) * blobRecordLength, blobCapacitySize, batchWindowGap, batchWindowLength,
+        [&](const size_t& first, const size_t& last, const uint64_t& start, const uint64_t& end)
+        {
+            window.resize(end - start);
+            if (!ReadBytesFromBlob(start, window.data(), end - start))
+            {
+                for (auto i = first; i < last; ++i)
+                    statuses[entries[i].index] = BlobStatus::IOError;
+                return;
+            }
+            auto dirtyStart = end;
+            uint64_t dirtyEnd = start;
+            uint64_t newRecords = 0;
+            uint64_t reusedTombstones = 0;
+            std::vector<uint64_t> placed;
+            for (auto i = first; i < last; ++i)
+            {
+                const auto& entry = entries[i];
+                uint64_t index = 0;
+                uint64_t tombstone = noTombstone;
+                auto state = ScanRecords(keyAt(entry.index).data(), window.data() + (entry.address - start),
+                                         (end - entry.address) / blobRecordLength, index, &tombstone);
+                if (state == SlotState::Occupied)
+                {
+                    unresolved.push_back(entry.index);
+                    continue;
+                }
+                if (state == SlotState::Empty && tombstone != noTombstone)
+                {
+                    index = tombstone;
+                    state = SlotState::Tombstone;
+                    ++reusedTombstones;
+                }
+                const auto address = entry.address + index * blobRecordLength;
+                const auto record = window.data() + (address - start);
+                std::memcpy(record, keyAt(entry.index).data(), blobKeyLength);
+                std::memcpy(record + blobKeyLength, valueAt(entry.index).data(), blobValueLength);
+                dirtyStart = std::min(dirtyStart, address);
+                dirtyEnd = std::max(dirtyEnd, address + blobRecordLength);
+                placed.push_back(entry.index);
+                newRecords += state != SlotState::Match;
+            }
+            const iovec dirty = {window.data() + (dirtyStart - start), dirtyEnd - dirtyStart};
+            const bool isWritten = dirtyStart >= dirtyEnd || WriteToFile(dirtyStart, &dirty, 1);
+            for (const auto& index : placed)
+                statuses[index] = isWritten ? BlobStatus::Ok : BlobStatus::IOError;
+            if (isWritten)
+            {
+                storedRecords.value += newRecords;
+                tombstoneRecords.value -= reusedTombstones;
+            }
+            if (isWritten && bloom)
+            {
+                for (const auto& index : placed)
+                    AddToBloom(keyAt(index).data());
+            }
+        });
+
+    StartGrowth();
+    std::sort(unresolved.begin(), unresolved.end());
+    for (const auto& index : unresolved)
+        statuses[index] = SetRecord(keyAt(index), valueAt(index), isBatchLogged);
+    return statuses;
+}
+
+void Blob::Init()
+{
+    // direct addressed blob uses the whole key as the slot number,
+    // shrinked one the high bits of the last sizeof(uint64_t) key bytes
+    // and the mixed one the high bits of the whole key hash
+    shift = 0;
+    const auto addressBits = blobOptions.keyHash == BlobKeyHash::Mixed ? 64 : std::min<uint64_t>(blobKeyLength, sizeof(uint64_t)) * 8;
+    if (blobCapacity != 0 && addressBits > blobCapacity)
+    {
+        shift = addressBits - blobCapacity;
+    }
+    slotValueLength = blobOptions.valueLogThreshold != 0 ? BlobValueLog::SlotLength(blobOptions.valueLogThreshold) : blobValueLength;
     if (blobCapacity == 0)
     {
-        blobRecordsCount = pow(2, blobKeyLength * 8);
-        blobRecordLength = blobValueLength;
+        blobRecordsCount = uint64_t(1) << (blobKeyLength * 8);
+        blobRecordLength = slotValueLength;
         isShrinked = false;
     }
     else
     {
         blobRecordsCount = pow(2, blobCapacity);
-        blobRecordLength = blobKeyLength + blobValueLength;
+        blobRecordLength = blobKeyLength + slotValueLength;
         isShrinked = true;
     }
     blobCapacitySize = blobRecordLength * blobRecordsCount;
 }
 
+void Blob::CreateBlobFile()
+{
+    const auto fd = fileno(file.get());
+    // sparse for direct addressed blobs, which can be much larger than the data in them,
+    // and only the header for the sparse layout, which appends the record pages as they are written
+    if (ftruncate(fd, headerLength + (blobOptions.sparse ? 0 : blobCapacitySize)) != 0)
+        throw std::runtime_error(std::string("Failed to size blob file: ") + std::strerror(errno));
+    if (isShrinked)
+        posix_fallocate(fd, 0, headerLength + blobCapacitySize);
+    if (!WriteHeader(false))
+        throw std::runtime_error(std::string("Failed to write blob header: ") + std::strerror(errno));
+    MapBlobFile();
+    CreateSlotTables();
+    // filter and directory left by the blob that had this path before
+    std::error_code error;
+    std::filesystem::remove(blobPath + ".bloom", error);
+    if (blobOptions.sparse)
+        directory = std::make_unique<BlobDirectory>(blobPath + ".pages", sparsePageLength, 0, false);
+    else
+        std::filesystem::remove(blobPath + ".pages", error);
+}
+
+void Blob::OpenBlobFile()
+{
+    BlobHeader header {};
+    struct stat fileStat {};
+    const auto fd = fileno(file.get());
+    if (pread(fd, &header, sizeof(header), 0) != ssize_t(sizeof(header))
+        || std::memcmp(header.magic, BlobHeader::blobMagic, sizeof(header.magic)) != 0
+        || header.version != BlobHeader::blobVersion)
+        throw std::logic_error("File is not a blob: " + blobPath);
+    if (header.keyLength != blobKeyLength || header.valueLength != blobValueLength
+        || header.capacity != blobCapacity || header.shift != shift || header.valueLogThreshold != blobOptions.valueLogThreshold
+        || header.keyHash != uint64_t(blobOptions.keyHash) || header.sparse != uint64_t(blobOptions.sparse))
+        throw std::logic_error("Blob header doesn't match the blob parameters: " + blobPath);
+    if (fstat(fd, &fileStat) != 0 || uint64_t(fileStat.st_size) < headerLength + (blobOptions.sparse ? 0 : blobCapacitySize))
+        throw std::logic_error("Blob file is shorter than its header says: " + blobPath);
+
+    MapBlobFile();
+    if (blobOptions.sparse)
+        directory = std::make_unique<BlobDirectory>(blobPath + ".pages", sparsePageLength,
+            (fileStat.st_size - headerLength + sparsePageLength - 1) / sparsePageLength, true);
+    storedRecords.value = header.storedRecords;
+    tombstoneRecords.value = header.tombstoneRecords;
+    zeroKeySlot = header.zeroKeySlot;
+    CreateSlotTables();
+    // saved filter is trusted only if the blob was closed cleanly after saving it
+    const bool isBloomLoaded = bloom && header.isClosed && LoadBloom(header.storedRecords);
+    // reader process takes the counts the writer saved last, the records change under it
+    if (IsSharedReader())
+        return;
+    if (isShrinked && (!header.isClosed || fingerprints || (bloom && !isBloomLoaded)))
+        CountStoredRecords();
+    // until it is closed again the count in the header is stale
+    if (!WriteHeader(false))
+        throw std::runtime_error(std::string("Failed to write blob header: ") + std::strerror(errno));
+}
+
+void Blob::MapBlobFile()
+{
+    // records go around the page cache from here on, the header stays on the buffered descriptor
+    if (blobOptions.storage == BlobStorage::Pool)
+        pool = std::make_unique<BlobPool>(blobPath, blobOptions.poolBytes);
+    if (blobOptions.storage != BlobStorage::Mmap)
+        return;
+    const auto length = headerLength + blobCapacitySize;
+    void* data = mmap(nullptr, length, IsSharedReader() ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fileno(file.get()), 0);
+    if (data == MAP_FAILED)
+        throw std::runtime_error(std::string("Failed to map blob file: ") + std::strerror(errno));
+    mapping = std::unique_ptr<Byte, MappingDeleter>(static_cast<Byte*>(data), MappingDeleter{length});
+}
+
+bool Blob::WriteHeader(const bool& isClosed) noexcept
+{
+    BlobHeader header {};
+    std::memcpy(header.magic, BlobHeader::blobMagic, sizeof(header.magic));
+    header.version = BlobHeader::blobVersion;
+    header.isClosed = isClosed;
+    header.keyLength = blobKeyLength;
+    header.valueLength = blobValueLength;
+    header.capacity = blobCapacity;
+    header.shift = shift;
+    header.storedRecords = storedRecords.value;
+    header.zeroKeySlot = zeroKeySlot;
+    header.tombstoneRecords = tombstoneRecords.value;
+    header.valueLogThreshold = blobOptions.valueLogThreshold;
+    header.keyHash = uint64_t(blobOptions.keyHash);
+    header.sparse = blobOptions.sparse;
+    CountIO(BlobCount::WriteCalls, sizeof(header));
+    return pwrite(fileno(file.get()), &header, sizeof(header), 0) == ssize_t(sizeof(header));
+}
+
+void Blob::CountStoredRecords()
+{
+    std::vector<Byte> chunk(std::max<uint64_t>(1, batchWindowLength / blobRecordLength) * blobRecordLength);
+    uint64_t count = 0;
+    uint64_t tombstones = 0;
+    for (uint64_t address = 0; address < blobCapacitySize; address += chunk.size())
+    {
+        const auto len = std::min<uint64_t>(chunk.size(), blobCapacitySize - address);
+        if (!ReadBytesFromBlob(address, chunk.data(), len))
+            throw std::runtime_error(std::string("Failed to read blob file: ") + std::strerror(errno));
+        for (uint64_t offset = 0; offset < len; offset += blobRecordLength)
+        {
+            const auto record = chunk.data() + offset;
+            const auto slot = (address + offset) / blobRecordLength;
+            if (std::all_of(record, record + blobKeyLength, [](const Byte b) { return b == 0; }) && slot + 1 != zeroKeySlot)
+                continue;
+            if (IsTombstoneKey(record, blobKeyLength))
+            {
+                ++tombstones;
+                if (fingerprints)
+                    fingerprints[slot].store(tombstoneFingerprint, std::memory_order_relaxed);
+                continue;
+            }
+            ++count;
+            if (fingerprints)
+                fingerprints[slot].store(FingerprintOf(record), std::memory_order_relaxed);
+            if (bloom)
+                AddToBloom(record);
+        }
+    }
+    storedRecords.value = count;
+    tombstoneRecords.value = tombstones;
+}
+
+Blob::~Blob()
+{
+    // moved from blob has nothing to close, reader process leaves the header to the writer
+    if (!file || IsSharedReader())
+        return;
+    // completions of the async calls read the blob members
+    if (ring)
+        ring->Drain();
+    // keys set while growing are only in the doubled blob, so it has to replace the blob first
+    while (grown && GrowStep() == BlobStatus::Ok)
+        ;
+    // header is marked closed only after the filter is saved, so a closed header means the filter is current
+    if (bloom && !SaveBloom())
+        return;
+    if (wal && !Checkpoint())
+        return;
+    WriteHeader(true);
+}
+
+void Blob::CreateSlotTables()
+{
+    if (!isShrinked)
+        return;
+    if (blobOptions.fingerprints)
+        fingerprints = std::make_unique<std::atomic<Byte>[]>(blobRecordsCount);
+    if (blobOptions.bloomBitsPerSlot != 0)
+    {
+        bloomBits = std::max<uint64_t>(1, blobRecordsCount * blobOptions.bloomBitsPerSlot / 64) * 64;
+        bloomHashes = std::clamp<uint64_t>(std::lround(blobOptions.bloomBitsPerSlot * std::log(2)), 1, 16);
+        bloom = std::make_unique<std::atomic<uint64_t>[]>(bloomBits / 64);
+    }
+}
+
+namespace
+{
+// k bit positions of the key are derived from two hashes
+template <typename Callback>
+void ForEachBloomBit(const uint64_t& hash, const uint64_t& bits, const uint64_t& hashes, Callback callback)
+{
+    const auto step = (hash * 0xC2B2AE3D27D4EB4F ^ hash >> 29) | 1;
+    for (uint64_t i = 0; i < hashes; ++i)
+    {
+        if (!callback((hash + i * step) % bits))
+            return;
+    }
+}
+
+// first bytes of the Bloom filter file, the filter words follow
+struct BloomHeader
+{
+    static constexpr char bloomMagic[8] = {'D', 'B', '3', '6', 'B', 'L', 'O', 'M'};
+
+    char magic[8];
+    uint64_t bits;
+    uint64_t hashes;
+    uint64_t storedRecords;
+};
+}
+
+void Blob::AddToBloom(const Byte* key) noexcept
+{
+    ForEachBloomBit(HashKey(key, blobKeyLength), bloomBits, bloomHashes, [this](const uint64_t& bit)
+    {
+        bloom[bit / 64].fetch_or(uint64_t(1) << bit % 64, std::memory_order_relaxed);
+        return true;
+    });
+}
+
+bool Blob::MayContain(const Byte* key) const noexcept
+{
+    bool isContained = true;
+    ForEachBloomBit(HashKey(key, blobKeyLength), bloomBits, bloomHashes, [&](const uint64_t& bit)
+    {
+        isContained = bloom[bit / 64].load(std::memory_order_relaxed) & uint64_t(1) << bit % 64;
+        return isContained;
+    });
+    return isContained;
+}
+
+bool Blob::LoadBloom(const uint64_t& recordsCount)
+{
+    std::unique_ptr<FILE, decltype(&fclose)> bloomFile(fopen((blobPath + ".bloom").c_str(), "r"), &fclose);
+    BloomHeader header {};
+    if (!bloomFile || fread(&header, sizeof(header), 1, bloomFile.get()) != 1
+        || std::memcmp(header.magic, BloomHeader::bloomMagic, sizeof(header.magic)) != 0
+        || header.bits != bloomBits || header.hashes != bloomHashes || header.storedRecords != recordsCount)
+        return false;
+    // atomic words have the layout of the plain ones
+    static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t));
+    return fread(bloom.get(), sizeof(uint64_t), bloomBits / 64, bloomFile.get()) == bloomBits / 64;
+}
+
+bool Blob::SaveBloom() const
+{
+    std::unique_ptr<FILE, decltype(&fclose)> bloomFile(fopen((blobPath + ".bloom").c_str(), "w"), &fclose);
+    BloomHeader header {};
+    std::memcpy(header.magic, BloomHeader::bloomMagic, sizeof(header.magic));
+    header.bits = bloomBits;
+    header.hashes = bloomHashes;
+    header.storedRecords = storedRecords.value;
+    return bloomFile && fwrite(&header, sizeof(header), 1, bloomFile.get()) == 1
+        && fwrite(bloom.get(), sizeof(uint64_t), bloomBits / 64, bloomFile.get()) == bloomBits / 64
+        && fflush(bloomFile.get()) == 0;
+}
+
+bool Blob::LogUpdate(const WalOperation& operation, const Byte* key, std::span<const Byte> value) noexcept
+{
+    if (!wal)
+        return true;
+    const auto lsn = wal->Append(operation, key, value.data(), value.size());
+    // periodic log is synced by its own thread, the record may reach the disk before its entry then
+    return blobOptions.durability == BlobDurability::Periodic || wal->Sync(lsn);
+}
+
+void Blob::CheckpointLongLog() noexcept
+{
+    if (wal && blobOptions.walCheckpointBytes != 0 && wal->Length() >= blobOptions.walCheckpointBytes)
+        Checkpoint();
+}
+
+void Blob::StartWal()
+{
+    const auto walPath = blobPath + ".wal";
+    if (blobOptions.openMode == BlobOpenMode::Open)
+    {
+        // log is replayed whatever the durability is now, the blob misses the updates of the crashed run otherwise
+        const bool isReplayed = BlobWal::Replay(walPath, blobKeyLength, blobValueLength,
+            [this](const WalOperation& operation, const Byte* key, const Byte* value, const uint64_t& valueLen)
+            {
+                if (operation == WalOperation::Delete)
+                    Delete(std::span<const Byte>(key, blobKeyLength));
+                else
+                    Set(std::span<const Byte>(key, blobKeyLength), std::span<const Byte>(value, valueLen));
+            });
+        if (!isReplayed)
+            throw std::logic_error("Blob log doesn't match the blob: " + walPath);
+        if (!WriteHeader(false) || !SyncBlob())
+            throw std::runtime_error(std::string("Failed to sync blob file: ") + std::strerror(errno));
+    }
+    if (blobOptions.durability == BlobDurability::None)
+    {
+        std::error_code error;
+        std::filesystem::remove(walPath, error);
+        return;
+    }
+    const auto syncInterval = blobOptions.durability == BlobDurability::Periodic
+        ? std::chrono::milliseconds(std::max<uint64_t>(1, blobOptions.walSyncIntervalMs)) : std::chrono::milliseconds(0);
+    wal = std::make_unique<BlobWal>(walPath, blobKeyLength, blobValueLength, syncInterval);
+}
+
+void Blob::StartValueLog()
+{
+    const auto logPath = blobPath + ".vlog";
+    if (blobOptions.valueLogThreshold == 0)
+    {
+        // log left by the blob that had this path before
+        std::error_code error;
+        std::filesystem::remove(logPath, error);
+        return;
+    }
+    valueLog = std::make_unique<BlobValueLog>(logPath, blobKeyLength, blobValueLength, blobOptions.valueLogThreshold,
+                                              blobOptions.openMode == BlobOpenMode::Open);
+}
+
+void Blob::StartRing() noexcept
+{
+    // mapped records are read in place, the ring thread can't take the slot locks of the caller
+    // and values of the value log take a second read, so only the plain file blob used by one thread gets the ring;
+    // pool pages are read by the calls themselves and pages of the sparse blob are found by them
+    if (blobOptions.asyncQueueDepth == 0 || mapping || pool || directory || stripes || valueLog)
+        return;
+    try
+    {
+        ring = std::make_unique<BlobRing>(blobOptions.asyncQueueDepth);
+    }
+    catch (const std::exception& e)
+    {
+        // async calls run synchronously then
+        std::cerr << "Blob io_uring is not available: " << e.what() << '\n';
+    }
+}
+
+bool Blob::SyncBlob() const noexcept
+{
+    // slots written after the entries they point at, so the entries reach the disk first
+    if (valueLog && !valueLog->Sync())
+        return false;
+    // same for the pages the records were written to
+    if (directory && !directory->Sync())
+        return false;
+    if (mapping && msync(mapping.get(), headerLength + blobCapacitySize, MS_SYNC) != 0)
+        return false;
+    // pool writes reach the file before they return, the sync flushes them out of the device cache with the header
+    return fdatasync(fileno(file.get())) == 0;
+}
+
+bool Blob::Checkpoint() noexcept
+{
+    if (IsSharedReader())
+        return false;
+    const auto compactionLock = CompactionLock();
+    // async writes are logged before they are queued, so they have to land before the log is dropped
+    if (ring)
+        ring->Drain();
+    if (!WriteHeader(false) || !SyncBlob())
+        return false;
+    // keys set while growing are only in the doubled blob until it replaces this one, so their entries are kept
+    if (grown)
+        return grown->SyncBlob();
+    return !wal || wal->Reset();
+}
+
+Blob Blob::Open(const std::string& path, BlobOptions options)
+{
+    BlobHeader header {};
+    std::unique_ptr<FILE, decltype(&fclose)> headerFile(fopen(path.c_str(), "r"), &fclose);
+    if (!headerFile || fread(&header, sizeof(header), 1, headerFile.get()) != 1
+        || std::memcmp(header.magic, BlobHeader::blobMagic, sizeof(header.magic)) != 0
+        || header.version != BlobHeader::blobVersion)
+        throw std::logic_error("File is not a blob: " + path);
+    if (options.openMode != BlobOpenMode::ReadShared)
+        options.openMode = BlobOpenMode::Open;
+    options.valueLogThreshold = header.valueLogThreshold;
+    options.keyHash = BlobKeyHash(header.keyHash);
+    options.sparse = header.sparse != 0;
+    return Blob(path, header.keyLength, header.valueLength, header.capacity, options);
+}
+
 uint64_t Blob::ConvertByteKeyToUintKey(const Byte* key) const
 {
     uint64_t tempKey = 0;
@@ -1,21 +1,168 @@
+#pragma once
+
+#include <atomic>
 #include <cerrno>
 #include <cmath>
 #include <cstring>
+#include <future>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
 #include <stdio.h>
 #include <string>
+#include <vector>
 
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
 #include <gtest/gtest_prod.h>
 
+#include "blob_cache.h"
+#include "blob_directory.h"
+#include "blob_pool.h"
+#include "blob_ring.h"
+#include "blob_scanner.h"
+#include "blob_stats.h"
+#include "blob_value_log.h"
+#include "blob_versions.h"
+#include "blob_wal.h"
+
 namespace DB36_NS
 {
 
     using Byte = uint8_t;
 
+    // how the blob file is accessed
+    enum class BlobStorage
+    {
+        File,   // every access is a pread/pwrite syscall
+        Mmap,   // whole blob file is mapped, records are accessed in place
+        Pool    // blob file is opened with O_DIRECT, its pages are kept in the blob's own buffer pool of poolBytes
+    };
+
+    // whether the constructor starts a new blob file or serves the existing one
+    enum class BlobOpenMode
+    {
+        Create,     // file is truncated and sized for the blob
+        Open,       // file is validated against its header and served as it is
+        ReadShared  // file is mapped read only while the writer process opened with sharedReaders changes it,
+                    // records are copied out and checked against its version counters instead of taking locks
+    };
+
+    // when the updates logged ahead of the records reach the disk
+    enum class BlobDurability
+    {
+        None,       // nothing is logged, records are written with a bare pwrite
+        Periodic,   // log is synced every walSyncIntervalMs, updates of the last interval may be lost
+        PerBatch,   // MultiSet waits once for its whole batch, single updates wait like PerOp
+        PerOp       // every update waits for its entry before it is written, concurrent ones share the sync
+    };
+
+    // how the shrinked blob takes the home slot from the key
+    enum class BlobKeyHash
+    {
+        Raw,        // high bits of the last 8 key bytes, keys stay in key order but sequential ones share their slots
+        Mixed       // high bits of a hash of the whole key, slots are spread whatever the keys look like
+    };
+
+    // optional blob parameters, defaults reproduce the plain file blob
+    struct BlobOptions
+    {
+        BlobStorage storage = BlobStorage::File;
+        uint64_t lockStripes = 0;   // number of slot locks shared by the threads, 0 means blob is used by one thread
+        double growLoadFactor = 0;  // shrinked blob doubles its capacity once this share of slots is taken, 0 disables growth
+        uint64_t growStepRecords = 64;  // records moved to the doubled blob by every Set while it grows
+        BlobOpenMode openMode = BlobOpenMode::Create;
+        bool fingerprints = false;  // shrinked blob keeps a byte per slot in memory, probing reads only the slots whose byte matches
+        uint64_t bloomBitsPerSlot = 0;  // shrinked blob checks keys against a Bloom filter of this size before probing, 0 disables it
+        double compactTombstoneRatio = 0;   // Delete runs a compaction step once this share of slots holds tombstones, 0 leaves it to Compact
+        uint64_t cacheBytes = 0;    // values of the recently read keys are kept in memory up to this size, 0 disables the cache
+        BlobDurability durability = BlobDurability::None;
+        uint64_t walSyncIntervalMs = 100;   // how often the periodic log is synced
+        uint32_t asyncQueueDepth = 0;   // file blob used by one thread serves GetAsync and SetAsync with io_uring requests
+                                        // up to this many in flight, 0 or a missing io_uring makes them synchronous
+        bool stats = false;         // collect the counters and histograms of Stats(), costs a branch per call if disabled
+        uint64_t valueLogThreshold = 0; // values longer than this are appended to the value log next to the blob file and
+                                        // their slots keep the offset, so slots take this many bytes plus 4; 0 disables the log
+        double valueLogGarbageRatio = 0;    // Set runs a log collection step once this share of the log is garbage,
+                                            // 0 leaves it to CollectValueLog
+        BlobKeyHash keyHash = BlobKeyHash::Raw; // kept in the header, so the blob is opened with the hash it was built with
+        uint64_t poolBytes = 64 << 20;  // memory of the pool storage, hot pages stay in it while the rest is evicted
+        bool sparse = false;        // direct addressed blob appends its record pages on their first write and finds them
+                                    // through the page directory next to the blob file, so only the written key ranges take disk
+        bool sharedReaders = false; // mapped blob bumps the version counters in the file next to it around every write,
+                                    // so processes opening it with ReadShared read it while this one writes
+        uint64_t walCheckpointBytes = 64 << 20; // Set and Delete checkpoint once the log holds this many bytes of entries,
+                                                // which bounds its file and the replay; 0 leaves it to Checkpoint
+    };
+
+    // result of the non-throwing blob operations
+    enum class BlobStatus
+    {
+        Ok,
+        NotFound,       // key is not stored in the blob
+        NoSpace,        // there is no free slot for the key
+        InvalidLength,  // key or value span doesn't fit the blob lengths
+        IOError,        // pread or pwrite failed
+        ReadOnly        // blob is opened by a reader process, only the writer process changes it
+    };
+
+    // first bytes of the blob file, records start at the page after it
+    struct BlobHeader
+    {
+        static constexpr char blobMagic[8] = {'D', 'B', '3', '6', 'B', 'L', 'O', 'B'};
+        static constexpr uint32_t blobVersion = 1;   // files of other versions are refused
+
+        char magic[8];
+        uint32_t version;
+        uint32_t isClosed;          // blob was closed cleanly, so the stored records count is exact
+        uint64_t keyLength;
+        uint64_t valueLength;
+        uint64_t capacity;
+        uint64_t shift;
+        uint64_t storedRecords;
+        uint64_t zeroKeySlot;       // slot of the all zeros key plus one, 0 if it isn't stored
+        uint64_t tombstoneRecords;  // slots of the deleted keys not reclaimed yet
+        uint64_t valueLogThreshold; // slots hold the values up to this length and the log offsets of the longer ones
+        uint64_t keyHash;           // BlobKeyHash the home slots are taken with
+        uint64_t sparse;            // record pages are found through the page directory
+    };
+
+    // well mixing hash of the whole key
+    uint64_t HashKey(const Byte* key, const uint64_t& keyLength) noexcept;
+    // hash of the whole key the mixed blob takes its home slots from, independent of HashKey,
+    // which picks the fingerprints, the Bloom bits and the shards
+    uint64_t MixKey(const Byte* key, const uint64_t& keyLength) noexcept;
+    // all 0xFF bytes key marks the slot of a deleted key, so it can't be stored
+    bool IsTombstoneKey(const Byte* key, const uint64_t& len) noexcept;
+
+    // atomic counter that moves together with the blob, moving itself is not thread safe
+    struct BlobCounter
+    {
+        std::atomic<uint64_t> value = 0;
+
+        BlobCounter() = default;
+        BlobCounter(BlobCounter&& other) noexcept : value(other.value.load()) {}
+        BlobCounter& operator= (BlobCounter&& other) noexcept
+        {
+            value = other.value.load();
+            return *this;
+        }
+    };
+
+    // unmaps the blob file, keeps the mapping movable together with the blob
+    struct MappingDeleter
+    {
+        uint64_t length = 0;
+        void operator()(Byte* data) const
+        {
+            munmap(data, length);
+        }
+    };
+
     class Blob 
     {
         private:
@@ -27,22 +174,235 @@ namespace DB36_NS
             uint64_t blobCapacitySize;      // blob size in bytes
             uint16_t shift = 0;             // shift used in key compression algorythm is blob is shrinked
             uint64_t blobRecordsCount;      // number of records is blob
+            uint64_t slotValueLength;       // bytes of the value in the record, the encoded value if blob has the value log
 
             bool isShrinked = false;
+            BlobOptions blobOptions;
             std::unique_ptr<FILE, decltype(&fclose)> file;
+            std::unique_ptr<Byte, MappingDeleter> mapping;
+            std::unique_ptr<BlobPool> pool; // pages of the O_DIRECT file if storage is pool
+            std::unique_ptr<BlobDirectory> directory;   // file pages of the record pages if blob is sparse
+            std::unique_ptr<BlobVersions> versions;     // counters shared with the reader processes or the writer one
+            std::unique_ptr<std::shared_mutex[]> stripes;   // page of records is guarded by stripe page % lockStripes
+            BlobCounter storedRecords;      // keys stored in the shrinked blob
+            BlobCounter tombstoneRecords;   // slots of the deleted keys, probing goes past them
+            BlobCounter compactionEpoch;    // odd while compaction moves records, readers retry if it changed under them
+            std::unique_ptr<std::shared_mutex> compactionMutex; // taken shared by Set and Delete, exclusively by Compact
+            uint64_t compactSlot = 0;       // slot the next compaction step starts at
+            std::unique_ptr<BlobCache> cache;   // hot values, written through by Set and dropped by Delete
+            std::unique_ptr<BlobWal> wal;   // updates since the last checkpoint, replayed by the next open after a crash
+            std::unique_ptr<BlobRing> ring; // reads and writes of the async calls
+            std::unique_ptr<BlobStatsCollector> stats;  // null unless the options ask for statistics
+            std::unique_ptr<BlobValueLog> valueLog;     // values longer than the threshold, slots point into it
+            std::unique_ptr<std::atomic<Byte>[]> fingerprints;  // fingerprint of the key in every slot, 0 for empty slots
+            uint64_t zeroKeySlot = 0;       // all zeros key can't be told from an empty slot by its bytes, so its slot is kept
+            std::unique_ptr<std::atomic<uint64_t>[]> bloom;     // Bloom filter of the stored keys, saved next to the blob file
+            uint64_t bloomBits = 0;
+            uint64_t bloomHashes = 0;
+
+            std::unique_ptr<Blob> grown;    // blob of the doubled capacity while records are moved to it
+            uint64_t growAddress = 0;       // records before this address are already moved
+            std::vector<Byte> growBuffer;   // records being moved
+
+            // what probing found in the slot
+            enum class SlotState
+            {
+                Match,      // slot holds the key
+                Empty,      // slot key is all zeros
+                Occupied,   // slot holds another key
+                Tombstone,  // slot key is all 0xFF, the key stored there was deleted
+                Error       // slot key couldn't be read
+            };
+            // keys are compared in chunks of this size, so probing needs no heap buffer
+            static constexpr uint64_t keyChunkLength = 64;
+            // probing reads records up to the next boundary of this size with one call
+            static constexpr uint64_t probePageLength = 4096;
+            // header takes the whole first page, so records stay page aligned in the file
+            static constexpr uint64_t headerLength = 4096;
+            // batched operations merge addresses closer than this gap into one read or write
+            static constexpr uint64_t batchWindowGap = 4096;
+            // and never read more than this in one window
+            static constexpr uint64_t batchWindowLength = 1 << 20;
+            // records read after the last home slot of the window, so short probe chains stay inside it
+            static constexpr uint64_t batchProbeRecords = 8;
+            // record pages of the sparse blob, records may span two of them
+            static constexpr uint64_t sparsePageLength = 4096;
+            // fingerprint of the slots holding a tombstone, fingerprints of the keys never take it
+            static constexpr Byte tombstoneFingerprint = 0xFF;
+            // slots visited by the compaction step Delete runs
+            static constexpr uint64_t compactStepSlots = 256;
+            // no tombstone was passed by probing
+            static constexpr uint64_t noTombstone = UINT64_MAX;
+            // slot value of the value log is encoded on the stack, so it can't be longer
+            static constexpr uint64_t maxSlotValueLength = 4096;
+            // bytes of the value log visited by the collection step Set runs
+            static constexpr uint64_t collectStepBytes = 1 << 20;
+
+            // key of the batch and the address it is sorted by
+            struct BatchEntry
+            {
+                uint64_t address;
+                uint64_t index;
+            };
+            // sort batch keys by their home address, equal addresses keep input order
+            std::vector<BatchEntry> SortBatchByAddress(const Byte* keys, const uint64_t& count) const;
+            // state of GetAsync probing the chain of the key a read at a time
+            struct AsyncLookup;
         protected:
             // calculate address for the shrinked blob
             uint64_t GetKeyAddress(const Byte* key) const;
+            // number the home slot of the key is taken from, the last sizeof(uint64_t) key bytes read as a little endian number
+            uint64_t KeyOrder(const Byte* key) const noexcept;
             // find address for the key in shrinked blob
             uint64_t GetKeyAddressInShrinkedBlob(const Byte* key) const;
             // find address for the key in shrinked blob
             uint64_t SetKeyAddressInShrinkedBlob(const Byte* key) const;
+            // non-throwing versions of the two above, the set version starts probing at the given address
+            BlobStatus FindKeyAddressInShrinkedBlob(const Byte* key, uint64_t& address) const noexcept;
+            BlobStatus FindSetAddressInShrinkedBlob(const Byte* key, uint64_t& address) const noexcept;
+            // lock the stripe of the record at the address, locks are empty if blob is used by one thread
+            std::shared_lock<std::shared_mutex> ReadLock(const uint64_t& address) const;
+            std::unique_lock<std::shared_mutex> WriteLock(const uint64_t& address) const;
+            // keep compaction from moving records while the key is set or deleted, and the other way round
+            std::shared_lock<std::shared_mutex> UpdateLock() const;
+            std::unique_lock<std::shared_mutex> CompactionLock() const;
             // read bytes in Byte array from the address, adress is in bytes
             std::unique_ptr<Byte[]> ReadBytesFromBlob(const uint64_t& address, const uint64_t& len) const;
+            // read bytes into the caller buffer, bytes past the end of file are zeros
+            bool ReadBytesFromBlob(const uint64_t& address, Byte* data, const uint64_t& len) const noexcept;
             // write bytes from the Byte array to the address, adress is in bytes
-            uint64_t WriteBytesToBlob(const uint64_t& address, Byte* data, const uint64_t& len);
-            // create file i
+            uint64_t WriteBytesToBlob(const uint64_t& address, const Byte* data, const uint64_t& len);
+            // read or write the bytes at the address of the file past the header, through the pool if it has one
+            bool ReadFromFile(const uint64_t& address, Byte* data, const uint64_t& len) const noexcept;
+            bool WritePartsToFile(const uint64_t& address, const iovec* parts, const int& count) noexcept;
+            // write the parts back to back at the record address, into the pages of the sparse blob,
+            // false if they weren't all written
+            bool WriteToFile(const uint64_t& address, const iovec* parts, const int& count) noexcept;
+            // write key and value of the record with a single call
+            bool WriteRecordToBlob(const uint64_t& address, const Byte* key, const Byte* value, const uint64_t& valueLen) noexcept;
+            // compare the key with the key stored at the address, in place if blob is mapped
+            SlotState ProbeSlot(const Byte* key, const uint64_t& address) const noexcept;
+            // compare the key with the key already loaded in memory
+            SlotState ProbeStoredKey(const Byte* key, const Byte* storedKey) const noexcept;
+            // find the first of count loaded records that holds the key or is empty, index is count if none is;
+            // tombstones are passed, the index of the first one goes to tombstone unless it already holds one
+            SlotState ScanRecords(const Byte* key, const Byte* records, const uint64_t& count, uint64_t& index,
+                                  uint64_t* tombstone = nullptr) const noexcept;
+            // probe records in [address, end) a page at a time, address is left at the found slot
+            SlotState ProbeRange(const Byte* key, uint64_t& address, const uint64_t& end, uint64_t* tombstone = nullptr) const noexcept;
+            // probe the whole chain starting at the address, wrapping around at the end of the blob;
+            // address of the first tombstone passed goes to tombstone, so Set can reuse it
+            SlotState ProbeChain(const Byte* key, uint64_t& address, uint64_t* tombstone = nullptr) const noexcept;
+            // same, but reads only the slots whose fingerprint matches the key
+            SlotState ProbeFingerprints(const Byte* key, uint64_t& address, uint64_t* tombstone) const noexcept;
+            // state of the single slot, empty slots are told by the fingerprints if blob has them
+            SlotState CheckSlot(const Byte* key, const uint64_t& address) const noexcept;
+            // account the new key written to the empty slot at the address
+            void TakeSlot(const Byte* key, const uint64_t& address) noexcept;
+            // write the pattern of the empty slot or the tombstone over the key at the address
+            bool MarkSlot(const uint64_t& address, const SlotState& state) noexcept;
+            // fill len bytes at the address with the byte
+            bool FillBytes(const uint64_t& address, const Byte& fill, const uint64_t& len) noexcept;
+            // read the record of the slot and tell whether it is empty, a tombstone or taken
+            SlotState ReadSlot(const uint64_t& slot, Byte* record) const noexcept;
+            // Set and the key slot to tombstone part of Delete, the update is logged first unless the caller logged it
+            BlobStatus SetRecord(std::span<const Byte> key, std::span<const Byte> value, const bool& isLogged) noexcept;
+            BlobStatus DeleteRecord(const Byte* key, const bool& isLogged) noexcept;
+            // Delete and MultiSet without the timing and the checkpoint of the long log
+            BlobStatus DeleteKey(std::span<const Byte> key) noexcept;
+            std::vector<BlobStatus> SetBatch(std::span<const Byte> keys, std::span<const Byte> values);
+            // Get without the timing, so the batches fall back to it without counting the lookup twice
+            BlobStatus GetRecord(std::span<const Byte> key, std::span<Byte> value) const noexcept;
+            // rest of SetRecord once the value is encoded, stored is what goes to the slot; the update lock is held
+            BlobStatus StoreRecord(std::span<const Byte> key, std::span<const Byte> value, std::span<const Byte> stored,
+                                   const bool& isLogged) noexcept;
+            // read the slot value of the key and decode it, retried like Get while collection moves values
+            BlobStatus GetLoggedValue(const Byte* key, Byte* value, uint64_t& valueLen) const noexcept;
+            // the slot value at the address is about to be overwritten, so its log entry becomes garbage
+            bool ReleaseStoredValue(const uint64_t& valueAddress) noexcept;
+            // open the value log if the options ask for it
+            void StartValueLog();
+            // append the update to the log and wait for it as the durability asks, true if there is no log
+            bool LogUpdate(const WalOperation& operation, const Byte* key, std::span<const Byte> value) noexcept;
+            // checkpoint if the log passed walCheckpointBytes, called with no lock of the blob held
+            void CheckpointLongLog() noexcept;
+            // replay the log left by the last run and start the new one
+            void StartWal();
+            // set up io_uring for the async calls if the options ask for it and the kernel has it
+            void StartRing() noexcept;
+            // flush the written records and the header to the disk
+            bool SyncBlob() const noexcept;
+            // move the records that probed past the tombstone back into it and clear the slot left last,
+            // false if a record couldn't be read or written
+            bool ReclaimTombstone(uint64_t hole, Byte* record) noexcept;
+            // look the key up and read its value, the result is only valid if no compaction ran meanwhile;
+            // the value is cached only if the epoch is still the one the lookup started at
+            BlobStatus ReadValue(const Byte* key, Byte* value, const uint64_t& epoch) const noexcept;
+            // queue the read of the records from the lookup address up to the next page boundary
+            void ProbeAsync(const std::shared_ptr<AsyncLookup>& lookup) const;
+            // scan the records read for the lookup, then finish it or queue the next read
+            void CompleteProbe(const std::shared_ptr<AsyncLookup>& lookup, const int64_t& result) const;
+            // write the value set for the key through to the cache, a partial value drops the key instead
+            void UpdateCache(const Byte* key, std::span<const Byte> value) const noexcept;
+            // fingerprint byte of the key, never 0 and never the tombstone one
+            Byte FingerprintOf(const Byte* key) const noexcept;
+            // allocate the in-memory tables the options ask for
+            void CreateSlotTables();
+            // Bloom filter of the stored keys, may give false positives but never false negatives
+            void AddToBloom(const Byte* key) noexcept;
+            bool MayContain(const Byte* key) const noexcept;
+            // Bloom filter is loaded only if it was saved for this blob with this many keys
+            bool LoadBloom(const uint64_t& recordsCount);
+            bool SaveBloom() const;
+            // write the record (key followed by value) unless the key is already stored
+            BlobStatus InsertRecord(const Byte* record) noexcept;
+            // start doubling the blob once the load factor is reached
+            void StartGrowth() noexcept;
+            // move the next records to the doubled blob and replace the blob with it after the last one
+            BlobStatus GrowStep() noexcept;
+            // size the blob file and map it if storage is mmap
             void CreateBlobFile();
+            // check the header of the existing blob file and map it if storage is mmap
+            void OpenBlobFile();
+            // map the blob file or open its pool as the storage asks
+            void MapBlobFile();
+            // write blob parameters and stored records count to the header
+            bool WriteHeader(const bool& isClosed) noexcept;
+            // count the stored keys and fill the fingerprints by reading all records
+            void CountStoredRecords();
+            // count the file read or write of len bytes
+            void CountIO(const BlobCount& calls, const uint64_t& len) const noexcept
+            {
+                if (!stats)
+                    return;
+                stats->Add(calls, 1);
+                stats->Add(calls == BlobCount::ReadCalls ? BlobCount::BytesRead : BlobCount::BytesWritten, len);
+            }
+            // blob is mapped by a reader process, which never writes and never reads records in place
+            bool IsSharedReader() const noexcept
+            {
+                return blobOptions.openMode == BlobOpenMode::ReadShared;
+            }
+            bool IsReadInPlace() const noexcept
+            {
+                return mapping && !IsSharedReader();
+            }
+            // compaction epoch, the writer's one from the shared counters if blob has reader processes
+            uint64_t LoadEpoch(const std::memory_order& order) const noexcept
+            {
+                return versions ? versions->Epoch(order) : compactionEpoch.value.load(order);
+            }
+            void StoreEpoch(const uint64_t& epoch, const std::memory_order& order) noexcept
+            {
+                compactionEpoch.value.store(epoch, order);
+                if (versions)
+                    versions->SetEpoch(epoch, order);
+            }
+            // first byte of the record in the mapping
+            Byte* MappedAt(const uint64_t& address) const noexcept
+            {
+                return mapping.get() + headerLength + address;
+            }
             // convert convert key in byte form to key in uint64 form
             uint64_t ConvertByteKeyToUintKey(const Byte* key) const;
 
@@ -53,12 +413,15 @@ namespace DB36_NS
                 const std::string& path,
                 const uint64_t& keyLength,
                 const uint64_t& valueLength,
-                const uint8_t& capacity) :
+                const uint8_t& capacity,
+                const BlobOptions& options = {}) :
                 blobPath(path),
                 blobKeyLength(keyLength),
                 blobValueLength(valueLength),
                 blobCapacity(capacity),
-                file(fopen(blobPath.c_str(), "w+"), &fclose)
+                blobOptions(options),
+                file(fopen(blobPath.c_str(), options.openMode == BlobOpenMode::Create ? "w+"
+                                             : options.openMode == BlobOpenMode::Open ? "r+" : "r"), &fclose)
                 {
                     if (!file.get())
                     {
@@ -66,19 +429,102 @@ namespace DB36_NS
                         std::cerr << "File creation failed: " << std::strerror(errno) << '\n';
                         throw(std::logic_error("Failed to initialize blob"));
                     }
-                    posix_fallocate(fileno(file.get()), 0, blobCapacitySize);
+                    if (blobOptions.growLoadFactor > 0 && blobOptions.lockStripes != 0)
+                        throw(std::logic_error("Blob growth is not supported with lock stripes"));
+                    if (blobOptions.valueLogThreshold != 0 && (blobOptions.valueLogThreshold >= blobValueLength
+                        || BlobValueLog::SlotLength(blobOptions.valueLogThreshold) > maxSlotValueLength || blobValueLength > UINT32_MAX))
+                        throw(std::logic_error("Value log threshold has to be shorter than the value and its slot at most a page"));
+                    if (blobOptions.growLoadFactor > 0 && blobOptions.valueLogThreshold != 0)
+                        throw(std::logic_error("Blob growth is not supported with the value log"));
+                    if (blobOptions.keyHash != BlobKeyHash::Raw && blobCapacity == 0)
+                        throw(std::logic_error("Key hashing needs a shrinked blob, direct addressed slots are the keys"));
+                    // addresses of the direct addressed slots have to fit 63 bits, so 8 bytes keys are never direct addressed
+                    if (blobCapacity == 0 && (blobKeyLength >= sizeof(uint64_t)
+                        || (uint64_t(1) << (63 - blobKeyLength * 8)) <= blobValueLength + BlobValueLog::slotHeaderLength))
+                        throw(std::logic_error("Keys are too long to address the records directly, a shrinked blob has to be used"));
+                    if (blobOptions.sparse && (blobCapacity != 0 || blobOptions.storage == BlobStorage::Mmap))
+                        throw(std::logic_error("Sparse layout needs a direct addressed blob that isn't mapped"));
+                    if ((blobOptions.sharedReaders || IsSharedReader()) && (blobOptions.storage != BlobStorage::Mmap
+                        || blobOptions.growLoadFactor > 0 || blobOptions.valueLogThreshold != 0))
+                        throw(std::logic_error("Shared readers need a mapped blob without growth and the value log"));
+                    if (IsSharedReader() && (blobOptions.cacheBytes != 0 || blobOptions.fingerprints || blobOptions.bloomBitsPerSlot != 0
+                        || blobOptions.durability != BlobDurability::None))
+                        throw(std::logic_error("Reader process can't keep tables or logs of the blob the writer changes"));
                     Init();
+                    if (blobOptions.openMode == BlobOpenMode::Create)
+                        CreateBlobFile();
+                    else
+                        OpenBlobFile();
+                    if (blobOptions.sharedReaders || IsSharedReader())
+                        versions = std::make_unique<BlobVersions>(blobPath + ".versions", !IsSharedReader());
+                    if (blobOptions.lockStripes != 0)
+                    {
+                        stripes = std::make_unique<std::shared_mutex[]>(blobOptions.lockStripes);
+                        compactionMutex = std::make_unique<std::shared_mutex>();
+                    }
+                    // cache keeps the slot values, the encoded ones if blob has the value log
+                    if (blobOptions.cacheBytes != 0)
+                        cache = std::make_unique<BlobCache>(blobOptions.cacheBytes, blobKeyLength, slotValueLength, blobOptions.lockStripes);
+                    if (blobOptions.stats)
+                        stats = std::make_unique<BlobStatsCollector>();
+                    // files next to the blob belong to the writer process
+                    if (IsSharedReader())
+                        return;
+                    StartValueLog();
+                    StartWal();
+                    StartRing();
                 }
             Blob() = delete;
             Blob(const Blob&) = delete;
             Blob& operator= (const Blob&) = delete;
             Blob(Blob&&) = default;
             Blob& operator= (Blob&&) = default;
-            ~Blob() = default;
+            // finishes growth and marks the header closed, so the blob reopens without a rescan
+            ~Blob();
+            // open the existing blob file with the parameters stored in its header
+            static Blob Open(const std::string& path, BlobOptions options = {});
             // write value associated with the key
             void Set(Byte* key, Byte* value, const uint64_t& valueLen);
             // get value associated with the key
             std::unique_ptr<Byte[]> Get(const Byte* key) const;
+            // allocation-free versions: key is KeyLength() bytes, value is at most ValueLength() bytes for Set
+            // and at least ValueLength() bytes for Get
+            BlobStatus Set(std::span<const Byte> key, std::span<const Byte> value) noexcept;
+            BlobStatus Get(std::span<const Byte> key, std::span<Byte> value) const noexcept;
+            // same, also tells the length of the value set, which is ValueLength() unless blob has the value log;
+            // with the value log Set stores exactly the value given and Get fills the bytes past it with zeros
+            BlobStatus Get(std::span<const Byte> key, std::span<Byte> value, uint64_t& valueLen) const noexcept;
+            // read the value into the ValueLength() bytes buffer, false if the key is not stored or couldn't be read
+            bool TryGet(const Byte* key, Byte* value) const noexcept;
+            // remove the key, its slot becomes a tombstone until compaction reclaims it;
+            // all 0xFF bytes key is the tombstone, so shrinked blob never stores it;
+            // direct addressed blob has no tombstones and only clears the value
+            void Delete(const Byte* key);
+            BlobStatus Delete(std::span<const Byte> key) noexcept;
+            // put the records on the disk and drop the log entries they cover; Set and Delete wait meanwhile
+            bool Checkpoint() noexcept;
+            // visit up to maxSlots slots after the last visited one and reclaim the tombstones among them,
+            // returns the number of reclaimed tombstones; readers go on while it runs, Set and Delete wait
+            uint64_t Compact(const uint64_t& maxSlots) noexcept;
+            // visit up to maxBytes of the oldest value log entries, append the live ones again and drop the rest from the file,
+            // returns the bytes dropped; like Compact, readers go on while it runs, Set and Delete wait
+            uint64_t CollectValueLog(const uint64_t& maxBytes) noexcept;
+            // batched versions: keys and values are packed back to back, ValueLength() bytes per value,
+            // nearby records are read and written together, statuses are returned in input order
+            std::vector<BlobStatus> MultiGet(std::span<const Byte> keys, std::span<Byte> values) const;
+            std::vector<BlobStatus> MultiSet(std::span<const Byte> keys, std::span<const Byte> values);
+            // asynchronous versions: the future is ready once the record is read or written, until then the key and value
+            // have to stay valid and the blob must not be moved; shrinked blob chains a read per page of the probe,
+            // Set of the shrinked blob, growing blobs and blobs without the ring run synchronously;
+            // a key updated while its read is in flight may be read half written
+            std::future<BlobStatus> GetAsync(std::span<const Byte> key, std::span<Byte> value) const;
+            std::future<BlobStatus> SetAsync(std::span<const Byte> key, std::span<const Byte> value);
+            // stored records in file order, the blob must outlive the scanner and must not be moved meanwhile
+            BlobScanner Scan() const;
+            // only the keys from from to to: keys are ordered by their last sizeof(uint64_t) bytes read as
+            // a little endian number, which is the order of their home slots, so only the slots of the range are read;
+            // home slots of the mixed key hash don't follow the keys, so the whole blob is read then
+            BlobScanner Scan(std::span<const Byte> from, std::span<const Byte> to) const;
         public:
             int64_t RecordsCount() const
             {
@@ -96,8 +542,78 @@ namespace DB36_NS
             {
                 return blobValueLength;
             }
+            BlobStorage Storage() const
+            {
+                return blobOptions.storage;
+            }
+            // Get, Set and Delete are thread safe only with lock stripes
+            uint64_t LockStripes() const
+            {
+                return blobOptions.lockStripes;
+            }
+            // keys stored in the shrinked blob, including the ones moved to the doubled blob
+            int64_t StoredCount() const
+            {
+                return grown ? grown->StoredCount() : storedRecords.value.load();
+            }
+            bool IsGrowing() const
+            {
+                return grown != nullptr;
+            }
+            // lookups answered by the cache and the ones that went to the records, 0 without the cache
+            uint64_t CacheHits() const
+            {
+                return cache ? cache->Hits() : 0;
+            }
+            uint64_t CacheMisses() const
+            {
+                return cache ? cache->Misses() : 0;
+            }
+            // page reads answered by the pool and the ones that went to the file, 0 unless storage is pool
+            uint64_t PoolHits() const
+            {
+                return pool ? pool->Hits() : 0;
+            }
+            uint64_t PoolMisses() const
+            {
+                return pool ? pool->Misses() : 0;
+            }
+            // memory taken by the pool, which doesn't grow past the budget however large the blob is
+            uint64_t PoolBytes() const
+            {
+                return pool ? pool->Bytes() : 0;
+            }
+            // record pages the sparse blob has written so far, 0 unless blob is sparse
+            uint64_t SparsePagesCount() const
+            {
+                return directory ? directory->PagesCount() : 0;
+            }
+            int64_t TombstoneCount() const
+            {
+                return grown ? grown->TombstoneCount() : tombstoneRecords.value.load();
+            }
+            // counters, probe lengths and latencies collected so far together with the fill of the blob
+            BlobStats Stats() const noexcept;
+            // bytes of the value log entries not collected yet and the share of them no slot points at
+            uint64_t ValueLogBytes() const
+            {
+                return valueLog ? valueLog->Bytes() : 0;
+            }
+            double ValueLogGarbageRatio() const
+            {
+                return valueLog && valueLog->Bytes() ? double(valueLog->GarbageBytes()) / valueLog->Bytes() : 0;
+            }
+            // share of the slots holding tombstones, chains get longer as it grows
+            double TombstoneRatio() const
+            {
+                return double(TombstoneCount()) / (grown ? grown->RecordsCount() : RecordsCount());
+            }
             void Init();
         private:
+            // writes the records of a new blob in slot order, bypassing Set
+            friend class BlobBuilder;
+            // reads the slots in chunks under the locks and the epoch of the blob
+            friend class BlobScanner;
             FRIEND_TEST(BlobTest, SlotOfTest);
             FRIEND_TEST(BlobTest, AutoCapacityTest);
             FRIEND_TEST(BlobTest, ReadWriteTest);
@@ -0,0 +1,262 @@
+#include "blob_builder.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <queue>
+#include <stdexcept>
+
+namespace DB36_NS
+{
+
+BlobBuilder::BlobBuilder(const std::string& path, const uint64_t& keyLength, const uint64_t& valueLength, const uint8_t& capacity,
+                         const BlobOptions& options, const uint64_t& memoryBytes) :
+    blob(path, keyLength, valueLength, capacity, [&options]()
+    {
+        auto createOptions = options;
+        createOptions.openMode = BlobOpenMode::Create;
+        return createOptions;
+    }()),
+    entryLength(sizeof(uint64_t) + keyLength + sizeof(uint32_t) + valueLength),
+    runRecords(std::max<uint64_t>(1, memoryBytes / entryLength))
+{
+}
+
+BlobBuilder::~BlobBuilder()
+{
+    RemoveRuns();
+}
+
+std::string BlobBuilder::RunPath(const uint64_t& run) const
+{
+    return blob.blobPath + ".run" + std::to_string(run);
+}
+
+void BlobBuilder::RemoveRuns() noexcept
+{
+    std::error_code error;
+    for (uint64_t run = 0; run < runsCount; ++run)
+        std::filesystem::remove(RunPath(run), error);
+    runsCount = 0;
+}
+
+bool BlobBuilder::IsBefore(const Byte* a, const Byte* b) const noexcept
+{
+    const auto addressA = AddressOf(a);
+    const auto addressB = AddressOf(b);
+    if (addressA != addressB)
+        return addressA < addressB;
+    return std::memcmp(a + sizeof(uint64_t), b + sizeof(uint64_t), blob.blobKeyLength) < 0;
+}
+
+BlobStatus BlobBuilder::Add(std::span<const Byte> key, std::span<const Byte> value) noexcept
+{
+    // tombstone key would read as a deleted slot once it is written
+    if (isFinished || key.size() != uint64_t(blob.blobKeyLength) || value.size() > blob.blobValueLength
+        || IsTombstoneKey(key.data(), key.size()))
+        return BlobStatus::InvalidLength;
+    if (entries.size() / entryLength == runRecords && !SpillEntries())
+        return BlobStatus::IOError;
+    try
+    {
+        const auto start = entries.size();
+        entries.resize(start + entryLength);
+        const auto entry = entries.data() + start;
+        const uint32_t valueLen = value.size();
+        // home address is hashed once here, sorting and merging only compare it
+        const auto address = blob.GetKeyAddress(key.data());
+        std::memcpy(entry, &address, sizeof(address));
+        std::memcpy(entry + sizeof(address), key.data(), key.size());
+        std::memcpy(entry + sizeof(address) + key.size(), &valueLen, sizeof(valueLen));
+        std::memcpy(entry + sizeof(address) + key.size() + sizeof(valueLen), value.data(), valueLen);
+    }
+    catch (const std::bad_alloc&)
+    {
+        // spilled entries free the memory for the record, unless there were none
+        return !entries.empty() && SpillEntries() ? Add(key, value) : BlobStatus::IOError;
+    }
+    return BlobStatus::Ok;
+}
+
+void BlobBuilder::SortEntries()
+{
+    order.resize(entries.size() / entryLength);
+    for (uint64_t i = 0; i < order.size(); ++i)
+        order[i] = {AddressOf(EntryAt(i)), i};
+    std::sort(order.begin(), order.end(), [this](const auto& a, const auto& b)
+    {
+        if (a.first != b.first)
+            return a.first < b.first;
+        const auto keyOrder = std::memcmp(EntryAt(a.second) + sizeof(uint64_t), EntryAt(b.second) + sizeof(uint64_t), blob.blobKeyLength);
+        return keyOrder != 0 ? keyOrder < 0 : a.second < b.second;
+    });
+}
+
+bool BlobBuilder::SpillEntries()
+{
+    if (entries.empty())
+        return true;
+    SortEntries();
+    std::unique_ptr<FILE, decltype(&fclose)> file(fopen(RunPath(runsCount).c_str(), "w"), &fclose);
+    if (!file)
+        return false;
+    ++runsCount;
+    for (const auto& [address, index] : order)
+    {
+        if (fwrite(EntryAt(index), entryLength, 1, file.get()) != 1)
+            return false;
+    }
+    entries.clear();
+    order.clear();
+    return fflush(file.get()) == 0;
+}
+
+bool BlobBuilder::Advance(Run& run) const
+{
+    if (!run.file)
+    {
+        run.current = run.next < order.size() ? EntryAt(order[run.next++].second) : nullptr;
+        return true;
+    }
+    const auto count = fread(run.record.data(), entryLength, 1, run.file.get());
+    run.current = count == 1 ? run.record.data() : nullptr;
+    return count == 1 || !ferror(run.file.get());
+}
+
+Blob BlobBuilder::Finish()
+{
+    if (isFinished)
+        throw std::logic_error("Blob is built already");
+    isFinished = true;
+    // runs are merged oldest first, the records left in memory are the newest run
+    std::vector<Run> runs(runsCount + 1);
+    for (uint64_t i = 0; i < runsCount; ++i)
+    {
+        runs[i].file.reset(fopen(RunPath(i).c_str(), "r"));
+        runs[i].record.resize(entryLength);
+        if (!runs[i].file)
+            throw std::runtime_error(std::string("Failed to open blob build run: ") + std::strerror(errno));
+    }
+    SortEntries();
+    const auto isLater = [this, &runs](const uint64_t& a, const uint64_t& b)
+    {
+        if (IsBefore(runs[b].current, runs[a].current))
+            return true;
+        return !IsBefore(runs[a].current, runs[b].current) && a > b;
+    };
+    std::priority_queue<uint64_t, std::vector<uint64_t>, decltype(isLater)> heap(isLater);
+    for (uint64_t i = 0; i < runs.size(); ++i)
+    {
+        if (!Advance(runs[i]))
+            throw std::runtime_error(std::string("Failed to read blob build run: ") + std::strerror(errno));
+        if (runs[i].current)
+            heap.push(i);
+    }
+
+    const auto keyLength = uint64_t(blob.blobKeyLength);
+    const auto recordLength = blob.blobRecordLength;
+    const auto recordsCount = blob.blobRecordsCount;
+    std::vector<Byte> window(std::max<uint64_t>(1, windowLength / recordLength) * recordLength);
+    uint64_t windowStart = 0;       // address of the first slot in the window
+    uint64_t windowEnd = 0;         // end of the slots written to the window so far
+    uint64_t nextSlot = 0;          // slots before it are taken
+    std::vector<Byte> overflow;     // records whose chains run past the last slot, set once the rest is written
+    std::vector<Byte> pending(entryLength);
+    std::vector<Byte> slotValue(blob.slotValueLength);
+    bool isPending = false;
+
+    const auto flushWindow = [&]()
+    {
+        const iovec part = {window.data(), windowEnd - windowStart};
+        if (windowEnd > windowStart && !blob.WriteToFile(windowStart, &part, 1))
+            throw std::runtime_error(std::string("Failed to write blob file: ") + std::strerror(errno));
+        std::fill(window.begin(), window.end(), 0);
+    };
+    const auto place = [&](const Byte* entry)
+    {
+        const auto home = AddressOf(entry) / recordLength;
+        entry += sizeof(uint64_t);
+        uint32_t valueLen = 0;
+        std::memcpy(&valueLen, entry + keyLength, sizeof(valueLen));
+        const auto value = std::span<const Byte>(entry + keyLength + sizeof(valueLen), blob.valueLog ? valueLen : blob.blobValueLength);
+        const auto slot = std::max(home, nextSlot);
+        if (slot >= recordsCount)
+        {
+            overflow.insert(overflow.end(), entry, entry + entryLength - sizeof(uint64_t));
+            return;
+        }
+        const auto address = slot * recordLength;
+        if (address + recordLength > windowStart + window.size())
+        {
+            flushWindow();
+            windowStart = address;
+        }
+        if (windowEnd <= windowStart)
+            windowEnd = windowStart;
+        const auto record = window.data() + (address - windowStart);
+        auto valueData = value.data();
+        if (blob.valueLog)
+        {
+            // long values go to the value log in the same order, so it is written sequentially too
+            if (!blob.valueLog->Write(entry, value, slotValue.data()))
+                throw std::runtime_error(std::string("Failed to write blob value log: ") + std::strerror(errno));
+            valueData = slotValue.data();
+        }
+        if (blob.isShrinked)
+        {
+            std::memcpy(record, entry, keyLength);
+            std::memcpy(record + keyLength, valueData, blob.slotValueLength);
+            nextSlot = slot + 1;
+            // without fingerprints the all zeros key looks like the empty slot it takes, so Set doesn't count it either
+            if (blob.fingerprints || !std::all_of(entry, entry + keyLength, [](const Byte b) { return b == 0; }))
+                blob.TakeSlot(entry, address);
+            if (blob.bloom)
+                blob.AddToBloom(entry);
+        }
+        else
+            std::memcpy(record, valueData, blob.slotValueLength);
+        windowEnd = address + recordLength;
+    };
+
+    while (!heap.empty())
+    {
+        const auto i = heap.top();
+        heap.pop();
+        // records of a key are next to each other, oldest first, so the last of them is kept
+        if (isPending && std::memcmp(pending.data(), runs[i].current, sizeof(uint64_t) + keyLength) != 0)
+            place(pending.data());
+        std::memcpy(pending.data(), runs[i].current, entryLength);
+        isPending = true;
+        if (!Advance(runs[i]))
+            throw std::runtime_error(std::string("Failed to read blob build run: ") + std::strerror(errno));
+        if (runs[i].current)
+            heap.push(i);
+    }
+    if (isPending)
+        place(pending.data());
+    flushWindow();
+    runs.clear();
+    entries = {};
+    order = {};
+    RemoveRuns();
+
+    // chains that wrapped around take the first free slots, which the window has written already
+    for (uint64_t offset = 0; offset < overflow.size(); offset += entryLength - sizeof(uint64_t))
+    {
+        const auto entry = overflow.data() + offset;
+        uint32_t valueLen = 0;
+        std::memcpy(&valueLen, entry + keyLength, sizeof(valueLen));
+        const auto value = std::span<const Byte>(entry + keyLength + sizeof(valueLen), blob.valueLog ? valueLen : blob.blobValueLength);
+        const auto status = blob.SetRecord(std::span<const Byte>(entry, keyLength), value, true);
+        if (status == BlobStatus::NoSpace)
+            throw std::logic_error("Blob has fewer slots than the records built into it");
+        if (status != BlobStatus::Ok)
+            throw std::runtime_error(std::string("Failed to write blob file: ") + std::strerror(errno));
+    }
+    // records bypassed the log, so they reach the disk before it could be replayed over them
+    if (!blob.Checkpoint())
+        throw std::runtime_error(std::string("Failed to sync blob file: ") + std::strerror(errno));
+    return std::move(blob);
+}
+}
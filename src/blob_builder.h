@@ -0,0 +1,77 @@
+#pragma once
+
+#include "blob.h"
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <stdio.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace DB36_NS
+{
+
+    // builds a new blob from records added in any order: they are sorted by their home slot in memory,
+    // runs that don't fit the budget are spilled to files next to the blob and merged, then slots are taken
+    // in address order, so the blob file is written front to back in large chunks instead of a pwrite per Set
+    class BlobBuilder
+    {
+        private:
+            // slots written with one pwrite
+            static constexpr uint64_t windowLength = 1 << 20;
+
+            // sorted records of one run, read back one at a time while the runs are merged
+            struct Run
+            {
+                std::unique_ptr<FILE, decltype(&fclose)> file {nullptr, &fclose};  // null for the run left in memory
+                std::vector<Byte> record;   // current record of the file run
+                uint64_t next = 0;          // index of the next record of the memory run
+                const Byte* current = nullptr;
+            };
+
+            Blob blob;
+            uint64_t entryLength;           // home address, key, value length and the value padded to ValueLength()
+            uint64_t runRecords;            // records sorted in memory before they are spilled
+            std::vector<Byte> entries;      // records added since the last spill
+            std::vector<std::pair<uint64_t, uint64_t>> order;   // home addresses and indexes of the entries, sorted
+            uint64_t runsCount = 0;
+            bool isFinished = false;
+
+            std::string RunPath(const uint64_t& run) const;
+            const Byte* EntryAt(const uint64_t& index) const
+            {
+                return entries.data() + index * entryLength;
+            }
+            // order of the entries: home address, then key bytes, so the records of a key are next to each other
+            bool IsBefore(const Byte* a, const Byte* b) const noexcept;
+            static uint64_t AddressOf(const Byte* entry) noexcept
+            {
+                uint64_t address = 0;
+                std::memcpy(&address, entry, sizeof(address));
+                return address;
+            }
+            // sort the entries, stable so the later records of a key stay after the earlier ones
+            void SortEntries();
+            // write the sorted entries to the next run file
+            bool SpillEntries();
+            // move the run to its next record, current is null once it has none
+            bool Advance(Run& run) const;
+            // remove the spilled run files
+            void RemoveRuns() noexcept;
+        public:
+            // creates the blob file, records are kept in memory up to memoryBytes at a time
+            BlobBuilder(const std::string& path, const uint64_t& keyLength, const uint64_t& valueLength, const uint8_t& capacity,
+                        const BlobOptions& options = {}, const uint64_t& memoryBytes = uint64_t(256) << 20);
+            BlobBuilder(const BlobBuilder&) = delete;
+            BlobBuilder& operator= (const BlobBuilder&) = delete;
+            ~BlobBuilder();
+            // add the record, the last one added for a key is the one the blob keeps; the tombstone key is InvalidLength
+            BlobStatus Add(std::span<const Byte> key, std::span<const Byte> value) noexcept;
+            // write all records to the blob and hand it over; throws std::logic_error if they don't fit
+            // and std::runtime_error if the files couldn't be read or written
+            Blob Finish();
+    };
+}
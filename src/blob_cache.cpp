@@ -0,0 +1,147 @@
+#include "blob_cache.h"
+#include "blob.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace DB36_NS
+{
+
+BlobCache::BlobCache(const uint64_t& budgetBytes, const uint64_t& keyLength, const uint64_t& valueLength, const uint64_t& lockStripes) :
+    keyLength(keyLength),
+    valueLength(valueLength),
+    entryLength(keyLength + valueLength),
+    isLocked(lockStripes != 0)
+{
+    // every way costs its entry, tag and CLOCK bit, every set its hand
+    const auto setLength = setWays * (entryLength + 2) + 1;
+    setsCount = std::max<uint64_t>(1, budgetBytes / setLength);
+    stripesCount = std::clamp<uint64_t>(lockStripes, 1, setsCount);
+    entries = std::make_unique<Byte[]>(setsCount * setWays * entryLength);
+    tags = std::make_unique<Byte[]>(setsCount * setWays);
+    referenced = std::make_unique<Byte[]>(setsCount * setWays);
+    hands = std::make_unique<Byte[]>(setsCount);
+    stripes = std::make_unique<CacheStripe[]>(stripesCount);
+}
+
+std::unique_lock<std::mutex> BlobCache::LockSet(const uint64_t& set) const
+{
+    if (!isLocked)
+        return {};
+    return std::unique_lock<std::mutex>(stripes[set % stripesCount].mutex);
+}
+
+uint64_t BlobCache::FindWay(const uint64_t& set, const Byte& tag, const Byte* key) const noexcept
+{
+    const auto setTags = tags.get() + set * setWays;
+    for (uint64_t way = 0; way < setWays; ++way)
+    {
+        if (setTags[way] == tag && std::memcmp(EntryAt(set, way), key, keyLength) == 0)
+            return way;
+    }
+    return setWays;
+}
+
+namespace
+{
+// set from the low hash bits, tag from the high ones, so keys of one set rarely share the tag
+void SetAndTagOf(const Byte* key, const uint64_t& keyLength, const uint64_t& setsCount, uint64_t& set, Byte& tag) noexcept
+{
+    const auto hash = HashKey(key, keyLength);
+    set = hash % setsCount;
+    tag = hash >> 56;
+    tag = tag == 0 ? 1 : tag;
+}
+}
+
+bool BlobCache::Get(const Byte* key, Byte* value) noexcept
+{
+    uint64_t set = 0;
+    Byte tag = 0;
+    SetAndTagOf(key, keyLength, setsCount, set, tag);
+    const auto lock = LockSet(set);
+    auto& stripe = stripes[set % stripesCount];
+    const auto way = FindWay(set, tag, key);
+    if (way == setWays)
+    {
+        ++stripe.misses;
+        return false;
+    }
+    std::memcpy(value, EntryAt(set, way) + keyLength, valueLength);
+    referenced[set * setWays + way] = 1;
+    ++stripe.hits;
+    return true;
+}
+
+void BlobCache::Put(const Byte* key, const Byte* value) noexcept
+{
+    uint64_t set = 0;
+    Byte tag = 0;
+    SetAndTagOf(key, keyLength, setsCount, set, tag);
+    const auto lock = LockSet(set);
+    auto way = FindWay(set, tag, key);
+    if (way == setWays)
+    {
+        const auto setTags = tags.get() + set * setWays;
+        way = std::find(setTags, setTags + setWays, 0) - setTags;
+        // without a free way the hand passes the referenced ways clearing their bits
+        // and stops at the first one that wasn't hit since
+        auto& hand = hands[set];
+        while (way == setWays)
+        {
+            if (!referenced[set * setWays + hand])
+                way = hand;
+            referenced[set * setWays + hand] = 0;
+            hand = (hand + 1) % setWays;
+        }
+        setTags[way] = tag;
+        std::memcpy(EntryAt(set, way), key, keyLength);
+    }
+    std::memcpy(EntryAt(set, way) + keyLength, value, valueLength);
+}
+
+void BlobCache::Erase(const Byte* key) noexcept
+{
+    uint64_t set = 0;
+    Byte tag = 0;
+    SetAndTagOf(key, keyLength, setsCount, set, tag);
+    const auto lock = LockSet(set);
+    const auto way = FindWay(set, tag, key);
+    if (way == setWays)
+        return;
+    tags[set * setWays + way] = 0;
+    referenced[set * setWays + way] = 0;
+}
+
+void BlobCache::Clear() noexcept
+{
+    for (uint64_t set = 0; set < setsCount; ++set)
+    {
+        const auto lock = LockSet(set);
+        std::fill_n(tags.get() + set * setWays, setWays, 0);
+        std::fill_n(referenced.get() + set * setWays, setWays, 0);
+    }
+}
+
+uint64_t BlobCache::Hits() const
+{
+    uint64_t hits = 0;
+    for (uint64_t i = 0; i < stripesCount; ++i)
+    {
+        const auto lock = LockSet(i);
+        hits += stripes[i].hits;
+    }
+    return hits;
+}
+
+uint64_t BlobCache::Misses() const
+{
+    uint64_t misses = 0;
+    for (uint64_t i = 0; i < stripesCount; ++i)
+    {
+        const auto lock = LockSet(i);
+        misses += stripes[i].misses;
+    }
+    return misses;
+}
+}
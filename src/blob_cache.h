@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+namespace DB36_NS
+{
+
+    using Byte = uint8_t;
+
+    // values of the recently read keys, kept in sets of a few ways picked by the key hash;
+    // every set evicts with its own CLOCK hand, so the cache never allocates after it is created
+    class BlobCache
+    {
+        private:
+            // ways of one set, a hit is found by comparing at most this many tags
+            static constexpr uint64_t setWays = 8;
+            // padded, so the threads locking neighbouring stripes don't share a cache line
+            struct alignas(64) CacheStripe
+            {
+                std::mutex mutex;
+                uint64_t hits = 0;
+                uint64_t misses = 0;
+            };
+
+            uint64_t keyLength;
+            uint64_t valueLength;
+            uint64_t entryLength;           // key followed by value
+            uint64_t setsCount;
+            uint64_t stripesCount;
+            bool isLocked;                  // stripes are locked only if the blob is shared by the threads
+            std::unique_ptr<Byte[]> entries;
+            std::unique_ptr<Byte[]> tags;   // high hash byte of the key in every way, 0 for the free ones
+            std::unique_ptr<Byte[]> referenced; // CLOCK bit of every way, set by a hit
+            std::unique_ptr<Byte[]> hands;  // next way the set evicts
+            std::unique_ptr<CacheStripe[]> stripes;
+
+            // lock of the set, empty if the cache is used by one thread
+            std::unique_lock<std::mutex> LockSet(const uint64_t& set) const;
+            // way of the set that holds the key, setWays if none does
+            uint64_t FindWay(const uint64_t& set, const Byte& tag, const Byte* key) const noexcept;
+            Byte* EntryAt(const uint64_t& set, const uint64_t& way) const noexcept
+            {
+                return entries.get() + (set * setWays + way) * entryLength;
+            }
+        public:
+            // the sets take at most budgetBytes, stripes are the number of set locks, 0 means no locking
+            BlobCache(const uint64_t& budgetBytes, const uint64_t& keyLength, const uint64_t& valueLength, const uint64_t& lockStripes);
+            BlobCache(const BlobCache&) = delete;
+            BlobCache& operator= (const BlobCache&) = delete;
+            // copy the cached value of the key, false on a miss
+            bool Get(const Byte* key, Byte* value) noexcept;
+            // store the whole value of the key, evicting the way the CLOCK hand stops at if the key is new
+            void Put(const Byte* key, const Byte* value) noexcept;
+            // forget the key, its stored value has changed or is gone
+            void Erase(const Byte* key) noexcept;
+            void Clear() noexcept;
+            uint64_t Hits() const;
+            uint64_t Misses() const;
+            uint64_t EntriesCount() const
+            {
+                return setsCount * setWays;
+            }
+    };
+}
@@ -0,0 +1,112 @@
+#include "blob_client.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace DB36_NS
+{
+
+BlobClient::BlobClient(const std::string& socketPath)
+{
+    sockaddr_un address {};
+    if (socketPath.size() >= sizeof(address.sun_path))
+        throw std::logic_error("Socket path is too long: " + socketPath);
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size());
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        const auto error = errno;
+        if (fd >= 0)
+            close(fd);
+        throw std::runtime_error(std::string("Failed to connect to the server: ") + std::strerror(error));
+    }
+}
+
+BlobClient::~BlobClient()
+{
+    close(fd);
+}
+
+uint64_t BlobClient::Send(const BlobOpcode& opcode, std::span<const Byte> key, std::span<const Byte> value)
+{
+    const auto id = nextId++;
+    AppendRequest(output, opcode, id, key, value);
+    return id;
+}
+
+bool BlobClient::Flush() noexcept
+{
+    for (uint64_t sent = 0; sent < output.size();)
+    {
+        const auto len = send(fd, output.data() + sent, output.size() - sent, MSG_NOSIGNAL);
+        if (len < 0 && errno == EINTR)
+            continue;
+        if (len < 0)
+            return false;
+        sent += len;
+    }
+    output.clear();
+    return true;
+}
+
+bool BlobClient::TakeResponse(Response& response) noexcept
+{
+    const auto rest = std::span<const Byte>(input).subspan(inputOffset);
+    const auto frameLength = FrameLength(rest);
+    if (frameLength == 0)
+        return false;
+    std::memcpy(&response.header, rest.data(), sizeof(response.header));
+    response.body = rest.subspan(sizeof(response.header), frameLength - sizeof(response.header));
+    inputOffset += frameLength;
+    return true;
+}
+
+bool BlobClient::ReceiveBytes(const bool& isBlocking) noexcept
+{
+    // responses handed out are dropped first, their bodies aren't used any more
+    input.erase(input.begin(), input.begin() + inputOffset);
+    inputOffset = 0;
+    for (;;)
+    {
+        const auto offset = input.size();
+        input.resize(offset + readLength);
+        const auto len = recv(fd, input.data() + offset, readLength, isBlocking ? 0 : MSG_DONTWAIT);
+        input.resize(offset + std::max<ssize_t>(len, 0));
+        if (len < 0 && errno == EINTR)
+            continue;
+        return len > 0;
+    }
+}
+
+bool BlobClient::Receive(Response& response) noexcept
+{
+    while (!TakeResponse(response))
+    {
+        if (!ReceiveBytes(true))
+            return false;
+    }
+    return true;
+}
+
+bool BlobClient::TryReceive(Response& response) noexcept
+{
+    return TakeResponse(response) || (ReceiveBytes(false) && TakeResponse(response));
+}
+
+std::pair<uint64_t, uint64_t> BlobClient::Lengths()
+{
+    Send(BlobOpcode::Info);
+    Response response {};
+    uint64_t lengths[2] = {};
+    if (!Flush() || !Receive(response) || response.body.size() != sizeof(lengths))
+        throw std::runtime_error("Failed to ask the server for the blob lengths");
+    std::memcpy(lengths, response.body.data(), sizeof(lengths));
+    return {lengths[0], lengths[1]};
+}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "blob_protocol.h"
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace DB36_NS
+{
+
+    // connection to the BlobServer; requests are buffered until Flush, so a pipeline of them goes out in one write,
+    // and responses are read in large pieces and handed out one by one in the order of the requests
+    class BlobClient
+    {
+        public:
+            struct Response
+            {
+                ResponseHeader header;
+                std::span<const Byte> body;     // valid until the next response is received
+            };
+        private:
+            static constexpr uint64_t readLength = 64 * 1024;
+
+            int fd = -1;
+            std::vector<Byte> output;   // requests not flushed yet
+            std::vector<Byte> input;    // bytes received, responses before the offset are handed out already
+            uint64_t inputOffset = 0;
+            uint64_t nextId = 1;
+
+            // response whole in the input, false if there is none
+            bool TakeResponse(Response& response) noexcept;
+            // receive more bytes, false if the connection is closed or failed
+            bool ReceiveBytes(const bool& isBlocking) noexcept;
+        public:
+            explicit BlobClient(const std::string& socketPath);
+            BlobClient(const BlobClient&) = delete;
+            BlobClient& operator= (const BlobClient&) = delete;
+            ~BlobClient();
+            // buffer the request with a body made of the key and the value, returns its id
+            uint64_t Send(const BlobOpcode& opcode, std::span<const Byte> key = {}, std::span<const Byte> value = {});
+            // write the buffered requests, false if the connection failed; the server stops reading a connection
+            // that doesn't read its responses, so a pipeline has to be received as it goes once it is megabytes long
+            bool Flush() noexcept;
+            // wait for the next response, false if the connection is closed or failed
+            bool Receive(Response& response) noexcept;
+            // next response if it is received already, false otherwise
+            bool TryReceive(Response& response) noexcept;
+            // key and value lengths of the served blob, asked for synchronously
+            std::pair<uint64_t, uint64_t> Lengths();
+    };
+}
@@ -0,0 +1,98 @@
+#include "blob_directory.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace DB36_NS
+{
+
+BlobDirectory::BlobDirectory(const std::string& path, const uint64_t& pageLength, const uint64_t& blobPagesCount, const bool& isOpened) :
+    directoryPath(path),
+    pageLength(pageLength),
+    file(fopen(directoryPath.c_str(), isOpened ? "r+" : "w+"), &fclose),
+    filePagesCount(blobPagesCount)
+{
+    if (!file)
+        throw std::runtime_error(std::string("Failed to open blob page directory: ") + std::strerror(errno));
+    if (!isOpened)
+    {
+        if (!WriteHeader())
+            throw std::runtime_error(std::string("Failed to write blob page directory header: ") + std::strerror(errno));
+        return;
+    }
+    DirectoryHeader header {};
+    struct stat fileStat {};
+    const auto fd = fileno(file.get());
+    if (pread(fd, &header, sizeof(header), 0) != ssize_t(sizeof(header))
+        || std::memcmp(header.magic, DirectoryHeader::directoryMagic, sizeof(header.magic)) != 0
+        || header.pageLength != pageLength || fstat(fd, &fileStat) != 0 || uint64_t(fileStat.st_size) < headerLength)
+        throw std::logic_error("Blob page directory doesn't match the blob: " + directoryPath);
+    // entry torn by a crash has no records in its page yet, so it is dropped with them
+    std::vector<uint64_t> entries((fileStat.st_size - headerLength) / sizeof(uint64_t));
+    const auto len = entries.size() * sizeof(uint64_t);
+    if (pread(fd, entries.data(), len, headerLength) != ssize_t(len))
+        throw std::runtime_error(std::string("Failed to read blob page directory: ") + std::strerror(errno));
+    pages.reserve(entries.size());
+    for (uint64_t filePage = 0; filePage < entries.size(); ++filePage)
+    {
+        if (entries[filePage] != 0)
+            pages.emplace(entries[filePage] - 1, filePage);
+    }
+    filePagesCount = std::max<uint64_t>(filePagesCount, entries.size());
+}
+
+bool BlobDirectory::WriteHeader() noexcept
+{
+    DirectoryHeader header {};
+    std::memcpy(header.magic, DirectoryHeader::directoryMagic, sizeof(header.magic));
+    header.pageLength = pageLength;
+    return pwrite(fileno(file.get()), &header, sizeof(header), 0) == ssize_t(sizeof(header));
+}
+
+uint64_t BlobDirectory::Find(const uint64_t& page) const noexcept
+{
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    const auto found = pages.find(page);
+    return found == pages.end() ? noPage : found->second;
+}
+
+uint64_t BlobDirectory::Allocate(const uint64_t& page) noexcept
+{
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    // another writer of the page may have appended it meanwhile
+    const auto found = pages.find(page);
+    if (found != pages.end())
+        return found->second;
+    const auto filePage = filePagesCount;
+    const uint64_t entry = page + 1;
+    if (pwrite(fileno(file.get()), &entry, sizeof(entry), headerLength + filePage * sizeof(entry)) != ssize_t(sizeof(entry)))
+        return noPage;
+    pages.emplace(page, filePage);
+    ++filePagesCount;
+    return filePage;
+}
+
+std::vector<uint64_t> BlobDirectory::Pages() const
+{
+    std::vector<uint64_t> written;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        written.reserve(pages.size());
+        for (const auto& [page, filePage] : pages)
+            written.push_back(page);
+    }
+    std::sort(written.begin(), written.end());
+    return written;
+}
+
+bool BlobDirectory::Sync() noexcept
+{
+    return fdatasync(fileno(file.get())) == 0;
+}
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <stdio.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace DB36_NS
+{
+
+    // first bytes of the page directory file, entries start at the page after it
+    struct DirectoryHeader
+    {
+        static constexpr char directoryMagic[8] = {'D', 'B', '3', '6', 'P', 'A', 'G', 'E'};
+
+        char magic[8];
+        uint64_t pageLength;
+    };
+
+    // record pages of the sparse direct addressed blob: a page is appended to the blob file on its first write
+    // and the directory file keeps the logical page of every file page, in file order, plus one so a hole reads as unused;
+    // the whole directory is kept in memory, so finding a page takes one map lookup and no read
+    class BlobDirectory
+    {
+        public:
+            static constexpr uint64_t headerLength = 4096;
+            // logical page that was never written
+            static constexpr uint64_t noPage = UINT64_MAX;
+        private:
+            const std::string directoryPath;
+            uint64_t pageLength;
+            std::unique_ptr<FILE, decltype(&fclose)> file;
+            mutable std::shared_mutex mutex;    // taken exclusively only to append a page
+            std::unordered_map<uint64_t, uint64_t> pages;   // logical page to its file page
+            uint64_t filePagesCount = 0;    // next page is appended at this file page
+
+            bool WriteHeader() noexcept;
+        public:
+            // starts an empty directory or reads the one left next to the blob; blobPagesCount is the number of pages
+            // the blob file already spans, pages a crash left without an entry are never handed out again
+            BlobDirectory(const std::string& path, const uint64_t& pageLength, const uint64_t& blobPagesCount, const bool& isOpened);
+            BlobDirectory(const BlobDirectory&) = delete;
+            BlobDirectory& operator= (const BlobDirectory&) = delete;
+            // file page of the logical page, noPage if it was never written
+            uint64_t Find(const uint64_t& page) const noexcept;
+            // same, but a page never written is appended first, its entry written before any record goes to it;
+            // noPage if the entry couldn't be written
+            uint64_t Allocate(const uint64_t& page) noexcept;
+            // logical pages written so far in ascending order
+            std::vector<uint64_t> Pages() const;
+            // put the entries on the disk
+            bool Sync() noexcept;
+            uint64_t PagesCount() const
+            {
+                std::shared_lock<std::shared_mutex> lock(mutex);
+                return pages.size();
+            }
+    };
+}
@@ -0,0 +1,205 @@
+#include "blob_pool.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace DB36_NS
+{
+
+BlobPool::BlobPool(const std::string& path, const uint64_t& budgetBytes) :
+    fd(open(path.c_str(), O_RDWR | O_DIRECT)),
+    framesCount(std::max(minFrames, budgetBytes / pageLength)),
+    data(static_cast<Byte*>(std::aligned_alloc(pageLength, framesCount * pageLength))),
+    frames(std::make_unique<Frame[]>(framesCount))
+{
+    if (fd < 0)
+        throw std::runtime_error(std::string("Failed to open blob file with O_DIRECT: ") + std::strerror(errno));
+    if (!data)
+    {
+        close(fd);
+        throw std::bad_alloc();
+    }
+    table.reserve(framesCount);
+}
+
+BlobPool::~BlobPool()
+{
+    close(fd);
+}
+
+uint64_t BlobPool::Victim() noexcept
+{
+    // every frame is passed at most maxUsage times before it is taken, unless it is pinned all along
+    for (uint64_t step = 0; step < framesCount * (maxUsage + 1); ++step)
+    {
+        auto& frame = frames[hand];
+        const auto victim = hand;
+        hand = hand + 1 == framesCount ? 0 : hand + 1;
+        if (frame.pins.load(std::memory_order_acquire) != 0)
+            continue;
+        const auto usage = frame.usage.load(std::memory_order_relaxed);
+        if (usage == 0)
+            return victim;
+        frame.usage.store(usage - 1, std::memory_order_relaxed);
+    }
+    return framesCount;
+}
+
+uint64_t BlobPool::Pin(const uint64_t& page, const Byte* wholePage) noexcept
+{
+    for (;;)
+    {
+        std::unique_lock<std::mutex> lock(tableMutex);
+        const auto found = table.find(page);
+        if (found != table.end())
+        {
+            auto& frame = frames[found->second];
+            frame.pins.fetch_add(1, std::memory_order_acquire);
+            frame.usage.store(std::min<uint8_t>(frame.usage.load(std::memory_order_relaxed) + 1, maxUsage), std::memory_order_relaxed);
+            lock.unlock();
+            // the call that took the frame is still reading the page
+            auto state = frame.state.load(std::memory_order_acquire);
+            while (state == FrameState::Loading)
+            {
+                std::this_thread::yield();
+                state = frame.state.load(std::memory_order_acquire);
+            }
+            if (state == FrameState::Failed)
+            {
+                Unpin(found->second);
+                return framesCount;
+            }
+            ++hits;
+            return found->second;
+        }
+        const auto victim = Victim();
+        if (victim == framesCount)
+        {
+            // every frame is in use by a call, one of them is done soon
+            lock.unlock();
+            std::this_thread::yield();
+            continue;
+        }
+        auto& frame = frames[victim];
+        const auto evicted = frame.page.load(std::memory_order_relaxed);
+        if (evicted != noPage)
+        {
+            table.erase(evicted);
+            ++evictions;
+        }
+        frame.page.store(page, std::memory_order_relaxed);
+        frame.state.store(FrameState::Loading, std::memory_order_relaxed);
+        frame.pins.store(1, std::memory_order_relaxed);
+        frame.usage.store(1, std::memory_order_relaxed);
+        table.emplace(page, victim);
+        lock.unlock();
+
+        ++misses;
+        const auto buffer = FrameData(victim);
+        if (wholePage)
+            std::memcpy(buffer, wholePage, pageLength);
+        else
+        {
+            const auto bytesRead = pread(fd, buffer, pageLength, page * pageLength);
+            if (bytesRead < 0)
+            {
+                lock.lock();
+                table.erase(page);
+                frame.page.store(noPage, std::memory_order_relaxed);
+                frame.state.store(FrameState::Failed, std::memory_order_release);
+                lock.unlock();
+                Unpin(victim);
+                return framesCount;
+            }
+            // last page of the file may be short
+            std::memset(buffer + bytesRead, 0, pageLength - bytesRead);
+        }
+        frame.state.store(FrameState::Ready, std::memory_order_release);
+        return victim;
+    }
+}
+
+bool BlobPool::ReadBypassed(const uint64_t& offset, Byte* buffer, const uint64_t& len) const noexcept
+{
+    const auto start = offset / pageLength * pageLength;
+    const auto end = (offset + len + pageLength - 1) / pageLength * pageLength;
+    std::unique_ptr<Byte, FreeDeleter> aligned(static_cast<Byte*>(std::aligned_alloc(pageLength, end - start)));
+    if (!aligned)
+        return false;
+    const auto bytesRead = pread(fd, aligned.get(), end - start, start);
+    if (bytesRead < 0)
+        return false;
+    std::memset(aligned.get() + bytesRead, 0, end - start - bytesRead);
+    // pages written through the pool are on the file already, so the transfer sees them
+    std::memcpy(buffer, aligned.get() + (offset - start), len);
+    return true;
+}
+
+bool BlobPool::Read(const uint64_t& offset, Byte* buffer, const uint64_t& len) noexcept
+{
+    if (len >= bypassLength)
+        return ReadBypassed(offset, buffer, len);
+    for (uint64_t done = 0; done < len;)
+    {
+        const auto page = (offset + done) / pageLength;
+        const auto pageOffset = (offset + done) % pageLength;
+        const auto chunk = std::min(len - done, pageLength - pageOffset);
+        const auto frame = Pin(page, nullptr);
+        if (frame == framesCount)
+            return false;
+        std::memcpy(buffer + done, FrameData(frame) + pageOffset, chunk);
+        Unpin(frame);
+        done += chunk;
+    }
+    return true;
+}
+
+bool BlobPool::Write(const uint64_t& offset, const iovec* parts, const int& count) noexcept
+{
+    uint64_t len = 0;
+    for (int i = 0; i < count; ++i)
+        len += parts[i].iov_len;
+    // bytes of the parts that fall on one page are gathered here first
+    alignas(64) Byte pageBytes[pageLength];
+    int part = 0;
+    uint64_t partOffset = 0;
+    for (uint64_t done = 0; done < len;)
+    {
+        const auto page = (offset + done) / pageLength;
+        const auto pageOffset = (offset + done) % pageLength;
+        const auto chunk = std::min(len - done, pageLength - pageOffset);
+        for (uint64_t gathered = 0; gathered < chunk;)
+        {
+            const auto take = std::min(chunk - gathered, parts[part].iov_len - partOffset);
+            std::memcpy(pageBytes + pageOffset + gathered, static_cast<const Byte*>(parts[part].iov_base) + partOffset, take);
+            gathered += take;
+            partOffset += take;
+            if (partOffset == parts[part].iov_len)
+            {
+                ++part;
+                partOffset = 0;
+            }
+        }
+        const auto frame = Pin(page, chunk == pageLength ? pageBytes : nullptr);
+        if (frame == framesCount)
+            return false;
+        bool isWritten = false;
+        {
+            std::lock_guard<std::mutex> lock(frames[frame].writeMutex);
+            std::memcpy(FrameData(frame) + pageOffset, pageBytes + pageOffset, chunk);
+            isWritten = pwrite(fd, FrameData(frame), pageLength, page * pageLength) == ssize_t(pageLength);
+        }
+        Unpin(frame);
+        if (!isWritten)
+            return false;
+        done += chunk;
+    }
+    return true;
+}
+}
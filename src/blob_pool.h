@@ -0,0 +1,110 @@
+#pragma once
+
+#include <sys/uio.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace DB36_NS
+{
+
+    using Byte = uint8_t;
+
+    // pages of a file opened with O_DIRECT, kept in a fixed number of aligned frames, so the blob never
+    // grows the page cache and its memory is the budget; frames are evicted by a CLOCK hand that passes
+    // a page as many times as it was used recently, up to maxUsage, and never takes a page pinned by a call;
+    // writes go through to the file, so an evicted page is never dirty
+    class BlobPool
+    {
+        public:
+            // O_DIRECT transfers are aligned to this, and so are the pages
+            static constexpr uint64_t pageLength = 4096;
+            // reads this long go to the file without the pool, so scans don't evict the hot pages
+            static constexpr uint64_t bypassLength = 64 * 1024;
+        private:
+            static constexpr uint64_t minFrames = 16;
+            static constexpr uint8_t maxUsage = 3;
+            static constexpr uint64_t noPage = UINT64_MAX;
+
+            enum class FrameState : uint8_t
+            {
+                Loading,    // page is being read by the call that took the frame
+                Ready,
+                Failed      // read failed, the callers waiting for it give up
+            };
+            struct Frame
+            {
+                std::atomic<uint64_t> page = noPage;
+                std::atomic<uint32_t> pins = 0;
+                std::atomic<uint8_t> usage = 0;
+                std::atomic<FrameState> state = FrameState::Ready;
+                std::mutex writeMutex;      // the page is changed and written by one call at a time
+            };
+            struct FreeDeleter
+            {
+                void operator()(Byte* data) const
+                {
+                    std::free(data);
+                }
+            };
+
+            int fd;
+            uint64_t framesCount;
+            std::unique_ptr<Byte, FreeDeleter> data;
+            std::unique_ptr<Frame[]> frames;
+            std::mutex tableMutex;          // guards the table, the hand and the pages of the frames
+            std::unordered_map<uint64_t, uint64_t> table;   // page to its frame
+            uint64_t hand = 0;
+            std::atomic<uint64_t> hits = 0;
+            std::atomic<uint64_t> misses = 0;
+            std::atomic<uint64_t> evictions = 0;
+
+            Byte* FrameData(const uint64_t& frame) const noexcept
+            {
+                return data.get() + frame * pageLength;
+            }
+            // frame holding the page, read from the file if it isn't in the pool; pinned until Unpin,
+            // page is the whole page if the caller overwrites it, so it isn't read; framesCount on failure
+            uint64_t Pin(const uint64_t& page, const Byte* wholePage) noexcept;
+            void Unpin(const uint64_t& frame) noexcept
+            {
+                frames[frame].pins.fetch_sub(1, std::memory_order_release);
+            }
+            // unpinned frame the hand stops at, framesCount if every frame is pinned; under the table mutex
+            uint64_t Victim() noexcept;
+            // read len bytes at the file offset with one aligned transfer
+            bool ReadBypassed(const uint64_t& offset, Byte* buffer, const uint64_t& len) const noexcept;
+        public:
+            // opens the file with O_DIRECT next to the caller's descriptor, throws if the file system refuses it
+            BlobPool(const std::string& path, const uint64_t& budgetBytes);
+            BlobPool(const BlobPool&) = delete;
+            BlobPool& operator= (const BlobPool&) = delete;
+            ~BlobPool();
+            // copy len bytes at the file offset, zeros past the end of the file
+            bool Read(const uint64_t& offset, Byte* buffer, const uint64_t& len) noexcept;
+            // write the parts back to back at the file offset, the pages are written whole
+            bool Write(const uint64_t& offset, const iovec* parts, const int& count) noexcept;
+            // bytes of the frames, which is all the pool ever holds
+            uint64_t Bytes() const
+            {
+                return framesCount * pageLength;
+            }
+            uint64_t Hits() const
+            {
+                return hits;
+            }
+            uint64_t Misses() const
+            {
+                return misses;
+            }
+            uint64_t Evictions() const
+            {
+                return evictions;
+            }
+    };
+}
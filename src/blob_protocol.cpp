@@ -0,0 +1,53 @@
+#include "blob_protocol.h"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace DB36_NS
+{
+
+void AppendRequest(std::vector<Byte>& out, const BlobOpcode& opcode, const uint64_t& id,
+                   std::span<const Byte> key, std::span<const Byte> value)
+{
+    if (key.size() + value.size() > maxBodyLength)
+        throw std::length_error("Request body is longer than the protocol allows");
+    RequestHeader header {};
+    header.bodyLength = key.size() + value.size();
+    header.opcode = static_cast<uint8_t>(opcode);
+    header.id = id;
+    const auto offset = out.size();
+    out.resize(offset + sizeof(header) + header.bodyLength);
+    std::memcpy(out.data() + offset, &header, sizeof(header));
+    if (!key.empty())
+        std::memcpy(out.data() + offset + sizeof(header), key.data(), key.size());
+    if (!value.empty())
+        std::memcpy(out.data() + offset + sizeof(header) + key.size(), value.data(), value.size());
+}
+
+std::span<Byte> AppendResponse(std::vector<Byte>& out, const BlobOpcode& opcode, const uint8_t& status,
+                               const uint64_t& id, const uint64_t& bodyLength)
+{
+    // the length field would be cut and the frames after the response misread
+    if (bodyLength > maxBodyLength)
+        throw std::length_error("Response body is longer than the protocol allows");
+    ResponseHeader header {};
+    header.bodyLength = bodyLength;
+    header.opcode = static_cast<uint8_t>(opcode);
+    header.status = status;
+    header.id = id;
+    const auto offset = out.size();
+    out.resize(offset + sizeof(header) + bodyLength);
+    std::memcpy(out.data() + offset, &header, sizeof(header));
+    return std::span<Byte>(out.data() + offset + sizeof(header), bodyLength);
+}
+
+uint64_t FrameLength(std::span<const Byte> bytes) noexcept
+{
+    uint32_t bodyLength = 0;
+    if (bytes.size() < sizeof(RequestHeader))
+        return 0;
+    std::memcpy(&bodyLength, bytes.data(), sizeof(bodyLength));
+    const auto length = sizeof(RequestHeader) + uint64_t(bodyLength);
+    return bytes.size() < length ? 0 : length;
+}
+}
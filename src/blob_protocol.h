@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace DB36_NS
+{
+
+    using Byte = uint8_t;
+
+    // what the request asks the server for
+    enum class BlobOpcode : uint8_t
+    {
+        Info = 0,       // empty body, answered with the key length and the value length as two uint64_t
+        Get = 1,        // body is the key, answered with ValueLength() bytes of the value if it is found
+        Set = 2,        // body is the key followed by at most ValueLength() bytes of the value, answered with an empty body
+        MultiGet = 3    // body is the keys back to back, answered with a status byte per key followed by all the values
+    };
+
+    // first bytes of every request, the body follows it; both ends share the host, so fields are in its byte order;
+    // requests are answered in the order they are sent on the connection, the id is echoed in the response
+    struct RequestHeader
+    {
+        uint32_t bodyLength;
+        uint8_t opcode;
+        uint8_t padding[3];
+        uint64_t id;
+    };
+
+    // first bytes of every response, status is the BlobStatus of the request, InvalidLength for the requests
+    // the server can't parse or doesn't know
+    struct ResponseHeader
+    {
+        uint32_t bodyLength;
+        uint8_t opcode;
+        uint8_t status;
+        uint8_t padding[2];
+        uint64_t id;
+    };
+
+    static_assert(sizeof(RequestHeader) == 16 && sizeof(ResponseHeader) == 16);
+
+    // longer frames end the connection, a peer that sends them is not speaking the protocol
+    constexpr uint64_t maxBodyLength = 64 << 20;
+
+    // append the request with a body made of the key and the value to the bytes to send;
+    // throws std::length_error if the body is longer than maxBodyLength
+    void AppendRequest(std::vector<Byte>& out, const BlobOpcode& opcode, const uint64_t& id,
+                       std::span<const Byte> key, std::span<const Byte> value = {});
+    // append the response header and make room for its body, which is returned to be filled;
+    // throws std::length_error if the body is longer than maxBodyLength
+    std::span<Byte> AppendResponse(std::vector<Byte>& out, const BlobOpcode& opcode, const uint8_t& status,
+                                   const uint64_t& id, const uint64_t& bodyLength);
+    // length of the frame with its header at the front of the bytes, 0 if it isn't received whole yet;
+    // request and response headers both start with the body length
+    uint64_t FrameLength(std::span<const Byte> bytes) noexcept;
+}
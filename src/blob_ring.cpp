@@ -0,0 +1,233 @@
+#include "blob_ring.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace DB36_NS
+{
+
+namespace
+{
+int EnterRing(const int& ringFd, const uint32_t& toSubmit, const uint32_t& minComplete, const uint32_t& flags) noexcept
+{
+    return syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, nullptr, 0);
+}
+
+// ring indexes are shared with the kernel, which reads and writes them without our mutex
+uint32_t LoadIndex(uint32_t* index) noexcept
+{
+    return std::atomic_ref<uint32_t>(*index).load(std::memory_order_acquire);
+}
+
+void StoreIndex(uint32_t* index, const uint32_t& value) noexcept
+{
+    std::atomic_ref<uint32_t>(*index).store(value, std::memory_order_release);
+}
+}
+
+BlobRing::BlobRing(const uint32_t& queueDepth) :
+    queueDepth(std::max<uint32_t>(1, queueDepth))
+{
+    io_uring_params params {};
+    ringFd = syscall(__NR_io_uring_setup, this->queueDepth, &params);
+    if (ringFd < 0)
+        throw std::runtime_error(std::string("Failed to set up io_uring: ") + std::strerror(errno));
+
+    sqRingLength = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    cqRingLength = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool isSingleMapping = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (isSingleMapping)
+        sqRingLength = cqRingLength = std::max(sqRingLength, cqRingLength);
+    sqRing = mmap(nullptr, sqRingLength, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    cqRing = isSingleMapping ? sqRing
+        : mmap(nullptr, cqRingLength, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+    sqesLength = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqesData = mmap(nullptr, sqesLength, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqesData == MAP_FAILED)
+    {
+        const auto error = errno;
+        sqes = sqesData == MAP_FAILED ? nullptr : static_cast<io_uring_sqe*>(sqesData);
+        Unmap();
+        throw std::runtime_error(std::string("Failed to map io_uring: ") + std::strerror(error));
+    }
+    sqes = static_cast<io_uring_sqe*>(sqesData);
+
+    const auto sq = static_cast<Byte*>(sqRing);
+    const auto cq = static_cast<Byte*>(cqRing);
+    sqTail = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+    sqMask = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+    cqHead = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+    cqMask = *reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    completions.resize(this->queueDepth);
+    for (uint32_t slot = this->queueDepth; slot > 0; --slot)
+        freeSlots.push_back(slot - 1);
+    reaper = std::thread([this]() { Reap(); });
+}
+
+BlobRing::~BlobRing()
+{
+    Drain();
+    {
+        // the stop request is the last one, so the ring thread has run every completion before it exits
+        std::lock_guard<std::mutex> lock(mutex);
+        QueueRequest(IORING_OP_NOP, -1, 0, nullptr, 0, stopRequest);
+    }
+    // the ring thread waits for a completion with nothing in flight, so it can't submit the request itself
+    EnterRing(ringFd, 1, 0, 0);
+    reaper.join();
+    Unmap();
+}
+
+void BlobRing::Unmap() noexcept
+{
+    if (sqes)
+        munmap(sqes, sqesLength);
+    if (cqRing && cqRing != MAP_FAILED && cqRing != sqRing)
+        munmap(cqRing, cqRingLength);
+    if (sqRing && sqRing != MAP_FAILED)
+        munmap(sqRing, sqRingLength);
+    close(ringFd);
+}
+
+void BlobRing::QueueRequest(const uint8_t& opcode, const int& fd, const uint64_t& offset, Byte* data, const uint32_t& len,
+                            const uint64_t& userData) noexcept
+{
+    // only this thread moves the tail, the kernel moves the head as it consumes the requests
+    const auto tail = *sqTail;
+    const auto index = tail & sqMask;
+    auto& sqe = sqes[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = opcode;
+    sqe.fd = fd;
+    sqe.off = offset;
+    sqe.addr = reinterpret_cast<uint64_t>(data);
+    sqe.len = len;
+    sqe.user_data = userData;
+    sqArray[index] = index;
+    StoreIndex(sqTail, tail + 1);
+}
+
+bool BlobRing::Queue(const uint8_t& opcode, const int& fd, const uint64_t& offset, Byte* data, const uint64_t& len,
+                     Completion completion)
+{
+    if (len > UINT32_MAX)
+        return false;
+    const bool isReaper = std::this_thread::get_id() == reaper.get_id();
+    std::unique_lock<std::mutex> lock(mutex);
+    uint32_t slot = 0;
+    if (isReaper && isSlotInherited)
+    {
+        slot = inheritedSlot;
+        isSlotInherited = false;
+    }
+    else
+    {
+        // the ring thread frees the slots, so it can't wait for one
+        if (isReaper && freeSlots.empty())
+            return false;
+        released.wait(lock, [this]() { return !freeSlots.empty(); });
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    }
+    completions[slot] = std::move(completion);
+    QueueRequest(opcode, fd, offset, data, len, slot);
+    ++pendingRequests;
+    // the ring thread submits its requests together with its next wait
+    if (isReaper || isSubmitting)
+        return true;
+    isSubmitting = true;
+    while (pendingRequests != 0)
+    {
+        const auto toSubmit = pendingRequests;
+        pendingRequests = 0;
+        lock.unlock();
+        const auto submitted = EnterRing(ringFd, toSubmit, 0, 0);
+        lock.lock();
+        pendingRequests += toSubmit - std::clamp<int>(submitted, 0, toSubmit);
+        // requests the kernel didn't take are left to the ring thread
+        if (submitted < 0)
+            break;
+    }
+    isSubmitting = false;
+    return true;
+}
+
+bool BlobRing::Read(const int& fd, const uint64_t& offset, Byte* data, const uint64_t& len, Completion completion)
+{
+    return Queue(IORING_OP_READ, fd, offset, data, len, std::move(completion));
+}
+
+bool BlobRing::Write(const int& fd, const uint64_t& offset, const Byte* data, const uint64_t& len, Completion completion)
+{
+    return Queue(IORING_OP_WRITE, fd, offset, const_cast<Byte*>(data), len, std::move(completion));
+}
+
+void BlobRing::Reap()
+{
+    bool isStopped = false;
+    while (!isStopped)
+    {
+        uint32_t toSubmit = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            toSubmit = pendingRequests;
+            pendingRequests = 0;
+        }
+        const auto submitted = EnterRing(ringFd, toSubmit, 1, IORING_ENTER_GETEVENTS);
+        if (submitted < int(toSubmit))
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pendingRequests += toSubmit - std::clamp<int>(submitted, 0, toSubmit);
+        }
+
+        auto head = *cqHead;
+        const auto tail = LoadIndex(cqTail);
+        for (; head != tail; ++head)
+        {
+            const auto& cqe = cqes[head & cqMask];
+            const auto userData = cqe.user_data;
+            const int64_t result = cqe.res;
+            if (userData == stopRequest)
+            {
+                isStopped = true;
+                continue;
+            }
+            Completion completion;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                completion = std::move(completions[userData]);
+                inheritedSlot = userData;
+                isSlotInherited = true;
+            }
+            completion(result);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (isSlotInherited)
+            {
+                isSlotInherited = false;
+                freeSlots.push_back(userData);
+                released.notify_all();
+            }
+        }
+        StoreIndex(cqHead, head);
+    }
+}
+
+void BlobRing::Drain()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    released.wait(lock, [this]() { return freeSlots.size() == queueDepth; });
+}
+}
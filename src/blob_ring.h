@@ -0,0 +1,84 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace DB36_NS
+{
+
+    using Byte = uint8_t;
+
+    // io_uring of the blob file reads and writes, set up with the bare syscalls;
+    // requests queued by the threads at the same time go to the kernel with one io_uring_enter,
+    // completions are reaped by the ring thread, which also submits the requests queued by the completions
+    class BlobRing
+    {
+        public:
+            // gets the result of the request: bytes read or written, or -errno
+            using Completion = std::function<void(const int64_t&)>;
+        private:
+            // user data of the request that stops the ring thread
+            static constexpr uint64_t stopRequest = UINT64_MAX;
+
+            uint32_t queueDepth;
+            int ringFd = -1;
+            void* sqRing = nullptr;
+            uint64_t sqRingLength = 0;
+            void* cqRing = nullptr;         // same mapping as sqRing if the kernel maps both rings at once
+            uint64_t cqRingLength = 0;
+            io_uring_sqe* sqes = nullptr;
+            uint64_t sqesLength = 0;
+            uint32_t* sqTail = nullptr;
+            uint32_t sqMask = 0;
+            uint32_t* sqArray = nullptr;
+            uint32_t* cqHead = nullptr;
+            uint32_t* cqTail = nullptr;
+            uint32_t cqMask = 0;
+            io_uring_cqe* cqes = nullptr;
+
+            std::mutex mutex;
+            std::condition_variable released;   // a request completed, so its slot is free
+            std::vector<Completion> completions;    // completion of every request in flight, indexed by its user data
+            std::vector<uint32_t> freeSlots;
+            uint32_t pendingRequests = 0;   // queued but not submitted yet
+            bool isSubmitting = false;      // some thread submits, the others only queue
+            bool isSlotInherited = false;   // completion being run may queue its continuation into its own slot
+            uint32_t inheritedSlot = 0;
+            std::thread reaper;
+
+            // release the rings and the ring fd
+            void Unmap() noexcept;
+            // put the request into the submission queue, slot is taken already
+            void QueueRequest(const uint8_t& opcode, const int& fd, const uint64_t& offset, Byte* data, const uint32_t& len,
+                              const uint64_t& userData) noexcept;
+            // queue the read or write and submit it unless the ring thread will
+            bool Queue(const uint8_t& opcode, const int& fd, const uint64_t& offset, Byte* data, const uint64_t& len,
+                       Completion completion);
+            // submit the queued requests, wait for completions and run them until stopped
+            void Reap();
+        public:
+            // sets the ring up for queueDepth requests in flight, throws if the kernel has no io_uring
+            explicit BlobRing(const uint32_t& queueDepth);
+            BlobRing(const BlobRing&) = delete;
+            BlobRing& operator= (const BlobRing&) = delete;
+            // waits for the requests in flight
+            ~BlobRing();
+            // queue pread/pwrite of len bytes at the file offset, waits while queueDepth requests are in flight;
+            // a completion may queue one more request, which takes its slot without waiting
+            bool Read(const int& fd, const uint64_t& offset, Byte* data, const uint64_t& len, Completion completion);
+            bool Write(const int& fd, const uint64_t& offset, const Byte* data, const uint64_t& len, Completion completion);
+            // wait until no request is in flight
+            void Drain();
+            uint32_t QueueDepth() const
+            {
+                return queueDepth;
+            }
+    };
+}
@@ -0,0 +1,250 @@
+#include "blob_scanner.h"
+#include "blob.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace DB36_NS
+{
+
+BlobScanner::BlobScanner(const Blob& blob, std::span<const Byte> from, std::span<const Byte> to, const bool& isRange) :
+    blob(&blob),
+    isRange(isRange),
+    key(blob.blobKeyLength),
+    value(blob.blobValueLength),
+    status(BlobStatus::Ok)
+{
+    if (isRange)
+    {
+        if (from.size() != uint64_t(blob.blobKeyLength) || to.size() != uint64_t(blob.blobKeyLength))
+        {
+            status = BlobStatus::InvalidLength;
+            isEnd = true;
+            return;
+        }
+        first = blob.KeyOrder(from.data());
+        last = blob.KeyOrder(to.data());
+    }
+    if (blob.grown)
+    {
+        older = &blob;
+        this->blob = blob.grown.get();
+    }
+    Start(*this->blob, 0);
+}
+
+void BlobScanner::Start(const Blob& scanned, const uint64_t& startSlot)
+{
+    blob = &scanned;
+    chunk.resize(std::max<uint64_t>(1, chunkLength / scanned.blobRecordLength) * scanned.blobRecordLength);
+    index = chunkCount = 0;
+    isWrapped = false;
+    isEnd = isRange && first > last;
+    pages = scanned.directory ? scanned.directory->Pages() : std::vector<uint64_t>();
+    if (!isRange)
+    {
+        nextSlot = startSlot;
+        return;
+    }
+    // slots of the direct addressed blob are the key orders, the shrinked blob takes their high bits,
+    // keys of the mixed hash may be anywhere
+    const auto shift = scanned.isShrinked ? scanned.shift : 0;
+    const bool isMixed = scanned.blobOptions.keyHash == BlobKeyHash::Mixed;
+    firstHome = isMixed ? 0 : first >> shift;
+    lastHome = isMixed ? scanned.blobRecordsCount - 1 : last >> shift;
+    nextSlot = firstHome;
+}
+
+void BlobScanner::SkipUnwritten() noexcept
+{
+    const auto recordLength = blob->blobRecordLength;
+    const auto pageLength = Blob::sparsePageLength;
+    auto page = std::lower_bound(pages.begin(), pages.end(), nextSlot * recordLength / pageLength);
+    if (page == pages.end())
+    {
+        nextSlot = blob->blobRecordsCount;
+        return;
+    }
+    // the record starting before the page may end in it
+    nextSlot = std::max(nextSlot, *page * pageLength / recordLength);
+    auto last = page;
+    while (last + 1 != pages.end() && *(last + 1) == *last + 1)
+        ++last;
+    writtenEnd = std::min(blob->blobRecordsCount, ((*last + 1) * pageLength + recordLength - 1) / recordLength);
+}
+
+uint64_t BlobScanner::ChunkCount(const uint64_t& slot) const noexcept
+{
+    const auto recordLength = blob->blobRecordLength;
+    // chains going on past the home slots of the range are short, so they are read a page at a time
+    auto count = std::max<uint64_t>(1, (IsChain(slot) ? chainChunkLength : chunk.size()) / recordLength);
+    if (isRange && !IsChain(slot))
+        count = std::min(count, lastHome - slot + 1 + (blob->isShrinked ? Blob::batchProbeRecords : 0));
+    count = std::min(count, blob->blobRecordsCount - slot);
+    if (blob->directory)
+        count = std::min(count, writtenEnd - slot);
+    // wrapped chains end before the slots read first
+    return isWrapped ? std::min(count, firstHome - slot) : count;
+}
+
+void BlobScanner::ReadAhead(const uint64_t& address, const uint64_t& len) const noexcept
+{
+    const auto aheadLen = std::min(len, blob->blobCapacitySize - address);
+    if (aheadLen == 0)
+        return;
+    if (blob->mapping)
+    {
+        const auto ahead = reinterpret_cast<uintptr_t>(blob->MappedAt(address));
+        const auto pageStart = ahead / Blob::probePageLength * Blob::probePageLength;
+        madvise(reinterpret_cast<void*>(pageStart), ahead + aheadLen - pageStart, MADV_WILLNEED);
+    }
+    // pool reads of the chunk length go around the page cache, so there is nothing to read ahead into,
+    // and the file offsets of the sparse pages aren't the record addresses
+    else if (!blob->pool && !blob->directory)
+        posix_fadvise(fileno(blob->file.get()), Blob::headerLength + address, aheadLen, POSIX_FADV_WILLNEED);
+}
+
+bool BlobScanner::ReadChunk(const uint64_t& slot, const uint64_t& count) noexcept
+{
+    const auto recordLength = blob->blobRecordLength;
+    const auto address = slot * recordLength;
+    const auto len = count * recordLength;
+    // stripes of the pages the records start in, taken in order since writers only ever hold one
+    std::vector<uint64_t> stripes;
+    if (blob->stripes)
+    {
+        const auto firstPage = address / Blob::probePageLength;
+        const auto lastPage = (address + len - recordLength) / Blob::probePageLength;
+        const auto stripesCount = blob->blobOptions.lockStripes;
+        for (uint64_t page = firstPage; page <= lastPage && stripes.size() < stripesCount; ++page)
+            stripes.push_back(page % stripesCount);
+        std::sort(stripes.begin(), stripes.end());
+    }
+    for (;;)
+    {
+        epoch = blob->LoadEpoch(std::memory_order_acquire);
+        if (epoch % 2 == 0)
+        {
+            std::vector<std::shared_lock<std::shared_mutex>> locks;
+            locks.reserve(stripes.size());
+            for (const auto& stripe : stripes)
+                locks.emplace_back(blob->stripes[stripe]);
+            if (!blob->ReadBytesFromBlob(address, chunk.data(), len))
+                return false;
+            locks.clear();
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (blob->LoadEpoch(std::memory_order_relaxed) == epoch)
+                break;
+        }
+        std::this_thread::yield();
+    }
+    chunkSlot = slot;
+    chunkCount = count;
+    index = 0;
+    return true;
+}
+
+bool BlobScanner::IsStored(const uint64_t& slot, const Byte* record) noexcept
+{
+    const auto keyLength = uint64_t(blob->blobKeyLength);
+    if (!blob->isShrinked)
+    {
+        // cleared slot value is a deleted or never set key, the key is the slot number itself
+        if (std::all_of(record, record + blob->slotValueLength, [](const Byte b) { return b == 0; }))
+            return false;
+        std::memcpy(key.data(), &slot, keyLength);
+        return true;
+    }
+    if (std::all_of(record, record + keyLength, [](const Byte b) { return b == 0; }) && slot + 1 != blob->zeroKeySlot)
+    {
+        // chains of the range end at the first empty slot past its home slots
+        if (IsChain(slot))
+            isEnd = true;
+        return false;
+    }
+    // all 0xFF bytes key is the tombstone of a deleted key
+    if (std::all_of(record, record + keyLength, [](const Byte b) { return b == 0xFF; }))
+        return false;
+    if (isRange)
+    {
+        const auto order = blob->KeyOrder(record);
+        if (order < first || order > last)
+            return false;
+    }
+    std::memcpy(key.data(), record, keyLength);
+    // records before the grow address are moved already, the others only count if the doubled blob hasn't got a newer one
+    if (blob == older && (slot * blob->blobRecordLength < older->growAddress
+                          || older->grown->GetRecord(key, value) != BlobStatus::NotFound))
+        return false;
+    return true;
+}
+
+bool BlobScanner::Next() noexcept
+{
+    if (status != BlobStatus::Ok)
+        return false;
+    for (;;)
+    {
+        if (index == chunkCount)
+        {
+            const auto recordsCount = blob->blobRecordsCount;
+            if (isRange && blob->isShrinked && nextSlot == recordsCount && firstHome != 0 && !isWrapped)
+            {
+                // chains of the last slots go on at the first ones
+                nextSlot = 0;
+                isWrapped = true;
+            }
+            if (blob->directory)
+                SkipUnwritten();
+            if (isEnd || nextSlot == recordsCount || (isRange && !blob->isShrinked && nextSlot > lastHome)
+                || (isWrapped && nextSlot >= firstHome))
+            {
+                if (!older || blob == older)
+                    return false;
+                Start(*older, older->growAddress / older->blobRecordLength);
+                continue;
+            }
+            const auto count = ChunkCount(nextSlot);
+            if (!IsChain(nextSlot))
+                ReadAhead((nextSlot + count) * blob->blobRecordLength, count * blob->blobRecordLength);
+            if (!ReadChunk(nextSlot, count))
+            {
+                status = BlobStatus::IOError;
+                return false;
+            }
+            nextSlot += count;
+        }
+        const auto slot = chunkSlot + index;
+        const auto record = chunk.data() + index * blob->blobRecordLength;
+        ++index;
+        if (!IsStored(slot, record))
+        {
+            // rest of the chunk is past the chains of the range
+            if (isEnd)
+                index = chunkCount;
+            continue;
+        }
+        const auto slotValue = blob->isShrinked ? record + blob->blobKeyLength : record;
+        if (!blob->valueLog)
+        {
+            std::memcpy(value.data(), slotValue, blob->blobValueLength);
+            valueLen = blob->blobValueLength;
+            return true;
+        }
+        const auto isRead = blob->valueLog->Read(slotValue, value.data(), valueLen);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (blob->LoadEpoch(std::memory_order_relaxed) == epoch)
+        {
+            if (!isRead)
+                status = BlobStatus::IOError;
+            return isRead;
+        }
+        // collection moved the entry, so the rest of the chunk is read again from this record on
+        if (!ReadChunk(slot, chunkSlot + chunkCount - slot))
+        {
+            status = BlobStatus::IOError;
+            return false;
+        }
+    }
+}
+}
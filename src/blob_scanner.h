@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace DB36_NS
+{
+
+    using Byte = uint8_t;
+    class Blob;
+    enum class BlobStatus;
+
+    // stored records of a blob in file order, read in large chunks while the next one is read ahead;
+    // every record is read whole, records set or deleted during the scan may or may not be seen,
+    // and compaction running meanwhile may move a record past the scan, so it is missed or seen twice;
+    // slots of the direct addressed blob are stored if their value isn't all zeros, which a deleted key leaves
+    class BlobScanner
+    {
+        private:
+            // slots read with one call, and after the last home slot of a range, where only its chains go on
+            static constexpr uint64_t chunkLength = 1 << 20;
+            static constexpr uint64_t chainChunkLength = 4096;
+
+            const Blob* blob;               // blob being read, the doubled one first while the blob grows
+            const Blob* older = nullptr;    // growing blob, its records not moved yet are read after the doubled blob
+            bool isRange;
+            uint64_t first = 0;             // key orders of the range
+            uint64_t last = 0;
+            uint64_t firstHome = 0;         // home slots a key of the range can have
+            uint64_t lastHome = 0;
+            uint64_t nextSlot = 0;          // first slot of the next chunk
+            std::vector<uint64_t> pages;    // record pages the sparse blob had written when the scan started
+            uint64_t writtenEnd = 0;        // end slot of the written pages following each other from nextSlot on
+            bool isWrapped = false;         // chains of the last slots go on at the first ones
+            bool isEnd = false;             // no chunk after the current one
+            std::vector<Byte> chunk;
+            uint64_t chunkSlot = 0;         // slot of the first record in the chunk
+            uint64_t chunkCount = 0;
+            uint64_t index = 0;             // next record of the chunk
+            uint64_t epoch = 0;             // compaction epoch the chunk was read in
+            std::vector<Byte> key;
+            std::vector<Byte> value;
+            uint64_t valueLen = 0;
+            BlobStatus status;
+
+            BlobScanner(const Blob& blob, std::span<const Byte> from, std::span<const Byte> to, const bool& isRange);
+            // start reading the blob at the home slot of the range or at its first slot
+            void Start(const Blob& scanned, const uint64_t& startSlot);
+            // whether the slot is past the home slots of the range, where only the chains going on from them are left
+            bool IsChain(const uint64_t& slot) const noexcept
+            {
+                return isRange && (slot > lastHome || isWrapped);
+            }
+            // move nextSlot past the pages the sparse blob never wrote, to the end of the blob if it wrote none after it
+            void SkipUnwritten() noexcept;
+            // records of the next chunk starting at the slot
+            uint64_t ChunkCount(const uint64_t& slot) const noexcept;
+            // hint the file system to read the records after the chunk
+            void ReadAhead(const uint64_t& address, const uint64_t& len) const noexcept;
+            // read count records starting at the slot into the chunk, retried while compaction moves records
+            bool ReadChunk(const uint64_t& slot, const uint64_t& count) noexcept;
+            // whether the record of the chunk is stored in the scanned range, its key goes to key
+            bool IsStored(const uint64_t& slot, const Byte* record) noexcept;
+            friend class Blob;
+        public:
+            // move to the next stored record, false at the end of the scan or if the records couldn't be read
+            bool Next() noexcept;
+            std::span<const Byte> Key() const noexcept
+            {
+                return key;
+            }
+            // ValueLength() bytes, the ones past the length set are zeros
+            std::span<const Byte> Value() const noexcept
+            {
+                return value;
+            }
+            // length of the value set, ValueLength() unless the blob has the value log
+            uint64_t ValueLen() const noexcept
+            {
+                return valueLen;
+            }
+            // Ok unless the keys of the range had the wrong length or the records couldn't be read
+            BlobStatus Status() const noexcept
+            {
+                return status;
+            }
+    };
+}
@@ -0,0 +1,407 @@
+#include "blob_server.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace DB36_NS
+{
+
+BlobServer::Connection::~Connection()
+{
+    close(fd);
+}
+
+BlobServer::BlobServer(Blob& blob, const std::string& socketPath, const uint64_t& workersCount) :
+    blob(blob),
+    socketPath(socketPath)
+{
+    if (workersCount == 0 || (workersCount > 1 && blob.LockStripes() == 0))
+        throw std::logic_error("Server needs a worker, and lock stripes in the blob for more of them");
+    if (blob.ValueLength() > maxBodyLength)
+        throw std::logic_error("Blob values don't fit in a response");
+    sockaddr_un address {};
+    if (socketPath.size() >= sizeof(address.sun_path))
+        throw std::logic_error("Socket path is too long: " + socketPath);
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size());
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    // socket of the server that ran before is left behind when it didn't stop cleanly
+    unlink(socketPath.c_str());
+    epoll_event listenEvent {EPOLLIN, {.fd = listenFd}};
+    epoll_event stopEvent {EPOLLIN, {.fd = stopFd}};
+    if (listenFd < 0 || epollFd < 0 || stopFd < 0
+        || bind(listenFd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+        || listen(listenFd, SOMAXCONN) != 0
+        || epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &listenEvent) != 0
+        || epoll_ctl(epollFd, EPOLL_CTL_ADD, stopFd, &stopEvent) != 0)
+    {
+        const auto error = errno;
+        CloseDescriptors();
+        throw std::runtime_error(std::string("Failed to listen on the server socket: ") + std::strerror(error));
+    }
+    for (uint64_t worker = 0; worker < workersCount; ++worker)
+        workers.emplace_back([this]() { Work(); });
+}
+
+BlobServer::~BlobServer()
+{
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        isStopped = true;
+    }
+    queueCondition.notify_all();
+    for (auto& worker : workers)
+        worker.join();
+    queue.clear();
+    connections.clear();
+    CloseDescriptors();
+    unlink(socketPath.c_str());
+}
+
+void BlobServer::CloseDescriptors() noexcept
+{
+    for (const auto fd : {listenFd, epollFd, stopFd})
+    {
+        if (fd >= 0)
+            close(fd);
+    }
+}
+
+void BlobServer::Run()
+{
+    epoll_event events[64];
+    for (;;)
+    {
+        const auto count = epoll_wait(epollFd, events, std::size(events), -1);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count < 0)
+            throw std::runtime_error(std::string("Failed to wait for the server sockets: ") + std::strerror(errno));
+        for (int i = 0; i < count; ++i)
+        {
+            const auto fd = events[i].data.fd;
+            if (fd == stopFd)
+            {
+                uint64_t stops = 0;
+                [[maybe_unused]] const auto len = read(stopFd, &stops, sizeof(stops));
+                return;
+            }
+            if (fd == listenFd)
+            {
+                Accept();
+                continue;
+            }
+            const auto found = connections.find(fd);
+            if (found == connections.end())
+                continue;
+            const auto connection = found->second;
+            bool isRead = true;
+            {
+                std::lock_guard<std::mutex> lock(connection->mutex);
+                if ((events[i].events & EPOLLOUT) != 0)
+                {
+                    Flush(*connection);
+                    Watch(*connection);
+                }
+                isRead = (connection->events & EPOLLIN) != 0;
+            }
+            // hang up is seen by the read, after the requests sent before it; a connection that isn't read until
+            // its queue drains is closed right away, the peer is gone and the hang up would wake the loop until then
+            const bool isHungUp = (events[i].events & (EPOLLHUP | EPOLLERR)) != 0;
+            if (isHungUp && !isRead)
+                CloseConnection(connection);
+            else if ((isHungUp || (events[i].events & EPOLLIN) != 0) && !ReadConnection(connection))
+                CloseConnection(connection);
+        }
+    }
+}
+
+void BlobServer::Stop() noexcept
+{
+    const uint64_t stop = 1;
+    [[maybe_unused]] const auto len = write(stopFd, &stop, sizeof(stop));
+}
+
+void BlobServer::Accept() noexcept
+{
+    for (;;)
+    {
+        const auto fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+        auto connection = std::make_shared<Connection>(fd, EPOLLIN);
+        epoll_event event {EPOLLIN, {.fd = fd}};
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == 0)
+            connections.emplace(fd, std::move(connection));
+    }
+}
+
+bool BlobServer::ReadConnection(const std::shared_ptr<Connection>& connection)
+{
+    auto& input = connection->input;
+    uint64_t queuedBytes = 0;
+    {
+        std::lock_guard<std::mutex> lock(connection->mutex);
+        queuedBytes = connection->queuedBytes;
+    }
+    if (queuedBytes >= maxQueuedBytes)
+        return true;
+    // the input holds only the partial request left by the last read, which is read to its end even past the limit,
+    // otherwise a request longer than the limit never becomes whole and frees the input
+    uint64_t restOfRequest = sizeof(RequestHeader) - std::min<uint64_t>(input.size(), sizeof(RequestHeader));
+    if (restOfRequest == 0)
+    {
+        RequestHeader header {};
+        std::memcpy(&header.bodyLength, input.data(), sizeof(header.bodyLength));
+        restOfRequest = sizeof(RequestHeader) + std::min<uint64_t>(header.bodyLength, maxBodyLength) - input.size();
+    }
+    // reading stops once the input and the queue reach the limit
+    auto room = std::max(maxQueuedBytes - std::min(maxQueuedBytes, queuedBytes + input.size()), restOfRequest);
+    bool isEnded = false;
+    while (room > 0)
+    {
+        const auto offset = input.size();
+        const auto length = std::min(readLength, room);
+        input.resize(offset + length);
+        const auto len = recv(connection->fd, input.data() + offset, length, MSG_DONTWAIT);
+        input.resize(offset + std::max<ssize_t>(len, 0));
+        // peer is done sending, the whole requests it sent are still answered
+        if (len == 0)
+        {
+            isEnded = true;
+            break;
+        }
+        if (len < 0 && errno == EINTR)
+            continue;
+        if (len < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                return false;
+            break;
+        }
+        room -= len;
+        // short read emptied the socket, the requests sent after it wait for the next event
+        if (uint64_t(len) < length)
+            break;
+    }
+
+    // whole requests go to the workers as one batch, the partial one at the end waits for the rest of it
+    uint64_t batchLength = 0;
+    for (;;)
+    {
+        const auto rest = std::span<const Byte>(input).subspan(batchLength);
+        RequestHeader header {};
+        if (rest.size() >= sizeof(header.bodyLength))
+            std::memcpy(&header.bodyLength, rest.data(), sizeof(header.bodyLength));
+        if (header.bodyLength > maxBodyLength)
+            return false;
+        const auto frameLength = FrameLength(rest);
+        if (frameLength == 0)
+            break;
+        batchLength += frameLength;
+    }
+    if (batchLength == 0 && !isEnded)
+        return true;
+    std::vector<Byte> batch;
+    if (batchLength == input.size())
+        batch.swap(input);
+    else
+    {
+        batch.assign(input.begin(), input.begin() + batchLength);
+        input.erase(input.begin(), input.begin() + batchLength);
+    }
+
+    bool isQueued = false;
+    {
+        std::lock_guard<std::mutex> lock(connection->mutex);
+        if (!batch.empty())
+        {
+            connection->queuedBytes += batch.size();
+            connection->batches.push_back(std::move(batch));
+            isQueued = !connection->isQueued;
+            connection->isQueued = true;
+        }
+        // ended connection isn't read any more, it goes once everything it asked for is answered
+        if (isEnded && connection->queuedBytes == 0)
+            return false;
+        connection->isEnded = connection->isEnded || isEnded;
+        Watch(*connection);
+    }
+    if (isQueued)
+    {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            queue.push_back(connection);
+        }
+        queueCondition.notify_one();
+    }
+    return true;
+}
+
+void BlobServer::CloseConnection(const std::shared_ptr<Connection>& connection) noexcept
+{
+    {
+        std::lock_guard<std::mutex> lock(connection->mutex);
+        connection->isClosed = true;
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, connection->fd, nullptr);
+    }
+    connections.erase(connection->fd);
+}
+
+void BlobServer::Flush(Connection& connection) noexcept
+{
+    auto& output = connection.output;
+    while (connection.sentBytes < output.size())
+    {
+        const auto len = send(connection.fd, output.data() + connection.sentBytes, output.size() - connection.sentBytes,
+                              MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (len < 0 && errno == EINTR)
+            continue;
+        // a full socket is sent to when the loop sees it writable, a failed one is closed by the loop
+        if (len < 0)
+            return;
+        connection.sentBytes += len;
+        connection.queuedBytes -= len;
+    }
+    output.clear();
+    connection.sentBytes = 0;
+}
+
+void BlobServer::Watch(Connection& connection) noexcept
+{
+    if (connection.isClosed)
+        return;
+    // answers of an ended connection are all sent, shutting the writes down hangs it up, which the loop closes
+    if (connection.isEnded && connection.queuedBytes == 0)
+        shutdown(connection.fd, SHUT_WR);
+    const uint32_t events = (connection.queuedBytes < maxQueuedBytes && !connection.isEnded ? uint32_t(EPOLLIN) : 0)
+                          | (connection.sentBytes < connection.output.size() ? uint32_t(EPOLLOUT) : 0);
+    if (events == connection.events)
+        return;
+    epoll_event event {events, {.fd = connection.fd}};
+    if (epoll_ctl(epollFd, EPOLL_CTL_MOD, connection.fd, &event) == 0)
+        connection.events = events;
+}
+
+void BlobServer::Work()
+{
+    std::vector<Byte> responses;
+    for (;;)
+    {
+        std::shared_ptr<Connection> connection;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCondition.wait(lock, [this]() { return isStopped || !queue.empty(); });
+            if (isStopped)
+                return;
+            connection = std::move(queue.front());
+            queue.pop_front();
+        }
+        // batches the loop adds meanwhile are taken by this worker too, so the connection is answered in order
+        for (;;)
+        {
+            std::vector<Byte> batch;
+            {
+                std::lock_guard<std::mutex> lock(connection->mutex);
+                if (connection->batches.empty() || connection->isClosed)
+                {
+                    connection->batches.clear();
+                    connection->isQueued = false;
+                    break;
+                }
+                batch = std::move(connection->batches.front());
+                connection->batches.pop_front();
+            }
+            responses.clear();
+            uint64_t requests = 0;
+            for (uint64_t offset = 0; offset < batch.size(); ++requests)
+            {
+                const auto frameLength = FrameLength(std::span<const Byte>(batch).subspan(offset));
+                Execute(std::span<const Byte>(batch).subspan(offset, frameLength), responses);
+                offset += frameLength;
+            }
+            requestsCount.fetch_add(requests, std::memory_order_relaxed);
+
+            std::lock_guard<std::mutex> lock(connection->mutex);
+            connection->queuedBytes -= batch.size();
+            if (connection->isClosed)
+                continue;
+            connection->queuedBytes += responses.size();
+            if (connection->output.empty())
+                connection->output.swap(responses);
+            else
+                connection->output.insert(connection->output.end(), responses.begin(), responses.end());
+            Flush(*connection);
+            Watch(*connection);
+        }
+    }
+}
+
+void BlobServer::Execute(std::span<const Byte> request, std::vector<Byte>& output)
+{
+    RequestHeader header {};
+    std::memcpy(&header, request.data(), sizeof(header));
+    const auto body = request.subspan(sizeof(header));
+    const auto opcode = static_cast<BlobOpcode>(header.opcode);
+    const uint64_t keyLength = blob.KeyLength();
+    const uint64_t valueLength = blob.ValueLength();
+    const auto answer = [&](const BlobStatus& status)
+    {
+        AppendResponse(output, opcode, static_cast<uint8_t>(status), header.id, 0);
+    };
+    switch (opcode)
+    {
+        case BlobOpcode::Info:
+        {
+            const uint64_t lengths[2] = {keyLength, valueLength};
+            std::memcpy(AppendResponse(output, opcode, static_cast<uint8_t>(BlobStatus::Ok), header.id, sizeof(lengths)).data(),
+                        lengths, sizeof(lengths));
+            return;
+        }
+        case BlobOpcode::Get:
+        {
+            if (body.size() != keyLength)
+                return answer(BlobStatus::InvalidLength);
+            // value is read straight into the response, which is cut back to the header if the key isn't there
+            const auto offset = output.size();
+            const auto value = AppendResponse(output, opcode, static_cast<uint8_t>(BlobStatus::Ok), header.id, valueLength);
+            const auto status = blob.Get(body, value);
+            if (status == BlobStatus::Ok)
+                return;
+            output.resize(offset);
+            return answer(status);
+        }
+        case BlobOpcode::Set:
+            if (body.size() < keyLength)
+                return answer(BlobStatus::InvalidLength);
+            return answer(blob.Set(body.first(keyLength), body.subspan(keyLength)));
+        case BlobOpcode::MultiGet:
+        {
+            if (body.empty() || body.size() % keyLength != 0)
+                return answer(BlobStatus::InvalidLength);
+            const auto count = body.size() / keyLength;
+            // a few short keys ask for a lot of values, the response has to fit in a frame too
+            if (count + count * valueLength > maxBodyLength)
+                return answer(BlobStatus::InvalidLength);
+            const auto response = AppendResponse(output, opcode, static_cast<uint8_t>(BlobStatus::Ok), header.id,
+                                                 count + count * valueLength);
+            const auto statuses = blob.MultiGet(body, response.subspan(count));
+            for (uint64_t i = 0; i < count; ++i)
+                response[i] = static_cast<uint8_t>(statuses[i]);
+            return;
+        }
+        default:
+            return answer(BlobStatus::InvalidLength);
+    }
+}
+}
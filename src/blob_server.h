@@ -0,0 +1,95 @@
+#pragma once
+
+#include "blob.h"
+#include "blob_protocol.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace DB36_NS
+{
+
+    // serves the blob over a Unix domain socket: one thread waits on epoll for every connection and cuts the received
+    // bytes into batches of whole requests, the workers run the batches on the blob and send the responses themselves;
+    // a connection is served by one worker at a time, so its requests are answered in order and pipelining
+    // a lot of them costs one read and one write per batch instead of one per request
+    class BlobServer
+    {
+        private:
+            static constexpr uint64_t readLength = 64 * 1024;
+            // connection isn't read while this much of its input, requests and responses waits, past the end of
+            // the request being read, so a client that sends without reading can't take the memory
+            static constexpr uint64_t maxQueuedBytes = 4 << 20;
+
+            struct Connection
+            {
+                int fd;
+                std::vector<Byte> input;            // bytes read past the last whole request, only the loop touches it
+                std::mutex mutex;                   // guards the members below
+                std::deque<std::vector<Byte>> batches;  // whole requests waiting for a worker
+                std::vector<Byte> output;           // responses not sent yet
+                uint64_t sentBytes = 0;             // of the output
+                uint64_t queuedBytes = 0;           // in the batches and the output
+                bool isQueued = false;              // a worker has the connection or it waits in the queue
+                bool isClosed = false;
+                bool isEnded = false;               // peer shut its writes down, nothing more is read
+                uint32_t events;                    // epoll events the loop waits for on the descriptor
+
+                Connection(const int& fd, const uint32_t& events) : fd(fd), events(events) {}
+                Connection(const Connection&) = delete;
+                Connection& operator= (const Connection&) = delete;
+                // the descriptor outlives the workers that may still send to it
+                ~Connection();
+            };
+
+            Blob& blob;
+            const std::string socketPath;
+            int listenFd = -1;
+            int epollFd = -1;
+            int stopFd = -1;        // eventfd that wakes the loop up to return
+            std::unordered_map<int, std::shared_ptr<Connection>> connections;   // only the loop touches it
+            std::mutex queueMutex;
+            std::condition_variable queueCondition;
+            std::deque<std::shared_ptr<Connection>> queue;  // connections with batches waiting
+            bool isStopped = false;
+            std::atomic<uint64_t> requestsCount = 0;
+            std::vector<std::thread> workers;   // started last, after everything they use is ready
+
+            void Accept() noexcept;
+            // read what the connection has, false if it has to be closed
+            bool ReadConnection(const std::shared_ptr<Connection>& connection);
+            void CloseConnection(const std::shared_ptr<Connection>& connection) noexcept;
+            // send the output until the socket is full, the connection mutex is held
+            void Flush(Connection& connection) noexcept;
+            // events the loop waits for: input unless too much is queued or the peer ended, output while some isn't sent;
+            // an ended connection with everything answered is shut down; the connection mutex is held
+            void Watch(Connection& connection) noexcept;
+            void Work();
+            // answer the request at the front of the bytes into the output
+            void Execute(std::span<const Byte> request, std::vector<Byte>& output);
+            void CloseDescriptors() noexcept;
+        public:
+            // listens on the socket path, replacing the socket left there; the blob must outlive the server
+            // and have lock stripes if there is more than one worker, and values that fit in a response
+            BlobServer(Blob& blob, const std::string& socketPath, const uint64_t& workersCount);
+            BlobServer(const BlobServer&) = delete;
+            BlobServer& operator= (const BlobServer&) = delete;
+            // stops the workers, closes the connections and removes the socket
+            ~BlobServer();
+            // serve the connections until Stop is called
+            void Run();
+            // make Run return, safe to call from a signal handler
+            void Stop() noexcept;
+            uint64_t RequestsCount() const noexcept
+            {
+                return requestsCount.load(std::memory_order_relaxed);
+            }
+    };
+}
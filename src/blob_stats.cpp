@@ -0,0 +1,104 @@
+#include "blob_stats.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <thread>
+
+namespace DB36_NS
+{
+
+uint64_t BlobHistogram::BucketOf(const uint64_t& value) noexcept
+{
+    if (value < subBuckets)
+        return value;
+    const uint64_t exponent = std::bit_width(value) - 1;
+    const auto subBucket = (value >> (exponent - subBucketBits)) & (subBuckets - 1);
+    return (exponent - subBucketBits + 1) * subBuckets + subBucket;
+}
+
+uint64_t BlobHistogram::BucketTop(const uint64_t& bucket) noexcept
+{
+    if (bucket < subBuckets)
+        return bucket;
+    const auto exponent = bucket / subBuckets + subBucketBits - 1;
+    const auto low = (subBuckets + bucket % subBuckets) << (exponent - subBucketBits);
+    return low + ((uint64_t(1) << (exponent - subBucketBits)) - 1);
+}
+
+uint64_t BlobHistogram::Percentile(const double& percentile) const noexcept
+{
+    const auto rank = std::max<uint64_t>(1, std::ceil(percentile * count));
+    uint64_t seen = 0;
+    for (uint64_t bucket = 0; bucket < bucketsCount; ++bucket)
+    {
+        seen += counts[bucket];
+        if (seen >= rank)
+            return std::min(BucketTop(bucket), max);
+    }
+    return max;
+}
+
+void BlobStatsCollector::AtomicHistogram::Add(const uint64_t& value) noexcept
+{
+    counts[BlobHistogram::BucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(value, std::memory_order_relaxed);
+    auto stored = max.load(std::memory_order_relaxed);
+    while (value > stored && !max.compare_exchange_weak(stored, value, std::memory_order_relaxed))
+        ;
+}
+
+void BlobStatsCollector::AtomicHistogram::AddTo(BlobHistogram& histogram) const noexcept
+{
+    for (uint64_t bucket = 0; bucket < BlobHistogram::bucketsCount; ++bucket)
+    {
+        const auto bucketCount = counts[bucket].load(std::memory_order_relaxed);
+        histogram.counts[bucket] += bucketCount;
+        histogram.count += bucketCount;
+    }
+    histogram.sum += sum.load(std::memory_order_relaxed);
+    histogram.max = std::max(histogram.max, max.load(std::memory_order_relaxed));
+}
+
+BlobStatsCollector::BlobStatsCollector() :
+    // threads beyond the cores share shards, which only costs contention
+    shardsCount(std::clamp<uint64_t>(std::thread::hardware_concurrency(), 1, 64)),
+    shards(std::make_unique<StatsShard[]>(shardsCount))
+{
+}
+
+BlobStatsCollector::StatsShard& BlobStatsCollector::ThreadShard() const noexcept
+{
+    static std::atomic<uint64_t> threadsCount = 0;
+    static thread_local const uint64_t threadNumber = threadsCount.fetch_add(1, std::memory_order_relaxed);
+    return shards[threadNumber % shardsCount];
+}
+
+void BlobStatsCollector::Add(const BlobCount& counter, const uint64_t& value) noexcept
+{
+    ThreadShard().counts[size_t(counter)].fetch_add(value, std::memory_order_relaxed);
+}
+
+void BlobStatsCollector::AddProbe(const uint64_t& slots) noexcept
+{
+    ThreadShard().histograms[probeHistogram].Add(slots);
+}
+
+void BlobStatsCollector::AddLatency(const BlobOperation& operation, const uint64_t& nanoseconds) noexcept
+{
+    ThreadShard().histograms[size_t(operation)].Add(nanoseconds);
+}
+
+void BlobStatsCollector::Snapshot(BlobStats& stats) const noexcept
+{
+    for (uint64_t i = 0; i < shardsCount; ++i)
+    {
+        const auto& shard = shards[i];
+        for (size_t counter = 0; counter < shard.counts.size(); ++counter)
+            stats.counts[counter] += shard.counts[counter].load(std::memory_order_relaxed);
+        for (size_t operation = 0; operation < stats.latencies.size(); ++operation)
+            shard.histograms[operation].AddTo(stats.latencies[operation]);
+        shard.histograms[probeHistogram].AddTo(stats.probeLengths);
+    }
+}
+}
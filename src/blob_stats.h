@@ -0,0 +1,148 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace DB36_NS
+{
+
+    // operations timed by the blob statistics
+    enum class BlobOperation
+    {
+        Get,
+        Set,
+        Delete,
+        MultiGet,
+        MultiSet,
+        Count
+    };
+
+    // counters of the blob file access
+    enum class BlobCount
+    {
+        ReadCalls,      // pread calls and ring reads of the records
+        WriteCalls,     // pwrite calls and ring writes of the records and the header
+        BytesRead,
+        BytesWritten,
+        Count
+    };
+
+    // values split into 4 buckets per power of two, so a percentile is off by at most a quarter
+    class BlobHistogram
+    {
+        public:
+            static constexpr uint64_t subBucketBits = 2;
+            static constexpr uint64_t subBuckets = 1 << subBucketBits;
+            static constexpr uint64_t bucketsCount = (64 - subBucketBits + 1) * subBuckets;
+
+            std::array<uint64_t, bucketsCount> counts {};
+            uint64_t count = 0;
+            uint64_t sum = 0;
+            uint64_t max = 0;
+
+            static uint64_t BucketOf(const uint64_t& value) noexcept;
+            // the largest value of the bucket
+            static uint64_t BucketTop(const uint64_t& bucket) noexcept;
+            // smallest bucket top that at least this share of the values doesn't exceed
+            uint64_t Percentile(const double& percentile) const noexcept;
+            uint64_t Mean() const noexcept
+            {
+                return count ? sum / count : 0;
+            }
+    };
+
+    // snapshot of the blob statistics; the counters are zeros if the blob doesn't collect them
+    struct BlobStats
+    {
+        uint64_t recordsCount = 0;
+        uint64_t storedRecords = 0;
+        uint64_t tombstoneRecords = 0;
+        double loadFactor = 0;          // share of the slots holding keys or tombstones
+        uint64_t cacheHits = 0;
+        uint64_t cacheMisses = 0;
+        uint64_t poolHits = 0;
+        uint64_t poolMisses = 0;
+        std::array<uint64_t, size_t(BlobCount::Count)> counts {};
+        BlobHistogram probeLengths;     // slots probed by every lookup of the shrinked blob, the home slot counts as 1
+        std::array<BlobHistogram, size_t(BlobOperation::Count)> latencies {};   // nanoseconds of every call
+
+        uint64_t Count(const BlobCount& counter) const
+        {
+            return counts[size_t(counter)];
+        }
+        const BlobHistogram& Latency(const BlobOperation& operation) const
+        {
+            return latencies[size_t(operation)];
+        }
+    };
+
+    // counters and histograms of one blob; every thread adds to its own shard with relaxed atomics,
+    // shards are only summed by Snapshot, so collecting costs no shared cache line
+    class BlobStatsCollector
+    {
+        private:
+            static constexpr uint64_t histogramsCount = size_t(BlobOperation::Count) + 1;
+            // the probe histogram follows the latency ones
+            static constexpr uint64_t probeHistogram = size_t(BlobOperation::Count);
+
+            // the count of the values is the sum of the buckets, so adding a value costs two increments
+            struct AtomicHistogram
+            {
+                std::array<std::atomic<uint64_t>, BlobHistogram::bucketsCount> counts {};
+                std::atomic<uint64_t> sum = 0;
+                std::atomic<uint64_t> max = 0;
+
+                void Add(const uint64_t& value) noexcept;
+                void AddTo(BlobHistogram& histogram) const noexcept;
+            };
+            struct alignas(64) StatsShard
+            {
+                std::array<std::atomic<uint64_t>, size_t(BlobCount::Count)> counts {};
+                std::array<AtomicHistogram, histogramsCount> histograms {};
+            };
+
+            uint64_t shardsCount;
+            std::unique_ptr<StatsShard[]> shards;
+
+            // shard of the calling thread, threads are numbered as they first add to any blob
+            StatsShard& ThreadShard() const noexcept;
+        public:
+            BlobStatsCollector();
+            BlobStatsCollector(const BlobStatsCollector&) = delete;
+            BlobStatsCollector& operator= (const BlobStatsCollector&) = delete;
+            void Add(const BlobCount& counter, const uint64_t& value) noexcept;
+            void AddProbe(const uint64_t& slots) noexcept;
+            void AddLatency(const BlobOperation& operation, const uint64_t& nanoseconds) noexcept;
+            // fill the counters and histograms of the snapshot
+            void Snapshot(BlobStats& stats) const noexcept;
+    };
+
+    // times the blob call it lives through if the blob collects statistics
+    class BlobOperationTimer
+    {
+        private:
+            BlobStatsCollector* stats;
+            BlobOperation operation;
+            std::chrono::steady_clock::time_point start;
+        public:
+            BlobOperationTimer(BlobStatsCollector* stats, const BlobOperation& operation) noexcept :
+                stats(stats),
+                operation(operation)
+                {
+                    if (stats)
+                        start = std::chrono::steady_clock::now();
+                }
+            BlobOperationTimer(const BlobOperationTimer&) = delete;
+            BlobOperationTimer& operator= (const BlobOperationTimer&) = delete;
+            ~BlobOperationTimer()
+            {
+                if (stats)
+                    stats->AddLatency(operation, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start).count());
+            }
+    };
+}
@@ -0,0 +1,223 @@
+#include "blob_value_log.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace DB36_NS
+{
+
+BlobValueLog::BlobValueLog(const std::string& path, const uint64_t& keyLength, const uint64_t& valueLength,
+                           const uint64_t& threshold, const bool& isOpened) :
+    logPath(path),
+    keyLength(keyLength),
+    valueLength(valueLength),
+    threshold(threshold),
+    file(fopen(logPath.c_str(), isOpened ? "r+" : "w+"), &fclose),
+    entryBuffer(std::make_unique<Byte[]>(entryHeaderLength + keyLength + valueLength))
+{
+    if (!file)
+        throw std::runtime_error(std::string("Failed to open blob value log: ") + std::strerror(errno));
+    if (!isOpened)
+    {
+        if (!WriteHeader())
+            throw std::runtime_error(std::string("Failed to write blob value log header: ") + std::strerror(errno));
+        return;
+    }
+    ValueLogHeader header {};
+    struct stat fileStat {};
+    const auto fd = fileno(file.get());
+    if (pread(fd, &header, sizeof(header), 0) != ssize_t(sizeof(header))
+        || std::memcmp(header.magic, ValueLogHeader::valueLogMagic, sizeof(header.magic)) != 0
+        || header.keyLength != keyLength || header.valueLength != valueLength || fstat(fd, &fileStat) != 0
+        || header.tail < headerLength || header.tail > uint64_t(fileStat.st_size))
+        throw std::logic_error("Blob value log doesn't match the blob: " + logPath);
+    // entries torn by a crash are past every slot that points into the log, so they are only garbage
+    head = fileStat.st_size;
+    tail = header.tail;
+    garbageBytes = header.garbageBytes;
+}
+
+BlobValueLog::~BlobValueLog()
+{
+    WriteHeader();
+}
+
+bool BlobValueLog::WriteHeader() noexcept
+{
+    ValueLogHeader header {};
+    std::memcpy(header.magic, ValueLogHeader::valueLogMagic, sizeof(header.magic));
+    header.keyLength = keyLength;
+    header.valueLength = valueLength;
+    header.tail = tail;
+    header.garbageBytes = garbageBytes;
+    return pwrite(fileno(file.get()), &header, sizeof(header), 0) == ssize_t(sizeof(header));
+}
+
+bool BlobValueLog::Write(const Byte* key, std::span<const Byte> value, Byte* slotValue) noexcept
+{
+    const uint32_t valueLen = value.size();
+    std::memcpy(slotValue, &valueLen, slotHeaderLength);
+    const auto slotData = slotValue + slotHeaderLength;
+    if (valueLen <= threshold)
+    {
+        std::memcpy(slotData, value.data(), valueLen);
+        std::memset(slotData + valueLen, 0, SlotLength(threshold) - slotHeaderLength - valueLen);
+        return true;
+    }
+    // appenders only race for the offset, every one of them writes its own range
+    const auto length = EntryLength(valueLen);
+    const uint64_t offset = head.fetch_add(length);
+    iovec parts[3] = {
+        {const_cast<uint32_t*>(&valueLen), entryHeaderLength},
+        {const_cast<Byte*>(key), keyLength},
+        {const_cast<Byte*>(value.data()), valueLen}};
+    if (pwritev(fileno(file.get()), parts, 3, offset) != ssize_t(length))
+    {
+        // head is past the range already, so collection has to be told how long it is to step over it:
+        // a skip in the range survives a reopen, the gap is kept in memory if the skip can't be written either
+        garbageBytes += length;
+        Byte skip[skipLength];
+        const uint64_t next = offset + length;
+        std::memcpy(skip, &failedMarker, entryHeaderLength);
+        std::memcpy(skip + entryHeaderLength, &next, sizeof(next));
+        if (length < skipLength || pwrite(fileno(file.get()), skip, skipLength, offset) != ssize_t(skipLength))
+        {
+            std::lock_guard<std::mutex> lock(gapsMutex);
+            gaps.emplace(offset, length);
+        }
+        return false;
+    }
+    std::memcpy(slotData, &offset, sizeof(offset));
+    std::memset(slotData + sizeof(offset), 0, SlotLength(threshold) - slotHeaderLength - sizeof(offset));
+    return true;
+}
+
+bool BlobValueLog::Read(const Byte* slotValue, Byte* value, uint64_t& valueLen) const noexcept
+{
+    uint32_t length = 0;
+    std::memcpy(&length, slotValue, slotHeaderLength);
+    valueLen = std::min<uint64_t>(length, valueLength);
+    if (valueLen <= threshold)
+        std::memcpy(value, slotValue + slotHeaderLength, valueLen);
+    else
+    {
+        uint64_t offset = 0;
+        std::memcpy(&offset, slotValue + slotHeaderLength, sizeof(offset));
+        if (pread(fileno(file.get()), value, valueLen, offset + entryHeaderLength + keyLength) != ssize_t(valueLen))
+            return false;
+    }
+    std::memset(value + valueLen, 0, valueLength - valueLen);
+    return true;
+}
+
+bool BlobValueLog::PointsAt(const Byte* slotValue, const uint64_t& offset) const noexcept
+{
+    uint32_t length = 0;
+    uint64_t slotOffset = 0;
+    std::memcpy(&length, slotValue, slotHeaderLength);
+    std::memcpy(&slotOffset, slotValue + slotHeaderLength, sizeof(slotOffset));
+    return length > threshold && slotOffset == offset;
+}
+
+void BlobValueLog::Release(const Byte* slotValue) noexcept
+{
+    uint32_t length = 0;
+    std::memcpy(&length, slotValue, slotHeaderLength);
+    if (length > threshold)
+        garbageBytes += EntryLength(length);
+}
+
+uint64_t BlobValueLog::Collect(const uint64_t& maxBytes, const Relocate& relocate,
+                               const std::function<bool()>& syncSlots) noexcept
+{
+    const auto fd = fileno(file.get());
+    const auto start = tail.load();
+    // entries appended by the relocation are past the end, so they aren't visited again
+    const auto end = std::min<uint64_t>(head, start + maxBytes);
+    auto offset = start;
+    uint64_t deadBytes = 0;
+    bool isSkippable = false;
+    while (offset < end)
+    {
+        // one read takes the entry header, the key and the longest value, the next entry only starts after it
+        const auto bytesRead = pread(fd, entryBuffer.get(), EntryLength(valueLength), offset);
+        uint32_t valueLen = 0;
+        if (bytesRead >= ssize_t(entryHeaderLength))
+            std::memcpy(&valueLen, entryBuffer.get(), entryHeaderLength);
+        // skip left by an earlier collection jumps over the pages it punched, the one of a failed append over its range
+        if ((valueLen == skipMarker || valueLen == failedMarker) && bytesRead >= ssize_t(skipLength))
+        {
+            uint64_t next = 0;
+            std::memcpy(&next, entryBuffer.get() + entryHeaderLength, sizeof(next));
+            if (next <= offset || next > head)
+                break;
+            if (valueLen == failedMarker)
+                deadBytes += next - offset;
+            isSkippable = isSkippable || offset == start;
+            offset = next;
+            continue;
+        }
+        if (valueLen <= threshold || valueLen > valueLength || bytesRead < ssize_t(EntryLength(valueLen)))
+        {
+            std::lock_guard<std::mutex> lock(gapsMutex);
+            const auto gap = gaps.find(offset);
+            // only an append in flight at a crash is left torn without a skip, collection stops at it
+            if (gap == gaps.end())
+                break;
+            deadBytes += gap->second;
+            isSkippable = isSkippable || (offset == start && gap->second >= skipLength);
+            offset += gap->second;
+            gaps.erase(gap);
+            continue;
+        }
+        const auto key = entryBuffer.get() + entryHeaderLength;
+        const auto state = relocate(key, offset, std::span<const Byte>(key + keyLength, valueLen));
+        if (state == EntryState::Failed)
+            break;
+        if (state == EntryState::Dead)
+            deadBytes += EntryLength(valueLen);
+        isSkippable = isSkippable || (offset == start && EntryLength(valueLen) >= skipLength);
+        offset += EntryLength(valueLen);
+    }
+    if (offset == start)
+        return 0;
+    // copies of the moved entries and then the slots pointing at them are on the disk before the entries go,
+    // otherwise the visited entries stay and the next collection finds them dead
+    if (fdatasync(fd) != 0 || !syncSlots())
+        return 0;
+    // first visited entry becomes a skip to the new tail, so a log opened with a stale tail jumps over the punched pages
+    // instead of stopping at their zeros
+    auto punchFrom = start;
+    if (isSkippable)
+    {
+        Byte skip[skipLength];
+        std::memcpy(skip, &skipMarker, entryHeaderLength);
+        std::memcpy(skip + entryHeaderLength, &offset, sizeof(offset));
+        if (pwrite(fd, skip, skipLength, start) == ssize_t(skipLength))
+            punchFrom = start + skipLength;
+    }
+    tail = offset;
+    garbageBytes -= std::min<uint64_t>(garbageBytes, deadBytes);
+    // new tail is on the disk before the pages behind it are punched
+    if (!WriteHeader() || fdatasync(fd) != 0)
+        return offset - start;
+    // whole pages of the visited entries go back to the file system, readers of stale offsets get zeros
+    // and see the epoch of the blob change
+    const auto punchStart = (punchFrom + headerLength - 1) / headerLength * headerLength;
+    const auto punchEnd = offset / headerLength * headerLength;
+    if (punchStart < punchEnd)
+        fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, punchStart, punchEnd - punchStart);
+    return offset - start;
+}
+
+bool BlobValueLog::Sync() noexcept
+{
+    return WriteHeader() && fdatasync(fileno(file.get())) == 0;
+}
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stdio.h>
+#include <string>
+
+namespace DB36_NS
+{
+
+    using Byte = uint8_t;
+
+    // first bytes of the value log file, entries start at the page after it
+    struct ValueLogHeader
+    {
+        static constexpr char valueLogMagic[8] = {'D', 'B', '3', '6', 'V', 'L', 'O', 'G'};
+
+        char magic[8];
+        uint64_t keyLength;
+        uint64_t valueLength;
+        uint64_t tail;              // entries before this offset are collected, their pages are punched out
+        uint64_t garbageBytes;      // entries no slot points at any more, exact only if the log was closed cleanly
+    };
+
+    // values longer than the threshold, appended as entries of the value length, the key and the value;
+    // the slot keeps the value length followed by the value itself or the offset of its entry,
+    // so the slots stay small whatever the largest value is
+    class BlobValueLog
+    {
+        public:
+            // what collection did with the entry it visited
+            enum class EntryState
+            {
+                Dead,       // no slot points at the entry, it is dropped
+                Moved,      // entry was appended again and its slot points at the copy
+                Failed      // slot couldn't be read or written, collection stops at the entry
+            };
+            // gets the key and the value of the entry at the offset, tells whether its slot still points at it
+            using Relocate = std::function<EntryState(const Byte* key, const uint64_t& offset, std::span<const Byte> value)>;
+
+            // value length stored in front of every slot value
+            static constexpr uint64_t slotHeaderLength = sizeof(uint32_t);
+            static constexpr uint64_t headerLength = 4096;
+
+            // bytes of the slot value: the header and the inline value or the entry offset, whichever is longer
+            static uint64_t SlotLength(const uint64_t& threshold)
+            {
+                return slotHeaderLength + std::max<uint64_t>(threshold, sizeof(uint64_t));
+            }
+        private:
+            // entry header is the value length, the key and the value follow it
+            static constexpr uint64_t entryHeaderLength = sizeof(uint32_t);
+            // entry headers of the skips collection and failed appends leave, the offset of the entry to go on with follows them
+            static constexpr uint32_t skipMarker = UINT32_MAX;
+            static constexpr uint32_t failedMarker = UINT32_MAX - 1;
+            static constexpr uint64_t skipLength = entryHeaderLength + sizeof(uint64_t);
+
+            const std::string logPath;
+            uint64_t keyLength;
+            uint64_t valueLength;
+            uint64_t threshold;
+            std::unique_ptr<FILE, decltype(&fclose)> file;
+            std::atomic<uint64_t> head = headerLength;  // next entry is appended here
+            std::atomic<uint64_t> tail = headerLength;  // oldest entry collection hasn't visited
+            std::atomic<uint64_t> garbageBytes = 0;
+            std::unique_ptr<Byte[]> entryBuffer;        // entry read by collection, the largest one fits
+            std::mutex gapsMutex;
+            std::map<uint64_t, uint64_t> gaps;          // offsets and lengths of the failed appends without a skip
+
+            bool WriteHeader() noexcept;
+            uint64_t EntryLength(const uint64_t& valueLen) const noexcept
+            {
+                return entryHeaderLength + keyLength + valueLen;
+            }
+        public:
+            // starts an empty log or opens the one left next to the blob, throws if it doesn't match the lengths
+            BlobValueLog(const std::string& path, const uint64_t& keyLength, const uint64_t& valueLength, const uint64_t& threshold,
+                         const bool& isOpened);
+            BlobValueLog(const BlobValueLog&) = delete;
+            BlobValueLog& operator= (const BlobValueLog&) = delete;
+            // saves the tail and the garbage count
+            ~BlobValueLog();
+            // fill the slot value of the value, appending the value to the log if it is longer than the threshold
+            bool Write(const Byte* key, std::span<const Byte> value, Byte* slotValue) noexcept;
+            // copy the value of the slot value into valueLength bytes, zeros past its length; length of the value goes to valueLen
+            bool Read(const Byte* slotValue, Byte* value, uint64_t& valueLen) const noexcept;
+            // whether the slot value points at the entry at the offset
+            bool PointsAt(const Byte* slotValue, const uint64_t& offset) const noexcept;
+            // slot value was overwritten or deleted, so its entry is garbage now
+            void Release(const Byte* slotValue) noexcept;
+            // visit the oldest entries up to maxBytes, the relocation keeps the live ones and syncSlots puts the slots
+            // it wrote on the disk; visited entries are dropped from the file, returns the bytes dropped
+            uint64_t Collect(const uint64_t& maxBytes, const Relocate& relocate, const std::function<bool()>& syncSlots) noexcept;
+            // put the entries and the header on the disk
+            bool Sync() noexcept;
+            // bytes of the entries not collected yet, live or not
+            uint64_t Bytes() const
+            {
+                return head - tail;
+            }
+            uint64_t GarbageBytes() const
+            {
+                return garbageBytes;
+            }
+    };
+}
@@ -0,0 +1,116 @@
+#include "blob_versions.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace DB36_NS
+{
+
+BlobVersions::BlobVersions(const std::string& path, const bool& isWriter)
+{
+    const auto length = sizeof(VersionsHeader) + countersCount * sizeof(uint64_t);
+    // the file is never truncated, readers of the previous writer keep a valid mapping
+    const int fd = open(path.c_str(), isWriter ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if (fd < 0 && !isWriter && errno == ENOENT)
+        throw std::logic_error("Blob versions are not written by a writer: " + path);
+    if (fd < 0)
+        throw std::runtime_error(std::string("Failed to open blob versions: ") + std::strerror(errno));
+    struct stat fileStat {};
+    if (fstat(fd, &fileStat) != 0 || (isWriter && uint64_t(fileStat.st_size) < length && ftruncate(fd, length) != 0))
+    {
+        close(fd);
+        throw std::runtime_error(std::string("Failed to size blob versions: ") + std::strerror(errno));
+    }
+    if (!isWriter && uint64_t(fileStat.st_size) < length)
+    {
+        close(fd);
+        throw std::logic_error("Blob versions are not written by a writer: " + path);
+    }
+    void* data = mmap(nullptr, length, isWriter ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        throw std::runtime_error(std::string("Failed to map blob versions: ") + std::strerror(errno));
+    mapping.reset(static_cast<Byte*>(data));
+
+    auto header = reinterpret_cast<VersionsHeader*>(mapping.get());
+    if (!isWriter)
+    {
+        if (std::memcmp(header->magic, VersionsHeader::versionsMagic, sizeof(header->magic)) != 0
+            || header->countersCount != countersCount)
+            throw std::logic_error("Blob versions are not written by a writer: " + path);
+        return;
+    }
+    // writes and compaction a crashed writer left in progress would keep the readers retrying forever
+    for (uint64_t counter = 0; counter < countersCount; ++counter)
+    {
+        auto version = Counter(counter);
+        const auto value = version.load(std::memory_order_relaxed);
+        if ((value & writersMask) != 0)
+            version.store((value & ~writersMask) + versionStep, std::memory_order_release);
+    }
+    const auto epoch = Epoch(std::memory_order_relaxed);
+    if (epoch % 2 != 0)
+        SetEpoch(epoch + 1, std::memory_order_release);
+    header->countersCount = countersCount;
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(header->magic, VersionsHeader::versionsMagic, sizeof(header->magic));
+}
+
+void BlobVersions::BeginWrite(const uint64_t& address, const uint64_t& len) noexcept
+{
+    const auto lastPage = (address + std::max<uint64_t>(len, 1) - 1) / pageLength;
+    for (auto page = address / pageLength; page <= lastPage && page - address / pageLength < countersCount; ++page)
+        Counter(page).fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void BlobVersions::EndWrite(const uint64_t& address, const uint64_t& len) noexcept
+{
+    const auto lastPage = (address + std::max<uint64_t>(len, 1) - 1) / pageLength;
+    for (auto page = address / pageLength; page <= lastPage && page - address / pageLength < countersCount; ++page)
+        Counter(page).fetch_add(versionStep - 1, std::memory_order_release);
+}
+
+bool BlobVersions::LoadCounters(const uint64_t& firstPage, const uint64_t& count, uint64_t* versions) const noexcept
+{
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        versions[i] = Counter(firstPage + i).load(std::memory_order_acquire);
+        if ((versions[i] & writersMask) != 0)
+            return false;
+    }
+    return true;
+}
+
+void BlobVersions::Read(const Byte* records, const uint64_t& address, Byte* data, const uint64_t& len) const noexcept
+{
+    const auto firstPage = address / pageLength;
+    // pages past the counters count share them with the first ones, which are checked already
+    const auto count = std::min((address + std::max<uint64_t>(len, 1) - 1) / pageLength - firstPage + 1, countersCount);
+    uint64_t inlineVersions[inlinePages];
+    std::vector<uint64_t> heapVersions(count > inlinePages ? count : 0);
+    const auto versions = count > inlinePages ? heapVersions.data() : inlineVersions;
+    for (;;)
+    {
+        if (LoadCounters(firstPage, count, versions))
+        {
+            std::memcpy(data, records, len);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            uint64_t i = 0;
+            while (i < count && Counter(firstPage + i).load(std::memory_order_relaxed) == versions[i])
+                ++i;
+            if (i == count)
+                return;
+        }
+        std::this_thread::yield();
+    }
+}
+}
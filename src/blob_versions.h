@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <sys/mman.h>
+
+namespace DB36_NS
+{
+
+    using Byte = uint8_t;
+
+    // version counters of the record pages and the compaction epoch, kept in a file next to the blob
+    // that the writer process and every reader process map; a counter holds the writes in progress
+    // in its low half and the writes done in its high half, so concurrent writers of a page never
+    // make it look idle, and a reader copies the records out and takes them only if no counter of their pages moved
+    class BlobVersions
+    {
+        public:
+            // pages share the counters modulo this
+            static constexpr uint64_t countersCount = 1 << 16;
+            // record pages a counter covers
+            static constexpr uint64_t pageLength = 4096;
+        private:
+            static constexpr uint64_t writersMask = 0xFFFFFFFF;
+            static constexpr uint64_t versionStep = uint64_t(1) << 32;
+            // records copied by a read check this many counters without allocating
+            static constexpr uint64_t inlinePages = 64;
+
+            // first bytes of the file, the counters follow it
+            struct VersionsHeader
+            {
+                static constexpr char versionsMagic[8] = {'D', 'B', '3', '6', 'V', 'E', 'R', 'S'};
+
+                char magic[8];
+                uint64_t countersCount;
+                uint64_t epoch;     // compaction epoch of the writer, odd while it moves records
+                uint64_t padding[5];
+            };
+            struct UnmapDeleter
+            {
+                void operator()(Byte* data) const
+                {
+                    munmap(data, sizeof(VersionsHeader) + countersCount * sizeof(uint64_t));
+                }
+            };
+
+            std::unique_ptr<Byte, UnmapDeleter> mapping;
+
+            std::atomic_ref<uint64_t> Counter(const uint64_t& page) const noexcept
+            {
+                return std::atomic_ref<uint64_t>(reinterpret_cast<uint64_t*>(mapping.get() + sizeof(VersionsHeader))[page % countersCount]);
+            }
+            std::atomic_ref<uint64_t> EpochCounter() const noexcept
+            {
+                return std::atomic_ref<uint64_t>(reinterpret_cast<VersionsHeader*>(mapping.get())->epoch);
+            }
+            // read the counters of the pages into versions, false if a write to one of them is in progress
+            bool LoadCounters(const uint64_t& firstPage, const uint64_t& count, uint64_t* versions) const noexcept;
+        public:
+            // writer creates the file or takes over the one a previous writer left, clearing the writes a crash
+            // left in progress; readers map it read only and throw if there is none
+            BlobVersions(const std::string& path, const bool& isWriter);
+            BlobVersions(const BlobVersions&) = delete;
+            BlobVersions& operator= (const BlobVersions&) = delete;
+            // writer brackets every change of the records, so readers of the pages retry meanwhile
+            void BeginWrite(const uint64_t& address, const uint64_t& len) noexcept;
+            void EndWrite(const uint64_t& address, const uint64_t& len) noexcept;
+            // copy len bytes of the records at the address from the mapped records, retried until no write overlapped the copy
+            void Read(const Byte* records, const uint64_t& address, Byte* data, const uint64_t& len) const noexcept;
+            uint64_t Epoch(const std::memory_order& order) const noexcept
+            {
+                return EpochCounter().load(order);
+            }
+            void SetEpoch(const uint64_t& epoch, const std::memory_order& order) noexcept
+            {
+                EpochCounter().store(epoch, order);
+            }
+    };
+
+    // write of the records between BeginWrite and EndWrite, nothing if the blob has no readers
+    class BlobVersionsWrite
+    {
+        private:
+            BlobVersions* versions;
+            uint64_t address;
+            uint64_t len;
+        public:
+            BlobVersionsWrite(BlobVersions* versions, const uint64_t& address, const uint64_t& len) noexcept :
+                versions(versions),
+                address(address),
+                len(len)
+            {
+                if (versions)
+                    versions->BeginWrite(address, len);
+            }
+            BlobVersionsWrite(const BlobVersionsWrite&) = delete;
+            BlobVersionsWrite& operator= (const BlobVersionsWrite&) = delete;
+            ~BlobVersionsWrite()
+            {
+                if (versions)
+                    versions->EndWrite(address, len);
+            }
+    };
+}
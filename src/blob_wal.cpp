@@ -0,0 +1,165 @@
+#include "blob_wal.h"
+#include "blob.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include <unistd.h>
+
+namespace DB36_NS
+{
+
+namespace
+{
+uint64_t ChecksumOf(const Byte* entry, const uint64_t& length) noexcept
+{
+    return HashKey(entry, length);
+}
+}
+
+BlobWal::BlobWal(const std::string& path, const uint64_t& keyLength, const uint64_t& valueLength,
+                 const std::chrono::milliseconds& syncInterval) :
+    walPath(path),
+    keyLength(keyLength),
+    valueLength(valueLength),
+    file(fopen(walPath.c_str(), "w+"), &fclose)
+{
+    if (!file || !WriteHeader() || fdatasync(fileno(file.get())) != 0)
+        throw std::runtime_error(std::string("Failed to create blob log: ") + std::strerror(errno));
+    if (syncInterval.count() == 0)
+        return;
+    syncThread = std::thread([this, syncInterval]()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!isStopped)
+        {
+            synced.wait_for(lock, syncInterval);
+            const auto lsn = nextLsn - 1;
+            lock.unlock();
+            Sync(lsn);
+            lock.lock();
+        }
+    });
+}
+
+BlobWal::~BlobWal()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        isStopped = true;
+    }
+    synced.notify_all();
+    if (syncThread.joinable())
+        syncThread.join();
+}
+
+bool BlobWal::WriteHeader()
+{
+    WalHeader header {};
+    std::memcpy(header.magic, WalHeader::walMagic, sizeof(header.magic));
+    header.keyLength = keyLength;
+    header.valueLength = valueLength;
+    return pwrite(fileno(file.get()), &header, sizeof(header), 0) == ssize_t(sizeof(header));
+}
+
+uint64_t BlobWal::Append(const WalOperation& operation, const Byte* key, const Byte* value, const uint64_t& valueLen)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    WalEntry entry {nextLsn, uint32_t(operation), uint32_t(valueLen), 0};
+    const auto start = buffer.size();
+    buffer.resize(start + sizeof(entry) + keyLength + valueLen);
+    const auto data = buffer.data() + start;
+    std::memcpy(data, &entry, sizeof(entry));
+    std::memcpy(data + sizeof(entry), key, keyLength);
+    std::memcpy(data + sizeof(entry) + keyLength, value, valueLen);
+    entry.checksum = ChecksumOf(data, sizeof(entry) + keyLength + valueLen);
+    std::memcpy(data, &entry, sizeof(entry));
+    entriesBytes.fetch_add(sizeof(entry) + keyLength + valueLen, std::memory_order_relaxed);
+    return nextLsn++;
+}
+
+bool BlobWal::Sync(const uint64_t& lsn)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (durableLsn < lsn)
+    {
+        // entries of a failed write are lost and the ones after them would be replayed past a torn entry,
+        // so nothing past the durable lsn can be on the disk until the log is reset
+        if (isFailed)
+            return false;
+        if (isSyncing)
+        {
+            synced.wait(lock);
+            continue;
+        }
+        // this thread syncs for all the threads that appended so far
+        isSyncing = true;
+        writeBuffer.swap(buffer);
+        buffer.clear();
+        const auto lastLsn = nextLsn - 1;
+        lock.unlock();
+        const auto fd = fileno(file.get());
+        const auto end = lseek(fd, 0, SEEK_END);
+        const bool isSynced = end >= 0
+            && pwrite(fd, writeBuffer.data(), writeBuffer.size(), end) == ssize_t(writeBuffer.size())
+            && fdatasync(fd) == 0;
+        lock.lock();
+        isSyncing = false;
+        if (isSynced)
+            durableLsn = lastLsn;
+        isFailed = !isSynced;
+        synced.notify_all();
+        if (!isSynced)
+            return false;
+    }
+    return true;
+}
+
+bool BlobWal::Reset()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    synced.wait(lock, [this]() { return !isSyncing; });
+    buffer.clear();
+    durableLsn = nextLsn - 1;
+    isFailed = false;
+    entriesBytes.store(0, std::memory_order_relaxed);
+    const auto fd = fileno(file.get());
+    return ftruncate(fd, 0) == 0 && WriteHeader() && fdatasync(fd) == 0;
+}
+
+bool BlobWal::Replay(const std::string& path, const uint64_t& keyLength, const uint64_t& valueLength,
+                     const std::function<void(const WalOperation&, const Byte*, const Byte*, const uint64_t&)>& function)
+{
+    std::unique_ptr<FILE, decltype(&fclose)> walFile(fopen(path.c_str(), "r"), &fclose);
+    if (!walFile)
+        return true;
+    // Reset truncates the log before it writes the header again, a crash between the two leaves no header or zeros
+    WalHeader header {};
+    const WalHeader noHeader {};
+    if (fread(&header, sizeof(header), 1, walFile.get()) != 1 || std::memcmp(&header, &noHeader, sizeof(header)) == 0)
+        return true;
+    if (std::memcmp(header.magic, WalHeader::walMagic, sizeof(header.magic)) != 0
+        || header.keyLength != keyLength || header.valueLength != valueLength)
+        return false;
+
+    std::vector<Byte> data(sizeof(WalEntry) + keyLength + valueLength);
+    uint64_t lastLsn = 0;
+    for (;;)
+    {
+        WalEntry entry {};
+        if (fread(&entry, sizeof(entry), 1, walFile.get()) != 1 || entry.valueLength > valueLength || entry.lsn <= lastLsn)
+            return true;
+        const auto length = keyLength + entry.valueLength;
+        if (fread(data.data() + sizeof(entry), 1, length, walFile.get()) != length)
+            return true;
+        const auto checksum = entry.checksum;
+        entry.checksum = 0;
+        std::memcpy(data.data(), &entry, sizeof(entry));
+        if (ChecksumOf(data.data(), sizeof(entry) + length) != checksum)
+            return true;
+        lastLsn = entry.lsn;
+        const auto key = data.data() + sizeof(entry);
+        function(WalOperation(entry.operation), key, key + keyLength, entry.valueLength);
+    }
+}
+}
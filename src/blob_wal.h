@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace DB36_NS
+{
+
+    using Byte = uint8_t;
+
+    // what the logged entry does to the key
+    enum class WalOperation : uint32_t
+    {
+        Set = 1,
+        Delete = 2
+    };
+
+    // first bytes of the log file, entries follow it
+    struct WalHeader
+    {
+        static constexpr char walMagic[8] = {'D', 'B', '3', '6', 'W', 'L', 'O', 'G'};
+
+        char magic[8];
+        uint64_t keyLength;
+        uint64_t valueLength;
+    };
+
+    // entry header, followed by the key and valueLength bytes of the value;
+    // checksum covers the whole entry, so the entry torn by a crash ends the replay
+    struct WalEntry
+    {
+        uint64_t lsn;
+        uint32_t operation;
+        uint32_t valueLength;
+        uint64_t checksum;
+    };
+
+    // write-ahead log of the blob updates; entries are buffered in memory and written by the thread
+    // that syncs them, so the threads waiting at the same time share one write and one fdatasync
+    class BlobWal
+    {
+        private:
+            const std::string walPath;
+            uint64_t keyLength;
+            uint64_t valueLength;
+            std::unique_ptr<FILE, decltype(&fclose)> file;
+            std::mutex mutex;
+            std::condition_variable synced;
+            std::vector<Byte> buffer;       // entries appended since the last write
+            std::vector<Byte> writeBuffer;  // entries being written, kept to reuse its memory
+            uint64_t nextLsn = 1;
+            uint64_t durableLsn = 0;        // entries up to this one are on the disk
+            std::atomic<uint64_t> entriesBytes = 0; // appended since the last reset
+            bool isSyncing = false;         // some thread writes and syncs the entries, the others wait for it
+            bool isFailed = false;          // a write or a sync failed, no entry is durable past durableLsn until Reset
+            bool isStopped = false;
+            std::thread syncThread;         // syncs the log every interval if the blob asked for it
+
+            // write the log header to the empty file
+            bool WriteHeader();
+        public:
+            // starts an empty log, syncInterval of zero means entries are synced only by Sync
+            BlobWal(const std::string& path, const uint64_t& keyLength, const uint64_t& valueLength,
+                    const std::chrono::milliseconds& syncInterval);
+            BlobWal(const BlobWal&) = delete;
+            BlobWal& operator= (const BlobWal&) = delete;
+            ~BlobWal();
+            // buffer the entry, returns its lsn
+            uint64_t Append(const WalOperation& operation, const Byte* key, const Byte* value, const uint64_t& valueLen);
+            // wait until the entries up to the lsn are on the disk, syncing them if no other thread does;
+            // false for every lsn past the durable ones once a write failed, until Reset
+            bool Sync(const uint64_t& lsn);
+            // drop all entries, the blob has them on the disk already, and clear a failed write
+            bool Reset();
+            // bytes of the entries appended since the last reset, which a crash would replay
+            uint64_t Length() const noexcept
+            {
+                return entriesBytes.load(std::memory_order_relaxed);
+            }
+            // call the function for every whole entry of the log file in lsn order, false if the file is not a log of these lengths;
+            // missing file and a file without its header have nothing to replay
+            static bool Replay(const std::string& path, const uint64_t& keyLength, const uint64_t& valueLength,
+                               const std::function<void(const WalOperation&, const Byte*, const Byte*, const uint64_t&)>& function);
+    };
+}
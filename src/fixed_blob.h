@@ -0,0 +1,301 @@
+#pragma once
+
+#include "blob.h"
+
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <span>
+#include <stdexcept>
+#include <string>
+
+#include <sys/stat.h>
+
+namespace DB36_NS
+{
+
+    // blob with the lengths and the capacity known at compile time, it reads and writes the files of Blob;
+    // records are accessed in place through the mapping by one thread, so every key compare and copy has a constant length
+    template <uint64_t KeyLength, uint64_t ValueLength, uint8_t Capacity>
+    class FixedBlob
+    {
+        static_assert(KeyLength > 0 && ValueLength > 0, "keys and values can't be empty");
+        static_assert(Capacity != 0 || KeyLength <= 4, "direct addressed blob has a slot for every key, so its keys have to be short");
+        static_assert(Capacity < 64, "slot number is taken from 64 key bits");
+
+        public:
+            static constexpr uint64_t recordLength = Capacity != 0 ? KeyLength + ValueLength : ValueLength;
+            static constexpr uint64_t recordsCount = uint64_t(1) << (Capacity != 0 ? Capacity : KeyLength * 8);
+            static constexpr uint64_t capacitySize = recordLength * recordsCount;
+        private:
+            // same layout as Blob: header page, then the records; slot is the high bits of the last 8 key bytes
+            static constexpr uint64_t headerLength = 4096;
+            static constexpr uint64_t addressBits = std::min<uint64_t>(KeyLength, sizeof(uint64_t)) * 8;
+            static constexpr uint16_t shift = Capacity != 0 && addressBits > Capacity ? addressBits - Capacity : 0;
+            static constexpr std::array<Byte, KeyLength> zeroKey {};
+            static constexpr std::array<Byte, KeyLength> tombstoneKey = []()
+            {
+                std::array<Byte, KeyLength> key {};
+                key.fill(0xFF);
+                return key;
+            }();
+            static constexpr uint64_t noSlot = recordsCount;
+
+            const std::string blobPath;
+            std::unique_ptr<FILE, decltype(&fclose)> file;
+            std::unique_ptr<Byte, MappingDeleter> mapping;
+            uint64_t storedRecords = 0;
+            uint64_t tombstoneRecords = 0;
+            uint64_t zeroKeySlot = 0;       // slot of the all zeros key plus one, set by Blob with fingerprints
+
+            static bool KeyEquals(const Byte* key1, const Byte* key2) noexcept
+            {
+                if constexpr (KeyLength == sizeof(uint64_t))
+                {
+                    uint64_t word1 = 0;
+                    uint64_t word2 = 0;
+                    std::memcpy(&word1, key1, sizeof(uint64_t));
+                    std::memcpy(&word2, key2, sizeof(uint64_t));
+                    return word1 == word2;
+                }
+                else
+                    return std::memcmp(key1, key2, KeyLength) == 0;
+            }
+            static uint64_t SlotOf(const Byte* key) noexcept
+            {
+                uint64_t word = 0;
+                if constexpr (KeyLength > sizeof(uint64_t))
+                    std::memcpy(&word, key + (KeyLength - sizeof(uint64_t)), sizeof(uint64_t));
+                else
+                    std::memcpy(&word, key, KeyLength);
+                return word >> shift;
+            }
+            Byte* RecordAt(const uint64_t& slot) const noexcept
+            {
+                return mapping.get() + headerLength + slot * recordLength;
+            }
+            // slot of the key or noSlot, tombstone gets the first tombstone passed before the first empty slot
+            uint64_t FindSlot(const Byte* key, uint64_t& emptySlot, uint64_t& tombstone) const noexcept
+            {
+                emptySlot = noSlot;
+                tombstone = noSlot;
+                auto slot = SlotOf(key);
+                for (uint64_t probed = 0; probed < recordsCount; ++probed, slot = (slot + 1) & (recordsCount - 1))
+                {
+                    const Byte* stored = RecordAt(slot);
+                    // all zeros key matches an empty slot, same as in Blob
+                    if (KeyEquals(stored, key))
+                        return slot;
+                    if (KeyEquals(stored, zeroKey.data()))
+                    {
+                        emptySlot = slot;
+                        return noSlot;
+                    }
+                    if (tombstone == noSlot && KeyEquals(stored, tombstoneKey.data()))
+                        tombstone = slot;
+                }
+                return noSlot;
+            }
+            bool WriteHeader(const bool& isClosed) const noexcept
+            {
+                BlobHeader header {};
+                std::memcpy(header.magic, BlobHeader::blobMagic, sizeof(header.magic));
+                header.version = BlobHeader::blobVersion;
+                header.isClosed = isClosed;
+                header.keyLength = KeyLength;
+                header.valueLength = ValueLength;
+                header.capacity = Capacity;
+                header.shift = shift;
+                header.storedRecords = storedRecords;
+                header.zeroKeySlot = zeroKeySlot;
+                header.tombstoneRecords = tombstoneRecords;
+                return pwrite(fileno(file.get()), &header, sizeof(header), 0) == ssize_t(sizeof(header));
+            }
+            void MapBlobFile()
+            {
+                void* data = mmap(nullptr, headerLength + capacitySize, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(file.get()), 0);
+                if (data == MAP_FAILED)
+                    throw std::runtime_error(std::string("Failed to map blob file: ") + std::strerror(errno));
+                mapping = std::unique_ptr<Byte, MappingDeleter>(static_cast<Byte*>(data), MappingDeleter{headerLength + capacitySize});
+            }
+            void CreateBlobFile()
+            {
+                const auto fd = fileno(file.get());
+                if (ftruncate(fd, headerLength + capacitySize) != 0)
+                    throw std::runtime_error(std::string("Failed to size blob file: ") + std::strerror(errno));
+                if constexpr (Capacity != 0)
+                    posix_fallocate(fd, 0, headerLength + capacitySize);
+                MapBlobFile();
+            }
+            void OpenBlobFile()
+            {
+                BlobHeader header {};
+                struct stat fileStat {};
+                const auto fd = fileno(file.get());
+                if (pread(fd, &header, sizeof(header), 0) != ssize_t(sizeof(header))
+                    || std::memcmp(header.magic, BlobHeader::blobMagic, sizeof(header.magic)) != 0
+                    || header.version == 0 || header.version > BlobHeader::blobVersion)
+                    throw std::logic_error("File is not a blob: " + blobPath);
+                if (header.keyLength != KeyLength || header.valueLength != ValueLength
+                    || header.capacity != Capacity || header.shift != shift || header.valueLogThreshold != 0
+                    || header.keyHash != 0 || header.sparse != 0)
+                    throw std::logic_error("Blob header doesn't match the blob parameters: " + blobPath);
+                if (fstat(fd, &fileStat) != 0 || uint64_t(fileStat.st_size) < headerLength + capacitySize)
+                    throw std::logic_error("Blob file is shorter than its header says: " + blobPath);
+                // entries of the log are replayed only by Blob
+                std::error_code error;
+                if (std::filesystem::exists(blobPath + ".wal", error) && std::filesystem::file_size(blobPath + ".wal", error) > sizeof(WalHeader))
+                    throw std::logic_error("Blob has a log to replay, open it with Blob first: " + blobPath);
+
+                MapBlobFile();
+                storedRecords = header.storedRecords;
+                tombstoneRecords = header.version < 2 ? 0 : header.tombstoneRecords;
+                zeroKeySlot = header.zeroKeySlot;
+                if (Capacity != 0 && !header.isClosed)
+                    CountStoredRecords();
+            }
+            void CountStoredRecords() noexcept
+            {
+                storedRecords = 0;
+                tombstoneRecords = 0;
+                for (uint64_t slot = 0; slot < recordsCount; ++slot)
+                {
+                    const Byte* stored = RecordAt(slot);
+                    if (KeyEquals(stored, tombstoneKey.data()))
+                        ++tombstoneRecords;
+                    else if (!KeyEquals(stored, zeroKey.data()) || slot + 1 == zeroKeySlot)
+                        ++storedRecords;
+                }
+            }
+        public:
+            FixedBlob(const std::string& path, const BlobOpenMode& openMode = BlobOpenMode::Create) :
+                blobPath(path),
+                file(openMode == BlobOpenMode::ReadShared ? nullptr
+                     : fopen(blobPath.c_str(), openMode == BlobOpenMode::Open ? "r+" : "w+"), &fclose)
+                {
+                    if (openMode == BlobOpenMode::ReadShared)
+                        throw(std::logic_error("Fixed blob has no reader processes"));
+                    if (!file.get())
+                    {
+                        std::cerr << "File creation failed: " << std::strerror(errno) << '\n';
+                        throw(std::logic_error("Failed to initialize blob"));
+                    }
+                    if (openMode == BlobOpenMode::Open)
+                        OpenBlobFile();
+                    else
+                        CreateBlobFile();
+                    if (!WriteHeader(false))
+                        throw std::runtime_error(std::string("Failed to write blob header: ") + std::strerror(errno));
+                    // Blob rebuilds its filter from the records, the saved one misses the keys set here
+                    std::error_code error;
+                    std::filesystem::remove(blobPath + ".bloom", error);
+                }
+            FixedBlob() = delete;
+            FixedBlob(const FixedBlob&) = delete;
+            FixedBlob& operator= (const FixedBlob&) = delete;
+            FixedBlob(FixedBlob&&) = default;
+            ~FixedBlob()
+            {
+                if (file)
+                    WriteHeader(true);
+            }
+            BlobStatus Set(std::span<const Byte, KeyLength> key, std::span<const Byte, ValueLength> value) noexcept
+            {
+                if constexpr (Capacity == 0)
+                {
+                    std::memcpy(RecordAt(SlotOf(key.data())), value.data(), ValueLength);
+                    return BlobStatus::Ok;
+                }
+                else
+                {
+                    if (KeyEquals(key.data(), tombstoneKey.data()))
+                        return BlobStatus::InvalidLength;
+                    uint64_t emptySlot = noSlot;
+                    uint64_t tombstone = noSlot;
+                    auto slot = FindSlot(key.data(), emptySlot, tombstone);
+                    if (slot == noSlot)
+                    {
+                        // new key takes the first tombstone of its chain, same as in Blob
+                        slot = tombstone != noSlot ? tombstone : emptySlot;
+                        if (slot == noSlot)
+                            return BlobStatus::NoSpace;
+                        tombstoneRecords -= slot == tombstone;
+                        ++storedRecords;
+                    }
+                    std::memcpy(RecordAt(slot), key.data(), KeyLength);
+                    std::memcpy(RecordAt(slot) + KeyLength, value.data(), ValueLength);
+                    return BlobStatus::Ok;
+                }
+            }
+            BlobStatus Get(std::span<const Byte, KeyLength> key, std::span<Byte, ValueLength> value) const noexcept
+            {
+                if constexpr (Capacity == 0)
+                {
+                    std::memcpy(value.data(), RecordAt(SlotOf(key.data())), ValueLength);
+                    return BlobStatus::Ok;
+                }
+                else
+                {
+                    if (KeyEquals(key.data(), tombstoneKey.data()))
+                        return BlobStatus::NotFound;
+                    uint64_t emptySlot = noSlot;
+                    uint64_t tombstone = noSlot;
+                    const auto slot = FindSlot(key.data(), emptySlot, tombstone);
+                    if (slot == noSlot)
+                        return BlobStatus::NotFound;
+                    std::memcpy(value.data(), RecordAt(slot) + KeyLength, ValueLength);
+                    return BlobStatus::Ok;
+                }
+            }
+            BlobStatus Delete(std::span<const Byte, KeyLength> key) noexcept
+            {
+                if constexpr (Capacity == 0)
+                {
+                    std::memset(RecordAt(SlotOf(key.data())), 0, ValueLength);
+                    return BlobStatus::Ok;
+                }
+                else
+                {
+                    if (KeyEquals(key.data(), tombstoneKey.data()))
+                        return BlobStatus::NotFound;
+                    uint64_t emptySlot = noSlot;
+                    uint64_t tombstone = noSlot;
+                    const auto slot = FindSlot(key.data(), emptySlot, tombstone);
+                    if (slot == noSlot)
+                        return BlobStatus::NotFound;
+                    // all zeros key is the empty slot it matched, only its value can be cleared
+                    if (KeyEquals(key.data(), zeroKey.data()) && slot + 1 != zeroKeySlot)
+                    {
+                        std::memset(RecordAt(slot) + KeyLength, 0, ValueLength);
+                        return BlobStatus::Ok;
+                    }
+                    std::memcpy(RecordAt(slot), tombstoneKey.data(), KeyLength);
+                    --storedRecords;
+                    ++tombstoneRecords;
+                    if (slot + 1 == zeroKeySlot)
+                    {
+                        zeroKeySlot = 0;
+                        WriteHeader(false);
+                    }
+                    return BlobStatus::Ok;
+                }
+            }
+        public:
+            static constexpr int64_t RecordsCount()
+            {
+                return recordsCount;
+            }
+            static constexpr int64_t CapacitySize()
+            {
+                return capacitySize;
+            }
+            int64_t StoredCount() const
+            {
+                return storedRecords;
+            }
+            int64_t TombstoneCount() const
+            {
+                return tombstoneRecords;
+            }
+    };
+}
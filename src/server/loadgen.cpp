@@ -0,0 +1,170 @@
+#include "../blob_client.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using DB36_NS::BlobClient;
+using DB36_NS::BlobOpcode;
+using DB36_NS::Byte;
+
+// latencies of the requests of every connection and the requests that weren't answered with Ok
+struct PhaseResult
+{
+    std::vector<uint64_t> latencies;
+    uint64_t errors = 0;
+};
+
+// key of the record index, spread over the key bytes; all zeros and all 0xFF keys are reserved by the blob
+void KeyOf(const uint64_t& index, Byte* key, const uint64_t& keyLength)
+{
+    const uint64_t mixed = (index + 1) * 0x9E3779B97F4A7C15;
+    std::memset(key, 0, keyLength);
+    std::memcpy(key, &mixed, std::min<uint64_t>(sizeof(mixed), keyLength));
+    if (std::all_of(key, key + keyLength, [](const Byte b) { return b == 0; })
+        || std::all_of(key, key + keyLength, [](const Byte b) { return b == 0xFF; }))
+        key[0] = 1;
+}
+
+// send count requests over a new connection keeping depth of them in flight; a request is timed from its Send to its
+// response, which arrive in the order of the requests
+PhaseResult RunConnection(const std::string& socketPath, const uint64_t& depth, const uint64_t& count,
+                          const std::function<void(BlobClient&, const uint64_t&)>& sendRequest)
+{
+    using namespace std::chrono;
+
+    BlobClient client(socketPath);
+    PhaseResult result;
+    result.latencies.reserve(count);
+    std::vector<steady_clock::time_point> sendTimes(depth);
+    uint64_t sent = 0;
+    uint64_t received = 0;
+    BlobClient::Response response {};
+    while (received < count)
+    {
+        for (; sent < count && sent - received < depth; ++sent)
+        {
+            sendTimes[sent % depth] = steady_clock::now();
+            sendRequest(client, sent);
+        }
+        if (!client.Flush() || !client.Receive(response))
+            throw std::runtime_error("Server closed the connection");
+        // responses that came with the first one are taken without waiting
+        do
+        {
+            result.latencies.push_back(duration_cast<nanoseconds>(steady_clock::now() - sendTimes[received % depth]).count());
+            result.errors += response.header.status != 0;
+            ++received;
+        } while (received < sent && client.TryReceive(response));
+    }
+    return result;
+}
+
+// run the phase on every connection at once and print its throughput and latency percentiles
+void RunPhase(const std::string& name, const std::string& socketPath, const uint64_t& connections, const uint64_t& depth,
+              const uint64_t& opsCount, const std::function<void(BlobClient&, const uint64_t&, const uint64_t&)>& sendRequest)
+{
+    using namespace std::chrono;
+
+    std::vector<PhaseResult> results(connections);
+    std::vector<std::thread> threads;
+    const auto start = steady_clock::now();
+    for (uint64_t c = 0; c < connections; ++c)
+    {
+        // connections split the operations, the first ones take the remainder
+        const auto count = opsCount / connections + (c < opsCount % connections ? 1 : 0);
+        threads.emplace_back([&, c, count]()
+        {
+            results[c] = RunConnection(socketPath, depth, count,
+                [&, c](BlobClient& client, const uint64_t& i) { sendRequest(client, c, i * connections + c); });
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    const auto seconds = duration<double>(steady_clock::now() - start).count();
+
+    std::vector<uint64_t> latencies;
+    uint64_t errors = 0;
+    for (const auto& result : results)
+    {
+        latencies.insert(latencies.end(), result.latencies.begin(), result.latencies.end());
+        errors += result.errors;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    const auto percentile = [&latencies](const double& p)
+    {
+        return latencies.empty() ? 0 : latencies[std::min<size_t>(latencies.size() - 1, p * latencies.size())];
+    };
+    std::cout << std::left << std::setw(10) << name << std::setw(13) << connections << std::setw(7) << depth
+              << std::setw(14) << std::fixed << std::setprecision(0) << latencies.size() / seconds << std::defaultfloat
+              << std::setw(10) << percentile(0.5) << std::setw(10) << percentile(0.99) << std::setw(10) << percentile(0.999)
+              << std::setw(12) << (latencies.empty() ? 0 : latencies.back()) << errors << '\n';
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 5)
+    {
+        std::cerr << "Usage: blob_loadgen <socketPath> <connections> <depth> <opsCount> [getPercent=90] [multiGetKeys=0] [keysCount=100000]" << '\n'
+                  << "Sets keysCount keys, then sends opsCount requests: Gets, or MultiGets of multiGetKeys keys, and Sets of those keys" << '\n';
+        return 1;
+    }
+    const std::string socketPath = argv[1];
+    const uint64_t connections = std::max<uint64_t>(1, std::stoull(argv[2]));
+    const uint64_t depth = std::max<uint64_t>(1, std::stoull(argv[3]));
+    const uint64_t opsCount = std::stoull(argv[4]);
+    const uint64_t getPercent = argc > 5 ? std::stoull(argv[5]) : 90;
+    const uint64_t multiGetKeys = argc > 6 ? std::stoull(argv[6]) : 0;
+    const uint64_t keysCount = std::max<uint64_t>(1, argc > 7 ? std::stoull(argv[7]) : 100000);
+
+    const auto [keyLength, valueLength] = BlobClient(socketPath).Lengths();
+    std::cout << "keyLength\t" << keyLength << '\n';
+    std::cout << "valueLength\t" << valueLength << '\n';
+    std::cout << "keysCount\t" << keysCount << '\n';
+    std::cout << "getPercent\t" << getPercent << '\n';
+    std::cout << "multiGetKeys\t" << multiGetKeys << '\n' << '\n';
+    std::cout << std::left << std::setw(10) << "phase" << std::setw(13) << "connections" << std::setw(7) << "depth"
+              << std::setw(14) << "requests/s" << std::setw(10) << "p50 ns" << std::setw(10) << "p99 ns"
+              << std::setw(10) << "p999 ns" << std::setw(12) << "max ns" << "errors" << '\n';
+
+    // every connection has its own buffers and generator, the value of a key is its index repeated
+    std::vector<std::vector<Byte>> keys(connections, std::vector<Byte>(keyLength * std::max<uint64_t>(1, multiGetKeys)));
+    std::vector<std::vector<Byte>> values(connections, std::vector<Byte>(valueLength));
+    std::vector<std::mt19937_64> gens;
+    for (uint64_t c = 0; c < connections; ++c)
+        gens.emplace_back(c + 36);
+    const auto sendSet = [&](BlobClient& client, const uint64_t& c, const uint64_t& index)
+    {
+        KeyOf(index, keys[c].data(), keyLength);
+        for (uint64_t offset = 0; offset < valueLength; offset += sizeof(index))
+            std::memcpy(values[c].data() + offset, &index, std::min<uint64_t>(sizeof(index), valueLength - offset));
+        client.Send(BlobOpcode::Set, std::span<const Byte>(keys[c].data(), keyLength), values[c]);
+    };
+
+    RunPhase("load", socketPath, connections, depth, keysCount, sendSet);
+    RunPhase("mixed", socketPath, connections, depth, opsCount, [&](BlobClient& client, const uint64_t& c, const uint64_t&)
+    {
+        auto& gen = gens[c];
+        if (gen() % 100 >= getPercent)
+            return sendSet(client, c, gen() % keysCount);
+        if (multiGetKeys == 0)
+        {
+            KeyOf(gen() % keysCount, keys[c].data(), keyLength);
+            client.Send(BlobOpcode::Get, std::span<const Byte>(keys[c].data(), keyLength));
+            return;
+        }
+        for (uint64_t k = 0; k < multiGetKeys; ++k)
+            KeyOf(gen() % keysCount, keys[c].data() + k * keyLength, keyLength);
+        client.Send(BlobOpcode::MultiGet, keys[c]);
+    });
+
+    return 0;
+}
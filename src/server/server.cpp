@@ -0,0 +1,55 @@
+#include "../blob.h"
+#include "../blob_server.h"
+
+#include <csignal>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+using DB36_NS::Blob;
+using DB36_NS::BlobOptions;
+using DB36_NS::BlobServer;
+using DB36_NS::BlobStorage;
+
+// server the signals stop, Stop only writes to its eventfd
+static BlobServer* runningServer = nullptr;
+
+void StopServer(int)
+{
+    if (runningServer)
+        runningServer->Stop();
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 4 && argc != 7)
+    {
+        std::cerr << "Usage: blob_server <socketPath> <blobPath> <workers> [<keyLength> <valueLength> <capacity>]" << '\n'
+                  << "Opens the blob at the path, or creates it when the lengths and the capacity are given" << '\n';
+        return 1;
+    }
+    const std::string socketPath = argv[1];
+    const std::string blobPath = argv[2];
+    const uint64_t workers = std::stoull(argv[3]);
+
+    BlobOptions options;
+    options.storage = BlobStorage::Mmap;
+    options.lockStripes = 1024;
+    auto blob = argc == 7 ? Blob(blobPath, std::stoull(argv[4]), std::stoull(argv[5]), std::stoi(argv[6]), options)
+                          : Blob::Open(blobPath, options);
+    BlobServer server(blob, socketPath, workers);
+    runningServer = &server;
+    std::signal(SIGINT, StopServer);
+    std::signal(SIGTERM, StopServer);
+
+    std::cout << "blob\t\t" << blobPath << '\n';
+    std::cout << "keyLength\t" << blob.KeyLength() << '\n';
+    std::cout << "valueLength\t" << blob.ValueLength() << '\n';
+    std::cout << "workers\t\t" << workers << '\n';
+    std::cout << "listening\t" << socketPath << std::endl;
+    server.Run();
+    runningServer = nullptr;
+    std::cout << "requests\t" << server.RequestsCount() << '\n';
+
+    return 0;
+}
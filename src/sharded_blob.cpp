@@ -0,0 +1,201 @@
+#include "sharded_blob.h"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace DB36_NS
+{
+
+void ShardWorker::Run()
+{
+    for (;;)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this]() { return isStopped || !tasks.empty(); });
+            if (tasks.empty())
+                return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+ShardWorker::~ShardWorker()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        isStopped = true;
+    }
+    condition.notify_one();
+    thread.join();
+}
+
+std::future<void> ShardWorker::Submit(std::function<void()> task)
+{
+    auto packagedTask = std::make_shared<std::packaged_task<void()>>(std::move(task));
+    auto future = packagedTask->get_future();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.emplace_back([packagedTask]() { (*packagedTask)(); });
+    }
+    condition.notify_one();
+    return future;
+}
+
+ShardedBlob::ShardedBlob(
+    const std::vector<std::string>& paths,
+    const uint64_t& keyLength,
+    const uint64_t& valueLength,
+    const uint8_t& capacity,
+    const BlobOptions& options)
+{
+    if (paths.empty())
+        throw std::logic_error("Sharded blob needs at least one shard");
+    shards.reserve(paths.size());
+    for (const auto& path : paths)
+    {
+        shards.emplace_back(path, keyLength, valueLength, capacity, options);
+        workers.push_back(std::make_unique<ShardWorker>());
+    }
+}
+
+uint64_t ShardedBlob::ShardOf(const Byte* key) const noexcept
+{
+    // cache sets, Bloom bits and fingerprints are taken from HashKey and mixed slots from MixKey, so the shard is
+    // taken from HashKey remixed with other constants; otherwise the keys of a shard only reach some of the cache sets
+    auto hash = HashKey(key, KeyLength()) ^ 0xD1B54A32D192ED03;
+    hash ^= hash >> 30;
+    hash *= 0xBF58476D1CE4E5B9;
+    hash ^= hash >> 27;
+    hash *= 0x94D049BB133111EB;
+    hash ^= hash >> 31;
+    return hash % shards.size();
+}
+
+void ShardedBlob::Set(Byte* key, Byte* value, const uint64_t& valueLen)
+{
+    shards[ShardOf(key)].Set(key, value, valueLen);
+}
+
+std::unique_ptr<Byte[]> ShardedBlob::Get(const Byte* key) const
+{
+    return shards[ShardOf(key)].Get(key);
+}
+
+BlobStatus ShardedBlob::Set(std::span<const Byte> key, std::span<const Byte> value) noexcept
+{
+    if (key.size() != uint64_t(KeyLength()))
+        return BlobStatus::InvalidLength;
+    return shards[ShardOf(key.data())].Set(key, value);
+}
+
+BlobStatus ShardedBlob::Get(std::span<const Byte> key, std::span<Byte> value) const noexcept
+{
+    if (key.size() != uint64_t(KeyLength()))
+        return BlobStatus::InvalidLength;
+    return shards[ShardOf(key.data())].Get(key, value);
+}
+
+void ShardedBlob::Delete(const Byte* key)
+{
+    shards[ShardOf(key)].Delete(key);
+}
+
+BlobStatus ShardedBlob::Delete(std::span<const Byte> key) noexcept
+{
+    if (key.size() != uint64_t(KeyLength()))
+        return BlobStatus::InvalidLength;
+    return shards[ShardOf(key.data())].Delete(key);
+}
+
+namespace
+{
+// part of the batch that goes to one shard, keys and values are packed like the whole batch
+struct ShardBatch
+{
+    std::vector<uint64_t> indexes;
+    std::vector<Byte> keys;
+    std::vector<Byte> values;
+};
+}
+
+std::vector<BlobStatus> ShardedBlob::MultiGet(std::span<const Byte> keys, std::span<Byte> values) const
+{
+    const auto keyLength = KeyLength();
+    const auto valueLength = ValueLength();
+    const auto count = keys.size() / keyLength;
+    std::vector<BlobStatus> statuses(count, BlobStatus::InvalidLength);
+    if (keys.size() % keyLength != 0 || values.size() < count * valueLength)
+        return statuses;
+
+    std::vector<ShardBatch> batches(shards.size());
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        auto& batch = batches[ShardOf(keys.data() + i * keyLength)];
+        batch.indexes.push_back(i);
+        batch.keys.insert(batch.keys.end(), keys.begin() + i * keyLength, keys.begin() + (i + 1) * keyLength);
+    }
+
+    // every shard writes only the statuses and values of its own keys
+    std::vector<std::future<void>> done;
+    for (uint64_t shard = 0; shard < shards.size(); ++shard)
+    {
+        if (batches[shard].indexes.empty())
+            continue;
+        done.push_back(workers[shard]->Submit([&, shard]()
+        {
+            auto& batch = batches[shard];
+            batch.values.resize(batch.indexes.size() * valueLength);
+            const auto shardStatuses = shards[shard].MultiGet(batch.keys, batch.values);
+            for (uint64_t i = 0; i < batch.indexes.size(); ++i)
+            {
+                statuses[batch.indexes[i]] = shardStatuses[i];
+                std::memcpy(values.data() + batch.indexes[i] * valueLength, batch.values.data() + i * valueLength, valueLength);
+            }
+        }));
+    }
+    for (auto& future : done)
+        future.get();
+    return statuses;
+}
+
+std::vector<BlobStatus> ShardedBlob::MultiSet(std::span<const Byte> keys, std::span<const Byte> values)
+{
+    const auto keyLength = KeyLength();
+    const auto valueLength = ValueLength();
+    const auto count = keys.size() / keyLength;
+    std::vector<BlobStatus> statuses(count, BlobStatus::InvalidLength);
+    if (keys.size() % keyLength != 0 || values.size() < count * valueLength)
+        return statuses;
+
+    // equal keys go to the same shard in input order, so the last of them still wins
+    std::vector<ShardBatch> batches(shards.size());
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        auto& batch = batches[ShardOf(keys.data() + i * keyLength)];
+        batch.indexes.push_back(i);
+        batch.keys.insert(batch.keys.end(), keys.begin() + i * keyLength, keys.begin() + (i + 1) * keyLength);
+        batch.values.insert(batch.values.end(), values.begin() + i * valueLength, values.begin() + (i + 1) * valueLength);
+    }
+
+    std::vector<std::future<void>> done;
+    for (uint64_t shard = 0; shard < shards.size(); ++shard)
+    {
+        if (batches[shard].indexes.empty())
+            continue;
+        done.push_back(workers[shard]->Submit([&, shard]()
+        {
+            const auto& batch = batches[shard];
+            const auto shardStatuses = shards[shard].MultiSet(batch.keys, batch.values);
+            for (uint64_t i = 0; i < batch.indexes.size(); ++i)
+                statuses[batch.indexes[i]] = shardStatuses[i];
+        }));
+    }
+    for (auto& future : done)
+        future.get();
+    return statuses;
+}
+}
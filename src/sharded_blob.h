@@ -0,0 +1,95 @@
+#pragma once
+
+#include "blob.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace DB36_NS
+{
+
+    // runs the tasks of one shard one by one on its own thread
+    class ShardWorker
+    {
+        private:
+            std::mutex mutex;
+            std::condition_variable condition;
+            std::deque<std::function<void()>> tasks;
+            bool isStopped = false;
+            std::thread thread;     // started last, after the queue is ready
+
+            void Run();
+        public:
+            ShardWorker() : thread([this]() { Run(); }) {}
+            ShardWorker(const ShardWorker&) = delete;
+            ShardWorker& operator= (const ShardWorker&) = delete;
+            ~ShardWorker();
+            // queue the task, future is ready when the task is done
+            std::future<void> Submit(std::function<void()> task);
+    };
+
+    // store that splits the keys between several blobs, each in its own file
+    class ShardedBlob
+    {
+        private:
+            std::vector<Blob> shards;
+            std::vector<std::unique_ptr<ShardWorker>> workers;  // one per shard, run batched operations in parallel
+        protected:
+            // shard the key is routed to, keys are spread by a hash of the whole key independent of the ones inside the shard
+            uint64_t ShardOf(const Byte* key) const noexcept;
+        public:
+            // one shard per path, every shard is a blob with the same lengths, capacity and options;
+            // Get and Set are thread safe if options have lock stripes
+            ShardedBlob(
+                const std::vector<std::string>& paths,
+                const uint64_t& keyLength,
+                const uint64_t& valueLength,
+                const uint8_t& capacity,
+                const BlobOptions& options = {});
+            ShardedBlob() = delete;
+            ShardedBlob(const ShardedBlob&) = delete;
+            ShardedBlob& operator= (const ShardedBlob&) = delete;
+            ShardedBlob(ShardedBlob&&) = default;
+            ShardedBlob& operator= (ShardedBlob&&) = default;
+            ~ShardedBlob() = default;
+            // same as the Blob ones, routed to the shard of the key
+            void Set(Byte* key, Byte* value, const uint64_t& valueLen);
+            std::unique_ptr<Byte[]> Get(const Byte* key) const;
+            BlobStatus Set(std::span<const Byte> key, std::span<const Byte> value) noexcept;
+            BlobStatus Get(std::span<const Byte> key, std::span<Byte> value) const noexcept;
+            void Delete(const Byte* key);
+            BlobStatus Delete(std::span<const Byte> key) noexcept;
+            // batch is split between the shards and every shard runs its part on its worker
+            std::vector<BlobStatus> MultiGet(std::span<const Byte> keys, std::span<Byte> values) const;
+            std::vector<BlobStatus> MultiSet(std::span<const Byte> keys, std::span<const Byte> values);
+        public:
+            int64_t ShardsCount() const
+            {
+                return shards.size();
+            }
+            int64_t RecordsCount() const
+            {
+                return shards.front().RecordsCount() * shards.size();
+            }
+            int64_t CapacitySize() const
+            {
+                return shards.front().CapacitySize() * shards.size();
+            }
+            int64_t KeyLength() const
+            {
+                return shards.front().KeyLength();
+            }
+            int64_t ValueLength() const
+            {
+                return shards.front().ValueLength();
+            }
+        private:
+            FRIEND_TEST(ShardedBlobTest, RoutingTest);
+    };
+}
@@ -1,288 +1,1019 @@
 #include "../blob.h"
+#include "../blob_builder.h"
+#include "../fixed_blob.h"
 
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iomanip>
 #include <iostream>
 #include <numeric>
 #include <random>
-
-class KeyValuePair
+#include <sstream>
+#include <thread>
+#include <unordered_set>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using DB36_NS::Blob;
+using DB36_NS::BlobOptions;
+using DB36_NS::BlobCount;
+using DB36_NS::BlobOpenMode;
+using DB36_NS::BlobStatus;
+using DB36_NS::BlobStorage;
+using DB36_NS::Byte;
+
+// unique random keys and their values, packed back to back
+class Records
 {
 private:
-    std::unique_ptr<DB36_NS::Byte[]> key;
-    std::unique_ptr<DB36_NS::Byte[]> value;
+    size_t count;
+    uint64_t keyLength;
+    uint64_t valueLength;
+    std::vector<Byte> keys;
+    std::vector<Byte> values;
+    std::mt19937_64 gen;
+
+    void FillRandom(Byte* data, const uint64_t& length)
+    {
+        for (uint64_t offset = 0; offset < length; offset += sizeof(uint64_t))
+        {
+            const auto word = gen();
+            std::memcpy(data + offset, &word, std::min<uint64_t>(sizeof(uint64_t), length - offset));
+        }
+    }
 
-    int keyLength;
-    int valueLength;
-public:
-    KeyValuePair():
-    keyLength(0), valueLength(0),
-    key(std::make_unique<DB36_NS::Byte[]>(1)), value(std::make_unique<DB36_NS::Byte[]>(1))
-    {};
-    KeyValuePair(const int& i_keyLength, const int& i_valueLength) :
-    keyLength(i_keyLength), valueLength(i_valueLength),
-    key(new DB36_NS::Byte[i_keyLength]), value (new DB36_NS::Byte[i_valueLength])
-    {};
-
-    KeyValuePair(KeyValuePair&) = delete;
-    KeyValuePair& operator= (KeyValuePair&) = delete;
-
-    KeyValuePair(KeyValuePair&& moved) noexcept :
-    keyLength(moved.keyLength),
-    valueLength(moved.valueLength),
-    key(std::move(moved.key)),
-    value(std::move(moved.value))
-    {}
-    KeyValuePair& operator=(KeyValuePair&& moved) noexcept
-    {
-        if (this != &moved)
+    // all zeros key looks like an empty slot and all 0xFF one is the tombstone, so neither is generated
+    bool IsReserved(const Byte* key) const
+    {
+        return std::all_of(key, key + keyLength, [](const Byte b) { return b == 0; })
+            || std::all_of(key, key + keyLength, [](const Byte b) { return b == 0xFF; });
+    }
+
+    // regenerate the keys seen before, a hash set of the indexes keeps it linear
+    void ReplaceDuplicateKeys()
+    {
+        const auto hash = [this](const size_t& i) { return DB36_NS::HashKey(Key(i), keyLength); };
+        const auto equal = [this](const size_t& i, const size_t& j) { return std::memcmp(Key(i), Key(j), keyLength) == 0; };
+        std::unordered_set<size_t, decltype(hash), decltype(equal)> seen(count, hash, equal);
+        for (size_t i = 0; i < count; ++i)
         {
-            key = std::move(moved.key);
-            value = std::move(moved.value);
-            keyLength = moved.keyLength;
-            valueLength = moved.valueLength;
+            while (IsReserved(Key(i)) || !seen.insert(i).second)
+                FillRandom(keys.data() + i * keyLength, keyLength);
         }
-        return *this;
+    }
+public:
+    Records(const size_t& count, const uint64_t& keyLength, const uint64_t& valueLength, const uint64_t& seed = 36) :
+        count(count), keyLength(keyLength), valueLength(valueLength),
+        keys(count * keyLength), values(count * valueLength), gen(seed)
+    {
+        if (keyLength < sizeof(uint64_t) && count + 2 > uint64_t(1) << (keyLength * 8))
+            throw std::logic_error("There are fewer keys of this length than records asked for");
+        FillRandom(keys.data(), keys.size());
+        FillRandom(values.data(), values.size());
+        ReplaceDuplicateKeys();
     }
 
-    union u64bytes
+    size_t Size() const
     {
-        uint64_t number;
-        DB36_NS::Byte bytes[sizeof(uint64_t)];
-    };
+        return count;
+    }
+    const Byte* Key(const size_t& i) const
+    {
+        return keys.data() + i * keyLength;
+    }
+    const Byte* Value(const size_t& i) const
+    {
+        return values.data() + i * valueLength;
+    }
+    std::span<const Byte> KeySpan(const size_t& i) const
+    {
+        return std::span<const Byte>(Key(i), keyLength);
+    }
+    std::span<const Byte> ValueSpan(const size_t& i) const
+    {
+        return std::span<const Byte>(Value(i), valueLength);
+    }
+};
 
-    void GenerateRandomKey()
+// latencies in nanoseconds; every power of two is split into 16 buckets, so a percentile is off by at most 1/16
+class LatencyHistogram
+{
+private:
+    static constexpr uint64_t subBuckets = 16;
+    static constexpr uint64_t subBucketBits = 4;
+
+    std::vector<uint64_t> counts = std::vector<uint64_t>(61 * subBuckets);
+    uint64_t count = 0;
+    uint64_t total = 0;
+    uint64_t maximal = 0;
+
+    static uint64_t BucketOf(const uint64_t& nanoseconds)
+    {
+        if (nanoseconds < subBuckets)
+            return nanoseconds;
+        const uint64_t exponent = std::bit_width(nanoseconds) - 1;
+        const auto subBucket = (nanoseconds >> (exponent - subBucketBits)) & (subBuckets - 1);
+        return (exponent - subBucketBits + 1) * subBuckets + subBucket;
+    }
+    // the largest latency of the bucket
+    static uint64_t BucketTop(const uint64_t& bucket)
+    {
+        if (bucket < subBuckets)
+            return bucket;
+        const auto exponent = bucket / subBuckets + subBucketBits - 1;
+        const auto low = (subBuckets + bucket % subBuckets) << (exponent - subBucketBits);
+        return low + (uint64_t(1) << (exponent - subBucketBits)) - 1;
+    }
+public:
+    void Record(const uint64_t& nanoseconds)
     {
-        std::random_device dev;
-        std::uniform_int_distribution<uint64_t> dist (0, std::numeric_limits<uint64_t>::max());
-        u64bytes u;
-        for (int i = 0; i < keyLength; ++i)
+        ++counts[BucketOf(nanoseconds)];
+        ++count;
+        total += nanoseconds;
+        maximal = std::max(maximal, nanoseconds);
+    }
+    void Merge(const LatencyHistogram& other)
+    {
+        for (size_t i = 0; i < counts.size(); ++i)
+            counts[i] += other.counts[i];
+        count += other.count;
+        total += other.total;
+        maximal = std::max(maximal, other.maximal);
+    }
+    uint64_t Percentile(const double& percentile) const
+    {
+        const auto rank = std::max<uint64_t>(1, std::ceil(percentile * count));
+        uint64_t seen = 0;
+        for (size_t bucket = 0; bucket < counts.size(); ++bucket)
         {
-            if (i % sizeof(u64bytes) == 0)
-            {
-                u = { dist(dev) };
-            }
-            key.get()[i] = u.bytes[i % sizeof(u64bytes)];
+            seen += counts[bucket];
+            if (seen >= rank)
+                return std::min(BucketTop(bucket), maximal);
         }
+        return maximal;
     }
+    uint64_t Count() const
+    {
+        return count;
+    }
+    uint64_t Mean() const
+    {
+        return count ? total / count : 0;
+    }
+    uint64_t Max() const
+    {
+        return maximal;
+    }
+};
+
+// one measured operation of a suite; latency is left empty by the suites that only count throughput
+struct BenchmarkRow
+{
+    std::string suite;
+    std::string params;         // what the suite varied, as name=value pairs split by ';'
+    std::string operation;
+    unsigned threads;
+    uint64_t ops;
+    double seconds;
+    LatencyHistogram latency;
+};
 
-    void GenerateRandomValue()
+// prints the rows as tables and appends them to a csv file, so runs can be compared between releases
+class BenchmarkReport
+{
+private:
+    std::ofstream csv;
+    std::string suite;
+public:
+    explicit BenchmarkReport(const std::string& csvPath) : csv(csvPath)
+    {
+        if (!csv)
+            throw std::runtime_error("Failed to open " + csvPath);
+        csv << "suite,params,operation,threads,ops,ops_per_sec,mean_ns,p50_ns,p99_ns,p999_ns,max_ns\n";
+    }
+    void Add(const BenchmarkRow& row)
     {
-        std::random_device dev;
-        std::uniform_int_distribution<uint64_t> dist (0, std::numeric_limits<uint64_t>::max());
-        u64bytes u;
-        for (int i = 0; i < keyLength; ++i)
+        const auto rate = row.ops / row.seconds;
+        if (row.suite != suite)
         {
-            if (i % sizeof(u64bytes) == 0)
-            {
-                u = { dist(dev) };
-            }
-            value.get()[i] = u.bytes[i % sizeof(u64bytes)];
+            suite = row.suite;
+            std::cout << '\n' << suite << '\n' << std::left << std::setw(48) << "params" << std::setw(10) << "operation"
+                      << std::setw(9) << "threads" << std::setw(14) << "ops/s" << std::setw(10) << "p50 ns"
+                      << std::setw(10) << "p99 ns" << std::setw(10) << "p999 ns" << '\n';
+        }
+        std::cout << std::setw(48) << row.params << std::setw(10) << row.operation << std::setw(9) << row.threads
+                  << std::setw(14) << std::fixed << std::setprecision(0) << rate << std::defaultfloat;
+        csv << row.suite << ',' << row.params << ',' << row.operation << ',' << row.threads << ',' << row.ops << ','
+            << std::fixed << std::setprecision(0) << rate << std::defaultfloat;
+        if (row.latency.Count() != 0)
+        {
+            const auto& latency = row.latency;
+            std::cout << std::setw(10) << latency.Percentile(0.5) << std::setw(10) << latency.Percentile(0.99)
+                      << std::setw(10) << latency.Percentile(0.999);
+            csv << ',' << latency.Mean() << ',' << latency.Percentile(0.5) << ',' << latency.Percentile(0.99)
+                << ',' << latency.Percentile(0.999) << ',' << latency.Max();
         }
+        else
+            csv << ",,,,,";
+        std::cout << '\n';
+        csv << '\n';
     }
+};
+
+// params column from name and value pairs
+std::string Params(std::initializer_list<std::pair<const char*, std::string>> pairs)
+{
+    std::ostringstream params;
+    for (const auto& [name, value] : pairs)
+        params << (params.tellp() > 0 ? ";" : "") << name << '=' << value;
+    return params.str();
+}
+
+std::string Format(const double& number)
+{
+    std::ostringstream text;
+    text << number;
+    return text.str();
+}
+
+const char* StorageName(const BlobStorage& storage)
+{
+    return storage == BlobStorage::Mmap ? "mmap" : storage == BlobStorage::Pool ? "pool" : "file";
+}
+
+// run function(i) for i in [0, count) split between the threads, timing every call into the histogram of its thread
+template <typename Function>
+BenchmarkRow RunTimed(const size_t& count, const unsigned& threadsCount, const Function& function)
+{
+    using namespace std::chrono;
 
-    void GenerateRandomKeyAndValue()
+    std::vector<LatencyHistogram> histograms(threadsCount);
+    std::vector<std::thread> threads;
+    const auto start = steady_clock::now();
+    for (unsigned t = 0; t < threadsCount; ++t)
     {
-        std::random_device dev;
-        std::uniform_int_distribution<uint64_t> dist (0, std::numeric_limits<uint64_t>::max());
-        u64bytes u;
-        for (int i = 0; i < std::max(keyLength, valueLength); ++i)
+        threads.emplace_back([&, t]()
         {
-            if (i % sizeof(u64bytes) == 0)
+            auto& histogram = histograms[t];
+            for (size_t i = t; i < count; i += threadsCount)
             {
-                u = { dist(dev) };               
+                const auto opStart = steady_clock::now();
+                function(i);
+                histogram.Record(duration_cast<nanoseconds>(steady_clock::now() - opStart).count());
             }
-            if (i < keyLength)
-                key.get()[i] = u.bytes[i % sizeof(u64bytes)];
-            if (i < valueLength)
-                value.get()[i] = u.bytes[i % sizeof(u64bytes)];
-        }
+        });
     }
+    for (auto& thread : threads)
+        thread.join();
+    BenchmarkRow row {};
+    row.seconds = duration<double>(steady_clock::now() - start).count();
+    row.threads = threadsCount;
+    row.ops = count;
+    for (const auto& histogram : histograms)
+        row.latency.Merge(histogram);
+    return row;
+}
 
-    int GetValueLength() const
+// indexes below rangeLength drawn from a Zipf distribution, index 0 is the hottest
+std::vector<size_t> GenerateZipfIndexes(const size_t& rangeLength, const size_t& count, const double& exponent, std::mt19937_64& gen)
+{
+    std::vector<double> cdf(rangeLength);
+    double sum = 0;
+    for (size_t i = 0; i < rangeLength; ++i)
     {
-        return valueLength;
+        sum += 1 / std::pow(i + 1, exponent);
+        cdf[i] = sum;
     }
+    std::uniform_real_distribution<double> dist(0, sum);
+    std::vector<size_t> indexes(count);
+    for (auto& index : indexes)
+        index = std::min<size_t>(std::lower_bound(cdf.begin(), cdf.end(), dist(gen)) - cdf.begin(), rangeLength - 1);
+    return indexes;
+}
 
-    int GetKeyLength() const
+// records the lookups go to: the first storedCount records are stored, the ones after them are the misses
+std::vector<size_t> GenerateLookups(const Records& records, const size_t& storedCount, const size_t& count,
+                                    const bool& isZipf, const double& hitRatio)
+{
+    std::mt19937_64 gen(count + storedCount);
+    auto lookups = isZipf ? GenerateZipfIndexes(storedCount, count, 0.99, gen) : std::vector<size_t>(count);
+    std::uniform_int_distribution<size_t> storedDist(0, storedCount - 1);
+    std::uniform_int_distribution<size_t> missingDist(storedCount, records.Size() - 1);
+    std::bernoulli_distribution isHit(hitRatio);
+    for (auto& lookup : lookups)
     {
-        return keyLength;
+        if (!isHit(gen))
+            lookup = missingDist(gen);
+        else if (!isZipf)
+            lookup = storedDist(gen);
     }
+    return lookups;
+}
 
-    DB36_NS::Byte* GetKey() const
+// lookups of uniform and Zipf keys with and without misses over blobs filled to each load factor
+void RunWorkloadBenchmark(BenchmarkReport& report, const Records& records, const size_t& maxStored,
+                          const int& capacity, const size_t& opsCount, const BlobStorage& storage)
+{
+    const auto maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    const auto threadCounts = maxThreads > 1 ? std::vector<unsigned>{1, maxThreads} : std::vector<unsigned>{1};
+    const auto keyLength = records.KeySpan(0).size();
+    const auto valueLength = records.ValueSpan(0).size();
+    for (const auto loadFactor : {0.1, 0.5, 0.75, 0.9, 0.95})
     {
-        return key.get();
+        Blob b(std::string("/tmp/testblobs/blob_workload_") + StorageName(storage) + ".bl", keyLength, valueLength, capacity,
+               {storage, 1024});
+        const auto storedCount = std::min<size_t>(maxStored, loadFactor * b.RecordsCount());
+        auto row = RunTimed(storedCount, 1, [&](const size_t& i)
+        {
+            if (b.Set(records.KeySpan(i), records.ValueSpan(i)) != BlobStatus::Ok)
+                throw std::logic_error("Failed to set record");
+        });
+        row.suite = "workload";
+        row.params = Params({{"storage", StorageName(storage)}, {"load", Format(loadFactor)}});
+        row.operation = "set";
+        report.Add(row);
+
+        for (const bool isZipf : {false, true})
+        {
+            for (const auto hitRatio : {1.0, 0.5})
+            {
+                const auto lookups = GenerateLookups(records, storedCount, opsCount, isZipf, hitRatio);
+                for (const auto threadsCount : threadCounts)
+                {
+                    std::vector<Byte> values(threadsCount * valueLength);
+                    row = RunTimed(lookups.size(), threadsCount, [&](const size_t& i)
+                    {
+                        const auto record = lookups[i];
+                        const auto value = std::span<Byte>(values.data() + i % threadsCount * valueLength, valueLength);
+                        const auto status = b.Get(records.KeySpan(record), value);
+                        if (status != (record < storedCount ? BlobStatus::Ok : BlobStatus::NotFound)
+                            || (status == BlobStatus::Ok && std::memcmp(value.data(), records.Value(record), valueLength) != 0))
+                            throw std::logic_error("Lookup returned wrong value");
+                    });
+                    row.suite = "workload";
+                    row.params = Params({{"storage", StorageName(storage)}, {"load", Format(loadFactor)},
+                                         {"keys", isZipf ? "zipf" : "uniform"}, {"hits", Format(hitRatio)}});
+                    row.operation = "get";
+                    report.Add(row);
+                }
+            }
+        }
     }
+}
 
-    DB36_NS::Byte* GetValue() const
+void RunThreadScalingBenchmark(BenchmarkReport& report, const Records& records, const size_t& count,
+                               const int& capacity, const BlobStorage& storage)
+{
+    const auto keyLength = records.KeySpan(0).size();
+    const auto valueLength = records.ValueSpan(0).size();
+    const auto maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned threadsCount = 1; threadsCount <= maxThreads; threadsCount *= 2)
     {
-        return value.get();
+        Blob b(std::string("/tmp/testblobs/blob_threads_") + StorageName(storage) + ".bl", keyLength, valueLength, capacity, {storage, 1024});
+        auto row = RunTimed(count, threadsCount, [&](const size_t& i)
+        {
+            b.Set(records.KeySpan(i), records.ValueSpan(i));
+        });
+        row.suite = "threads";
+        row.params = Params({{"storage", StorageName(storage)}});
+        row.operation = "set";
+        report.Add(row);
+        std::vector<Byte> values(threadsCount * valueLength);
+        row = RunTimed(count, threadsCount, [&](const size_t& i)
+        {
+            if (b.Get(records.KeySpan(i), std::span<Byte>(values.data() + i % threadsCount * valueLength, valueLength)) != BlobStatus::Ok)
+                throw std::logic_error("Record is not found");
+        });
+        row.suite = "threads";
+        row.params = Params({{"storage", StorageName(storage)}});
+        row.operation = "get";
+        report.Add(row);
     }
-};
+}
 
-bool CompareByteArrays(DB36_NS::Byte* value1, DB36_NS::Byte* value2, const int& valueLength)
+void RunMissBenchmark(BenchmarkReport& report, const Records& records, const size_t& count, const int& capacity)
 {
-    for (int i = 0; i < valueLength; ++i)
-        if (value1[i] != value2[i])
-            return false;
-    
-    return true;
+    const auto keyLength = records.KeySpan(0).size();
+    const auto valueLength = records.ValueSpan(0).size();
+    BlobOptions bloomOptions;
+    bloomOptions.bloomBitsPerSlot = 10;
+    for (const auto& [filter, options] : {std::pair<const char*, BlobOptions>{"none", {}}, {"bloom", bloomOptions}})
+    {
+        Blob b(std::string("/tmp/testblobs/blob_misses_") + filter + ".bl", keyLength, valueLength, capacity, options);
+        for (size_t i = 0; i < count; ++i)
+            b.Set(records.KeySpan(i), records.ValueSpan(i));
+        std::vector<Byte> value(valueLength);
+        for (const auto missRatio : {0.0, 0.4, 0.9, 1.0})
+        {
+            const auto lookups = GenerateLookups(records, count, count, false, 1 - missRatio);
+            auto row = RunTimed(lookups.size(), 1, [&](const size_t& i)
+            {
+                b.TryGet(records.Key(lookups[i]), value.data());
+            });
+            row.suite = "misses";
+            row.params = Params({{"filter", filter}, {"misses", Format(missRatio)}});
+            row.operation = "get";
+            report.Add(row);
+        }
+    }
 }
 
-std::vector<KeyValuePair> GenerateRandomKeyValuesVector(const int& vectorLength, const int& keyLength, const int& valueLength)
+void RunSkewedBenchmark(BenchmarkReport& report, const Records& records, const size_t& count, const int& capacity)
 {
-    int i = 0;
-    std::vector<KeyValuePair> resultVector(vectorLength);
-    using KeyType = std::unique_ptr<DB36_NS::Byte[]>;
-
-    std::vector<KeyType> usedKeys;
-    for (auto& keyValue : resultVector)
-    {
-        KeyValuePair tempKey(keyLength, valueLength);
-        tempKey.GenerateRandomValue();
-        tempKey.GenerateRandomKey();
-        
-        keyValue = std::move(tempKey);
-        ++i;
-        if (i >= 100000 && i % 100000 == 0)
-            std::cout << "Generated " << i << " random key and value" << std::endl;
-    }
-    return resultVector;
+    const auto keyLength = records.KeySpan(0).size();
+    const auto valueLength = records.ValueSpan(0).size();
+    const auto lookups = GenerateLookups(records, count, count, true, 1);
+    const uint64_t dataLength = count * (keyLength + valueLength);
+    for (const auto cacheBytes : {uint64_t(0), dataLength / 100, dataLength / 10})
+    {
+        BlobOptions options;
+        options.cacheBytes = cacheBytes;
+        Blob b("/tmp/testblobs/blob_skewed.bl", keyLength, valueLength, capacity, options);
+        for (size_t i = 0; i < count; ++i)
+            b.Set(records.KeySpan(i), records.ValueSpan(i));
+        std::vector<Byte> value(valueLength);
+        const auto hitsBefore = b.CacheHits();
+        const auto missesBefore = b.CacheMisses();
+        auto row = RunTimed(lookups.size(), 1, [&](const size_t& i)
+        {
+            b.TryGet(records.Key(lookups[i]), value.data());
+        });
+        const auto hits = b.CacheHits() - hitsBefore;
+        const auto misses = b.CacheMisses() - missesBefore;
+        row.suite = "cache";
+        row.params = Params({{"cache_bytes", std::to_string(cacheBytes)},
+                             {"hit_ratio", Format(hits + misses ? double(hits) / (hits + misses) : 0.0)}});
+        row.operation = "get";
+        report.Add(row);
+    }
 }
 
-
-void FindAndReplaceAllNonUniqueKeysInVector(std::vector<KeyValuePair>& v)
+// cost of the statistics: the same lookups with the collection off and on
+void RunStatsBenchmark(BenchmarkReport& report, const Records& records, const size_t& count, const int& capacity)
 {
-    if (v.empty())
-        throw std::logic_error("Empty vector");
-
-    std::cout << "Looking for duplicate keys" << std::endl;
-    using KeyType = std::unique_ptr<DB36_NS::Byte[]>;
-    std::vector<KeyType> alreadyUsedKeys;
-    
-    bool iteratedThroughAllVector = false;
-    const auto keyLength = v[0].GetKeyLength();
-    int iteration = 0;
-    while (!iteratedThroughAllVector)
-    {
-        std::cout << "Starting iteration " << iteration << std::endl;
-        bool startNewIteration = false;
-        for (auto kvIter = v.begin(); kvIter != v.end(); std::advance(kvIter, 1))
+    const auto keyLength = records.KeySpan(0).size();
+    const auto valueLength = records.ValueSpan(0).size();
+    const auto lookups = GenerateLookups(records, count, count, false, 1);
+    for (const auto storage : {BlobStorage::File, BlobStorage::Mmap})
+    {
+        for (const bool isCollected : {false, true})
         {
-            for (const auto& key : alreadyUsedKeys)
+            BlobOptions options {storage};
+            options.stats = isCollected;
+            Blob b("/tmp/testblobs/blob_stats.bl", keyLength, valueLength, capacity, options);
+            for (size_t i = 0; i < count; ++i)
+                b.Set(records.KeySpan(i), records.ValueSpan(i));
+            std::vector<Byte> value(valueLength);
+            auto row = RunTimed(lookups.size(), 1, [&](const size_t& i)
             {
-                auto& kv = *kvIter;
-                if (CompareByteArrays(key.get(), kv.GetKey(), keyLength))
-                {
-                    KeyType goodKey = std::make_unique<DB36_NS::Byte[]>(keyLength);
-                    memcpy(goodKey.get(), kv.GetKey(), keyLength);
-                    alreadyUsedKeys.emplace_back(std::move(goodKey));
-                }
-                else
-                {
-                    std::cout << "Found duplicate key" << std::endl;
-                    kv.GenerateRandomKey();
-                    std::cout << "Generated new random key" << std::endl;
-                    startNewIteration = true;
-                    break;
-                }
-            }
-            if(startNewIteration)
-                break;
-
-            if (kvIter == (v.end() - 1))
-                iteratedThroughAllVector = true;
+                b.Get(records.KeySpan(lookups[i]), value);
+            });
+            row.suite = "stats";
+            row.params = Params({{"storage", StorageName(storage)}, {"stats", isCollected ? "on" : "off"}});
+            row.operation = "get";
+            report.Add(row);
+            if (!isCollected)
+                continue;
+            const auto stats = b.Stats();
+            const auto& probes = stats.probeLengths;
+            std::cout << "stats " << StorageName(storage) << ": load " << Format(stats.loadFactor)
+                      << ", probes p50 " << probes.Percentile(0.5) << " p99 " << probes.Percentile(0.99) << " max " << probes.max
+                      << ", reads " << stats.Count(BlobCount::ReadCalls) << " (" << stats.Count(BlobCount::BytesRead) << " bytes)"
+                      << ", writes " << stats.Count(BlobCount::WriteCalls) << " (" << stats.Count(BlobCount::BytesWritten) << " bytes)"
+                      << '\n';
+        }
+    }
+}
 
-            if (std::distance(kvIter, v.begin()) > 100000 && std::distance(kvIter, v.begin()) % 100000)
+void RunDurabilityBenchmark(BenchmarkReport& report, const Records& records, const size_t& count, const int& capacity)
+{
+    using DB36_NS::BlobDurability;
+
+    const auto keyLength = records.KeySpan(0).size();
+    const auto valueLength = records.ValueSpan(0).size();
+    // synced updates are slow, a part of the records is enough to see the rate
+    const auto synced = std::min<size_t>(count, 20000);
+    const std::pair<BlobDurability, const char*> modes[] = {
+        {BlobDurability::None, "none"}, {BlobDurability::Periodic, "periodic"}, {BlobDurability::PerOp, "per_op"}};
+    for (const auto& [durability, name] : modes)
+    {
+        for (const unsigned threadsCount : {1u, 8u})
+        {
+            BlobOptions options {BlobStorage::File, 1024};
+            options.durability = durability;
+            Blob b("/tmp/testblobs/blob_durability.bl", keyLength, valueLength, capacity, options);
+            auto row = RunTimed(synced, threadsCount, [&](const size_t& i)
             {
-                std::cout << "Checked " << std::distance(kvIter, v.begin()) << " keys" << std::endl;
-            }
+                b.Set(records.KeySpan(i), records.ValueSpan(i));
+            });
+            row.suite = "durability";
+            row.params = Params({{"durability", name}});
+            row.operation = "set";
+            report.Add(row);
         }
     }
 }
 
-// returns vector of time in microseconds
-std::vector<unsigned long long> WriteVectorToBlob (std::vector<KeyValuePair>& v, DB36_NS::Blob& blob)
+void RunQueueDepthBenchmark(BenchmarkReport& report, const Records& records, const size_t& count, const int& capacity)
 {
     using namespace std::chrono;
-    using namespace std::chrono_literals;
 
-    if (v.size() == 0)
-        return {};
+    const auto keyLength = records.KeySpan(0).size();
+    const auto valueLength = records.ValueSpan(0).size();
+    BlobOptions options;
+    options.asyncQueueDepth = 64;
+    Blob b("/tmp/testblobs/blob_async.bl", keyLength, valueLength, capacity, options);
+    for (size_t i = 0; i < count; ++i)
+        b.Set(records.KeySpan(i), records.ValueSpan(i));
 
-    if (blob.KeyLength() != v[0].GetKeyLength())
-        throw std::logic_error ("Key length in input vector and blob are not equal");
+    std::vector<Byte> value(valueLength);
+    auto row = RunTimed(count, 1, [&](const size_t& i)
+    {
+        b.TryGet(records.Key(i), value.data());
+    });
+    row.suite = "async";
+    row.params = Params({{"in_flight", "sync"}});
+    row.operation = "get";
+    report.Add(row);
+
+    for (const size_t depth : {1, 4, 16, 64})
+    {
+        // request i reuses the buffer and the future of request i - depth, so it waits for it first
+        std::vector<Byte> values(depth * valueLength);
+        std::vector<std::future<BlobStatus>> futures(depth);
+        const auto start = steady_clock::now();
+        for (size_t i = 0; i < count; ++i)
+        {
+            auto& future = futures[i % depth];
+            if (future.valid())
+                future.get();
+            future = b.GetAsync(records.KeySpan(i), std::span<Byte>(values.data() + i % depth * valueLength, valueLength));
+        }
+        for (auto& future : futures)
+        {
+            if (future.valid())
+                future.get();
+        }
+        // latency of a request in flight isn't measured, only the rate
+        BenchmarkRow depthRow {"async", Params({{"in_flight", std::to_string(depth)}}), "get", 1, count,
+                               duration<double>(steady_clock::now() - start).count(), {}};
+        report.Add(depthRow);
+    }
+}
 
-    FindAndReplaceAllNonUniqueKeysInVector(v);
+// lengths of FixedBlob are template arguments, so it is compared on its own records of 8 byte keys and 32 byte values
+void RunFixedBenchmark(BenchmarkReport& report, const size_t& opsCount)
+{
+    constexpr uint64_t keyLength = 8;
+    constexpr uint64_t valueLength = 32;
+    constexpr int capacity = 20;
 
-    std::vector<unsigned long long> writeTimesStartMicroseconds;
-    for (const auto& kv : v)
+    const Records records(std::min<size_t>(opsCount, 1 << (capacity - 1)), keyLength, valueLength);
+    std::array<Byte, valueLength> value {};
+    const auto addRow = [&](BenchmarkRow row, const char* blob, const char* operation)
+    {
+        row.suite = "fixed";
+        row.params = Params({{"blob", blob}});
+        row.operation = operation;
+        report.Add(row);
+    };
     {
-        const auto writeTimeStart = system_clock::now();
-        blob.Set(kv.GetKey(), kv.GetValue(), kv.GetValueLength());
-        writeTimesStartMicroseconds.push_back(duration_cast<microseconds>(system_clock::now() - writeTimeStart).count());
+        Blob b("/tmp/testblobs/blob_fixed.bl", keyLength, valueLength, capacity, {BlobStorage::Mmap});
+        addRow(RunTimed(records.Size(), 1, [&](const size_t& i) { b.Set(records.KeySpan(i), records.ValueSpan(i)); }), "Blob", "set");
+        addRow(RunTimed(records.Size(), 1, [&](const size_t& i) { b.Get(records.KeySpan(i), std::span<Byte>(value)); }), "Blob", "get");
     }
-    return writeTimesStartMicroseconds;
+    DB36_NS::FixedBlob<keyLength, valueLength, capacity> b("/tmp/testblobs/blob_fixed.bl");
+    addRow(RunTimed(records.Size(), 1, [&](const size_t& i)
+    {
+        b.Set(std::span<const Byte, keyLength>(records.Key(i), keyLength), std::span<const Byte, valueLength>(records.Value(i), valueLength));
+    }), "FixedBlob", "set");
+    addRow(RunTimed(records.Size(), 1, [&](const size_t& i)
+    {
+        b.Get(std::span<const Byte, keyLength>(records.Key(i), keyLength), std::span<Byte, valueLength>(value));
+    }), "FixedBlob", "get");
 }
 
-std::vector<unsigned long long> ReadFromBlobAndCheckKeyValuePairs(const std::vector<KeyValuePair>& v, const DB36_NS::Blob& blob)
+// values of 20 bytes to 4 KiB, mostly short, in padded slots and in the value log; the file bytes are in the params
+void RunValueLogBenchmark(BenchmarkReport& report, const size_t& opsCount)
 {
-    using namespace std::chrono;
-    using namespace std::chrono_literals;
+    constexpr uint64_t keyLength = 8;
+    constexpr uint64_t valueLength = 4096;
+    constexpr int capacity = 14;
+
+    const auto count = std::min<size_t>(opsCount, (1 << capacity) / 2);
+    const Records records(count, keyLength, valueLength);
+    std::mt19937_64 gen(count);
+    std::vector<size_t> lengths(count);
+    std::lognormal_distribution<double> lengthDist(5, 1.2);
+    for (auto& length : lengths)
+        length = std::clamp<size_t>(lengthDist(gen), 20, valueLength);
+    std::vector<Byte> value(valueLength);
+    for (const uint64_t threshold : {uint64_t(0), uint64_t(64)})
+    {
+        const std::string path = "/tmp/testblobs/blob_value_log.bl";
+        BlobOptions options;
+        options.valueLogThreshold = threshold;
+        Blob b(path, keyLength, valueLength, capacity, options);
+        const auto setRow = RunTimed(count, 1, [&](const size_t& i) { b.Set(records.KeySpan(i), records.ValueSpan(i).first(lengths[i])); });
+        const auto getRow = RunTimed(count, 1, [&](const size_t& i) { b.Get(records.KeySpan(i), value); });
+        const auto fileBytes = std::filesystem::file_size(path) + b.ValueLogBytes();
+        for (auto [row, operation] : {std::pair{setRow, "set"}, {getRow, "get"}})
+        {
+            row.suite = "valuelog";
+            row.params = Params({{"slots", threshold ? "log" : "padded"}, {"file_bytes", std::to_string(fileBytes)}});
+            row.operation = operation;
+            report.Add(row);
+        }
+    }
+}
 
-    if (v.size() == 0)
-        return {};
+void RunBulkLoadBenchmark(BenchmarkReport& report, const Records& records, const size_t& count, const int& capacity)
+{
+    const auto keyLength = records.KeySpan(0).size();
+    const auto valueLength = records.ValueSpan(0).size();
+    const std::string path = "/tmp/testblobs/blob_load.bl";
+    {
+        Blob b(path, keyLength, valueLength, capacity);
+        auto row = RunTimed(count, 1, [&](const size_t& i) { b.Set(records.KeySpan(i), records.ValueSpan(i)); });
+        row.suite = "load";
+        row.params = Params({{"loader", "set"}});
+        row.operation = "set";
+        report.Add(row);
+    }
+    // the whole dataset in memory, then a budget of an eighth of it, so the runs are spilled and merged
+    const auto datasetBytes = count * (keyLength + sizeof(uint32_t) + valueLength);
+    for (const auto& [loader, memoryBytes] : {std::pair<const char*, size_t>{"build", datasetBytes}, {"build_spilled", datasetBytes / 8}})
+    {
+        std::filesystem::remove(path);
+        DB36_NS::BlobBuilder builder(path, keyLength, valueLength, capacity, {}, memoryBytes);
+        auto addRow = RunTimed(count, 1, [&](const size_t& i) { builder.Add(records.KeySpan(i), records.ValueSpan(i)); });
+        auto finishRow = RunTimed(1, 1, [&](const size_t&) { builder.Finish(); });
+        finishRow.ops = count;
+        for (auto [row, operation] : {std::pair{addRow, "add"}, {finishRow, "finish"}})
+        {
+            row.suite = "load";
+            row.params = Params({{"loader", loader}});
+            row.operation = operation;
+            report.Add(row);
+        }
+    }
+}
 
-    if (blob.KeyLength() != v[0].GetKeyLength())
-        throw std::logic_error ("Key length in input vector and blob are not equal");
+void RunScanBenchmark(BenchmarkReport& report, const Records& records, const size_t& count, const int& capacity)
+{
+    const auto keyLength = records.KeySpan(0).size();
+    const auto valueLength = records.ValueSpan(0).size();
+    std::vector<Byte> value(valueLength);
+    for (const auto storage : {BlobStorage::File, BlobStorage::Mmap})
+    {
+        Blob b("/tmp/testblobs/blob_scan.bl", keyLength, valueLength, capacity, {storage});
+        for (size_t i = 0; i < count; ++i)
+            b.Set(records.KeySpan(i), records.ValueSpan(i));
+        // exporting the known keys one Get at a time, against streaming the slots
+        auto getRow = RunTimed(count, 1, [&](const size_t& i) { b.Get(records.KeySpan(i), value); });
+        uint64_t scanned = 0;
+        auto scanRow = RunTimed(1, 1, [&](const size_t&)
+        {
+            auto scanner = b.Scan();
+            while (scanner.Next())
+                ++scanned;
+        });
+        scanRow.ops = scanned;
+        // the last key byte is the top of the key order, so this range is a sixteenth of the slots
+        std::vector<Byte> from(keyLength, 0);
+        std::vector<Byte> to(keyLength, 0xFF);
+        to.back() = 0x0F;
+        uint64_t rangeScanned = 0;
+        auto rangeRow = RunTimed(1, 1, [&](const size_t&)
+        {
+            auto scanner = b.Scan(from, to);
+            while (scanner.Next())
+                ++rangeScanned;
+        });
+        rangeRow.ops = rangeScanned;
+        for (auto [row, operation] : {std::pair{getRow, "get"}, {scanRow, "scan"}, {rangeRow, "range_scan"}})
+        {
+            row.suite = "scan";
+            row.params = Params({{"storage", StorageName(storage)}});
+            row.operation = operation;
+            report.Add(row);
+        }
+    }
+}
 
-    std::vector<unsigned long long> readTimesStartMicroseconds;
-    for (const auto& kv : v)
+void RunClusteringBenchmark(BenchmarkReport& report, const int& capacity)
+{
+    using DB36_NS::BlobKeyHash;
+
+    // raw slots put sequential keys on one chain, so every Set walks all of it; a smaller blob keeps that bearable
+    const int clusteredCapacity = std::min(capacity, 16);
+    const size_t count = (size_t(1) << clusteredCapacity) * 3 / 4;
+    std::mt19937_64 gen(count);
+    std::vector<uint64_t> randomKeys(count);
+    for (auto& key : randomKeys)
+        key = gen();
+    for (const auto& [isSequentialKeys, keysName] : {std::pair<bool, const char*>{true, "sequential"}, {false, "random"}})
     {
-        const auto readTimeStart = system_clock::now();
-        const auto data = blob.Get(kv.GetKey());
-        readTimesStartMicroseconds.push_back(duration_cast<microseconds>(system_clock::now() - readTimeStart).count());
+        for (const auto& [keyHash, hashName] : {std::pair{BlobKeyHash::Raw, "raw"}, {BlobKeyHash::Mixed, "mixed"}})
+        {
+            BlobOptions options;
+            options.keyHash = keyHash;
+            options.stats = true;
+            Blob b("/tmp/testblobs/blob_clustering.bl", sizeof(uint64_t), sizeof(uint64_t), clusteredCapacity, options);
+            const auto keyOf = [&, isSequential = isSequentialKeys](const size_t& i) { return isSequential ? uint64_t(i + 1) : randomKeys[i]; };
+            uint64_t value = 0;
+            const auto setRow = RunTimed(count, 1, [&](const size_t& i)
+            {
+                const auto key = keyOf(i);
+                b.Set(std::span<const Byte>(reinterpret_cast<const Byte*>(&key), sizeof(key)),
+                      std::span<const Byte>(reinterpret_cast<const Byte*>(&i), sizeof(i)));
+            });
+            const auto getRow = RunTimed(count, 1, [&](const size_t& i)
+            {
+                const auto key = keyOf(i);
+                b.Get(std::span<const Byte>(reinterpret_cast<const Byte*>(&key), sizeof(key)),
+                      std::span<Byte>(reinterpret_cast<Byte*>(&value), sizeof(value)));
+            });
+            // probe lengths of the Sets and the Gets together
+            const auto probes = b.Stats().probeLengths;
+            for (auto [row, operation] : {std::pair{setRow, "set"}, {getRow, "get"}})
+            {
+                row.suite = "clustering";
+                row.params = Params({{"keys", keysName}, {"hash", hashName}, {"probe_mean", std::to_string(probes.Mean())},
+                                     {"probe_p99", std::to_string(probes.Percentile(0.99))}, {"probe_max", std::to_string(probes.max)}});
+                row.operation = operation;
+                report.Add(row);
+            }
+        }
+    }
+}
 
-        if (!CompareByteArrays(data.get(), kv.GetValue(), kv.GetValueLength()))
-            throw std::logic_error("KV pair doesn't equal to data");
+// skewed lookups through the page cache, the mapping and the pool of O_DIRECT pages sized to a share of the blob
+void RunPoolBenchmark(BenchmarkReport& report, const Records& records, const size_t& count, const int& capacity)
+{
+    const auto keyLength = records.KeySpan(0).size();
+    const auto valueLength = records.ValueSpan(0).size();
+    const auto lookups = GenerateLookups(records, count, count, true, 1);
+    const auto capacitySize = (uint64_t(1) << capacity) * (keyLength + valueLength);
+    const auto threadsCount = std::max(1u, std::min(4u, std::thread::hardware_concurrency()));
+    for (const auto& [storage, poolBytes] : {std::pair{BlobStorage::File, uint64_t(0)}, {BlobStorage::Mmap, uint64_t(0)},
+                                             {BlobStorage::Pool, capacitySize / 16}, {BlobStorage::Pool, capacitySize / 4}})
+    {
+        BlobOptions options;
+        options.storage = storage;
+        options.lockStripes = 1024;
+        options.poolBytes = poolBytes;
+        Blob b(std::string("/tmp/testblobs/blob_pool_") + StorageName(storage) + ".bl", keyLength, valueLength, capacity, options);
+        // hit ratio of the pages read by the calls of the row
+        uint64_t hitsBefore = 0;
+        uint64_t missesBefore = 0;
+        auto row = RunTimed(count, 1, [&](const size_t& i)
+        {
+            b.Set(records.KeySpan(i), records.ValueSpan(i));
+        });
+        const auto params = [&]()
+        {
+            const auto hits = b.PoolHits() - hitsBefore;
+            const auto misses = b.PoolMisses() - missesBefore;
+            hitsBefore = b.PoolHits();
+            missesBefore = b.PoolMisses();
+            return Params({{"storage", StorageName(storage)}, {"pool_bytes", std::to_string(b.PoolBytes())},
+                           {"hit_ratio", Format(hits + misses ? double(hits) / (hits + misses) : 0.0)}});
+        };
+        row.suite = "pool";
+        row.params = params();
+        row.operation = "set";
+        report.Add(row);
+        for (const auto& threads : {1u, threadsCount})
+        {
+            std::vector<Byte> values(threads * valueLength);
+            row = RunTimed(lookups.size(), threads, [&](const size_t& i)
+            {
+                const auto thread = i % threads;
+                b.TryGet(records.Key(lookups[i]), values.data() + thread * valueLength);
+            });
+            row.suite = "pool";
+            row.params = params();
+            row.operation = "get";
+            report.Add(row);
+        }
     }
-    return readTimesStartMicroseconds;
 }
 
-int main(int argc, char *argv[])
+// 4 bytes keys addressed directly: the flat file of every slot against the pages appended as keys are written
+void RunSparseBenchmark(BenchmarkReport& report, const size_t& opsCount)
+{
+    constexpr uint64_t keyLength = 4;
+    constexpr uint64_t valueLength = 8;
+
+    std::mt19937_64 gen(opsCount);
+    std::vector<uint32_t> randomKeys(opsCount);
+    for (auto& key : randomKeys)
+        key = gen();
+    for (const auto& [isSequentialKeys, keysName] : {std::pair<bool, const char*>{true, "sequential"}, {false, "random"}})
+    {
+        for (const bool isSparse : {false, true})
+        {
+            const std::string path = "/tmp/testblobs/blob_sparse.bl";
+            BlobOptions options;
+            options.sparse = isSparse;
+            Blob b(path, keyLength, valueLength, 0, options);
+            const auto keyOf = [&, isSequential = isSequentialKeys](const size_t& i) { return isSequential ? uint32_t(i) : randomKeys[i]; };
+            uint64_t value = 0;
+            const auto setRow = RunTimed(opsCount, 1, [&](const size_t& i)
+            {
+                const auto key = keyOf(i);
+                b.Set(std::span<const Byte>(reinterpret_cast<const Byte*>(&key), sizeof(key)),
+                      std::span<const Byte>(reinterpret_cast<const Byte*>(&i), sizeof(value)));
+            });
+            const auto getRow = RunTimed(opsCount, 1, [&](const size_t& i)
+            {
+                const auto key = keyOf(i);
+                b.Get(std::span<const Byte>(reinterpret_cast<const Byte*>(&key), sizeof(key)),
+                      std::span<Byte>(reinterpret_cast<Byte*>(&value), sizeof(value)));
+            });
+            // blocks the file system allocated, the flat file is as long as all the slots but has holes
+            struct stat fileStat {};
+            stat(path.c_str(), &fileStat);
+            for (auto [row, operation] : {std::pair{setRow, "set"}, {getRow, "get"}})
+            {
+                row.suite = "sparse";
+                row.params = Params({{"layout", isSparse ? "sparse" : "flat"}, {"keys", keysName},
+                                     {"disk_bytes", std::to_string(uint64_t(fileStat.st_blocks) * 512)},
+                                     {"pages", std::to_string(b.SparsePagesCount())}});
+                row.operation = operation;
+                report.Add(row);
+            }
+        }
+    }
+}
+
+// lookups of reader processes mapping the blob next to the writer, against the threads of the writer process;
+// with a busy writer the readers retry the copies its Sets overlap
+void RunSharedBenchmark(BenchmarkReport& report, const Records& records, const size_t& count, const int& capacity)
 {
-    using namespace DB36_NS;
     using namespace std::chrono;
-    using namespace std::chrono_literals;
 
+    const auto keyLength = records.KeySpan(0).size();
+    const auto valueLength = records.ValueSpan(0).size();
+    const auto lookups = GenerateLookups(records, count, count, false, 1);
+    const std::string path = "/tmp/testblobs/blob_shared.bl";
+    BlobOptions options;
+    options.storage = BlobStorage::Mmap;
+    options.sharedReaders = true;
+    Blob writer(path, keyLength, valueLength, capacity, options);
+    for (size_t i = 0; i < count; ++i)
+        writer.Set(records.KeySpan(i), records.ValueSpan(i));
+    BlobOptions readerOptions;
+    readerOptions.storage = BlobStorage::Mmap;
+    readerOptions.openMode = BlobOpenMode::ReadShared;
+
+    for (const bool isWriterBusy : {false, true})
+    {
+        // writer rewrites the stored values with themselves, so the lookups still find what they expect
+        std::atomic<bool> isWriting = isWriterBusy;
+        std::thread writerThread([&]()
+        {
+            for (size_t i = 0; isWriting; i = (i + 1) % count)
+                writer.Set(records.KeySpan(i), records.ValueSpan(i));
+        });
+        std::vector<Byte> value(valueLength);
+        auto row = RunTimed(lookups.size(), 1, [&](const size_t& i)
+        {
+            writer.Get(records.KeySpan(lookups[i]), value);
+        });
+        row.suite = "shared";
+        row.params = Params({{"readers", "threads"}, {"writer", isWriterBusy ? "busy" : "idle"}});
+        row.operation = "get";
+        report.Add(row);
+
+        for (const unsigned processes : {1u, 2u, 4u})
+        {
+            // every reader sends its seconds and then the latency of each of its lookups
+            std::vector<std::pair<pid_t, int>> children;
+            for (unsigned p = 0; p < processes; ++p)
+            {
+                int fds[2];
+                if (pipe(fds) != 0)
+                    throw std::runtime_error("Failed to create pipe");
+                const auto child = fork();
+                if (child < 0)
+                    throw std::runtime_error("Failed to fork reader");
+                if (child == 0)
+                {
+                    close(fds[0]);
+                    auto reader = Blob::Open(path, readerOptions);
+                    std::vector<uint64_t> latencies;
+                    latencies.reserve(lookups.size() / processes + 1);
+                    const auto start = steady_clock::now();
+                    for (size_t i = p; i < lookups.size(); i += processes)
+                    {
+                        const auto opStart = steady_clock::now();
+                        reader.Get(records.KeySpan(lookups[i]), value);
+                        latencies.push_back(duration_cast<nanoseconds>(steady_clock::now() - opStart).count());
+                    }
+                    const double seconds = duration<double>(steady_clock::now() - start).count();
+                    const auto isSent = write(fds[1], &seconds, sizeof(seconds)) == ssize_t(sizeof(seconds))
+                        && write(fds[1], latencies.data(), latencies.size() * sizeof(uint64_t)) == ssize_t(latencies.size() * sizeof(uint64_t));
+                    _exit(isSent ? 0 : 1);
+                }
+                close(fds[1]);
+                children.emplace_back(child, fds[0]);
+            }
+            row = BenchmarkRow {};
+            row.suite = "shared";
+            row.params = Params({{"readers", "processes"}, {"writer", isWriterBusy ? "busy" : "idle"}});
+            row.operation = "get";
+            row.threads = processes;
+            row.ops = lookups.size();
+            for (const auto& [child, fd] : children)
+            {
+                double seconds = 0;
+                uint64_t latency = 0;
+                if (read(fd, &seconds, sizeof(seconds)) == ssize_t(sizeof(seconds)))
+                    row.seconds = std::max(row.seconds, seconds);
+                // pipe hands the latencies over in pieces of its buffer length
+                std::vector<Byte> pending;
+                Byte buffer[1 << 16];
+                for (ssize_t len; (len = read(fd, buffer, sizeof(buffer))) > 0;)
+                {
+                    pending.insert(pending.end(), buffer, buffer + len);
+                    const auto whole = pending.size() / sizeof(latency) * sizeof(latency);
+                    for (size_t offset = 0; offset < whole; offset += sizeof(latency))
+                    {
+                        std::memcpy(&latency, pending.data() + offset, sizeof(latency));
+                        row.latency.Record(latency);
+                    }
+                    pending.erase(pending.begin(), pending.begin() + whole);
+                }
+                close(fd);
+                waitpid(child, nullptr, 0);
+            }
+            report.Add(row);
+        }
+        isWriting = false;
+        writerThread.join();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 5)
+    {
+        std::cerr << "Usage: benchmark <capacity> <keyLength> <valueLength> <opsCount> [results.csv]" << '\n';
+        return 1;
+    }
+    const int capacity = std::stoi(argv[1]);
     const int keyLength = std::stoi(argv[2]);
     const int valueLength = std::stoi(argv[3]);
-    const int capacity = std::stoi(argv[1]);
-    const int vectorLength = std::stoi(argv[4]);
-
-    std::cout << "Generating large random vector, it might take a while" << std::endl;
-    auto largeVector = GenerateRandomKeyValuesVector(vectorLength, keyLength, valueLength);
-    std::cout << "Making sure there are no duplicate keys" << std::endl;
-    FindAndReplaceAllNonUniqueKeysInVector(largeVector);
-
-    Blob b ("/tmp/testblobs/blob.bl", keyLength, valueLength, capacity);
-
-    std::cout << "keyLength\t" << keyLength << std::endl;
-    std::cout << "valueLength\t" << valueLength << std::endl;
-    std::cout << "capacity\t" << capacity << std::endl;
-    std::cout << "vectorLength\t" << vectorLength << std::endl;
-    std::cout << "Test started" << std::endl;
-
-    const auto writeTimesMicrosendsVector = WriteVectorToBlob(largeVector, b);
-    const auto readTimesMicrosendsVector = ReadFromBlobAndCheckKeyValuePairs(largeVector, b);
-   
-    std::cout << "Test finished" << std::endl;
-    std::cout << "duration\t" << std::accumulate(writeTimesMicrosendsVector.begin(), writeTimesMicrosendsVector.end(), std::accumulate(readTimesMicrosendsVector.begin(), readTimesMicrosendsVector.end(), 0))/1000 << "ms\n";
-    std::cout << "average write\t" << double(std::accumulate(writeTimesMicrosendsVector.begin(), writeTimesMicrosendsVector.end(), 0)/writeTimesMicrosendsVector.size())/1000 << "ms\n";
-    std::cout << "maximal write\t" << double(*std::max_element(writeTimesMicrosendsVector.begin(), writeTimesMicrosendsVector.end()))/1000 << "ms\n";
-    std::cout << "minimal write\t" << double(*std::min_element(writeTimesMicrosendsVector.begin(), writeTimesMicrosendsVector.end()))/1000 << "ms\n";
-    std::cout << "average read\t" << double(std::accumulate(readTimesMicrosendsVector.begin(), readTimesMicrosendsVector.end(), 0)/readTimesMicrosendsVector.size())/1000 << "ms\n";
-    std::cout << "maximal read\t" << double(*std::max_element(readTimesMicrosendsVector.begin(), readTimesMicrosendsVector.end()))/1000 << "ms\n";
-    std::cout << "minimal read\t" << double(*std::min_element(readTimesMicrosendsVector.begin(), readTimesMicrosendsVector.end()))/1000 << "ms\n";
+    const size_t opsCount = std::stoull(argv[4]);
+    const std::string csvPath = argc > 5 ? argv[5] : "benchmark_results.csv";
+    if (capacity == 0)
+    {
+        std::cerr << "Benchmark needs a shrinked blob, capacity can't be 0" << '\n';
+        return 1;
+    }
+
+    std::cout << "keyLength\t" << keyLength << '\n';
+    std::cout << "valueLength\t" << valueLength << '\n';
+    std::cout << "capacity\t" << capacity << '\n';
+    std::cout << "opsCount\t" << opsCount << '\n';
+    std::cout << "results\t\t" << csvPath << std::endl;
+
+    // stored records fill the blob up to the largest load factor, the records after them are never stored
+    const size_t maxStored = 0.95 * (uint64_t(1) << capacity);
+    const Records records(maxStored + opsCount, keyLength, valueLength);
+    // the suites not about load factors keep the blob at most 3/4 full
+    const auto count = std::min<size_t>(opsCount, maxStored * 3 / 4);
+
+    std::filesystem::create_directories("/tmp/testblobs");
+    BenchmarkReport report(csvPath);
+    for (const auto storage : {BlobStorage::File, BlobStorage::Mmap})
+        RunWorkloadBenchmark(report, records, maxStored, capacity, opsCount, storage);
+    for (const auto storage : {BlobStorage::File, BlobStorage::Mmap})
+        RunThreadScalingBenchmark(report, records, count, capacity, storage);
+    RunMissBenchmark(report, records, count, capacity);
+    RunSkewedBenchmark(report, records, count, capacity);
+    RunStatsBenchmark(report, records, count, capacity);
+    RunDurabilityBenchmark(report, records, count, capacity);
+    RunQueueDepthBenchmark(report, records, count, capacity);
+    RunFixedBenchmark(report, opsCount);
+    RunValueLogBenchmark(report, opsCount);
+    RunBulkLoadBenchmark(report, records, count, capacity);
+    RunScanBenchmark(report, records, count, capacity);
+    RunClusteringBenchmark(report, capacity);
+    RunPoolBenchmark(report, records, count, capacity);
+    RunSparseBenchmark(report, opsCount);
+    RunSharedBenchmark(report, records, count, capacity);
 
     return 0;
-}
\ No newline at end of file
+}
@@ -1,10 +1,53 @@
 #include "../blob.h"
+#include "../blob_builder.h"
+#include "../blob_client.h"
+#include "../blob_server.h"
+#include "../fixed_blob.h"
+#include "../sharded_blob.h"
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
 #include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <limits>
+#include <new>
+#include <numeric>
 #include <random>
+#include <thread>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// counts heap allocations, so tests can check that hot paths don't allocate
+static std::atomic<uint64_t> allocationsCount = 0;
+
+void* operator new(std::size_t size)
+{
+    ++allocationsCount;
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
 
 namespace DB36_NS
 {
@@ -74,13 +117,2085 @@ TEST(BlobTest, IOTest)
     EXPECT_NO_THROW(b.Init());
     std::unique_ptr<Byte[]>setValueBytes(new Byte[3] {254, 0, 254});
 
-    const auto byteKey = ConvertUintKeyToByteArray(0, 3).get();
-    IOTest(byteKey, setValueBytes.get(), 3, b);
-    const auto byteKey2 = ConvertUintKeyToByteArray(10, 3).get();
-    IOTest(byteKey2, setValueBytes.get(), 3, b);
+    const auto byteKey = ConvertUintKeyToByteArray(0, 3);
+    IOTest(byteKey.get(), setValueBytes.get(), 3, b);
+    const auto byteKey2 = ConvertUintKeyToByteArray(10, 3);
+    IOTest(byteKey2.get(), setValueBytes.get(), 3, b);
     
 }
 
+TEST(BlobTest, MmapIOTest)
+{
+    Blob direct("/tmp/testblobs/blob_mmap_direct.bl", 2, 3, 0, {BlobStorage::Mmap});
+    EXPECT_EQ(direct.Storage(), BlobStorage::Mmap);
+    std::unique_ptr<Byte[]>setValueBytes(new Byte[3] {254, 0, 254});
+    for (uint64_t key = 0; key < 1000; key += 7)
+        IOTest(ConvertUintKeyToByteArray(key, 2).get(), setValueBytes.get(), 3, direct);
+
+    Blob shrinked("/tmp/testblobs/blob_mmap_shrinked.bl", 4, 4, 10, {BlobStorage::Mmap});
+    for (uint64_t key = 1; key < 500; ++key)
+    {
+        // neighbouring keys share the slot, so this also checks probing in place
+        const auto keyBytes = ConvertUintKeyToByteArray(key, 4);
+        const auto valueBytes = ConvertUintKeyToByteArray(key * 3, 4);
+        IOTest(keyBytes.get(), valueBytes.get(), 4, shrinked);
+    }
+    for (uint64_t key = 1; key < 500; ++key)
+    {
+        const auto value = shrinked.Get(ConvertUintKeyToByteArray(key, 4).get());
+        EXPECT_EQ(std::memcmp(value.get(), ConvertUintKeyToByteArray(key * 3, 4).get(), 4), 0);
+    }
+}
+
+TEST(BlobTest, SpanIOTest)
+{
+    for (const auto storage : {BlobStorage::File, BlobStorage::Mmap})
+    {
+        Blob b("/tmp/testblobs/blob_span.bl", 4, 6, 12, {storage});
+        Byte key[4] = {1, 2, 3, 4};
+        Byte value[6] = {6, 5, 4, 3, 2, 1};
+        Byte readValue[6] = {};
+
+        EXPECT_EQ(b.Get(key, readValue), BlobStatus::NotFound);
+        EXPECT_EQ(b.Set(key, value), BlobStatus::Ok);
+        EXPECT_EQ(b.Get(key, readValue), BlobStatus::Ok);
+        EXPECT_EQ(std::memcmp(value, readValue, 6), 0);
+
+        // key and value spans must fit the blob
+        EXPECT_EQ(b.Set(std::span<const Byte>(key, 3), value), BlobStatus::InvalidLength);
+        EXPECT_EQ(b.Get(key, std::span<Byte>(readValue, 5)), BlobStatus::InvalidLength);
+        Byte longValue[7] = {};
+        EXPECT_EQ(b.Set(key, longValue), BlobStatus::InvalidLength);
+        // shorter value overwrites only the beginning of the stored one
+        EXPECT_EQ(b.Set(key, std::span<const Byte>(longValue, 2)), BlobStatus::Ok);
+        EXPECT_EQ(b.Get(key, readValue), BlobStatus::Ok);
+        EXPECT_EQ(readValue[0], 0);
+        EXPECT_EQ(readValue[2], 4);
+    }
+}
+
+TEST(BlobTest, SpanIONoAllocations)
+{
+    for (const auto storage : {BlobStorage::File, BlobStorage::Mmap})
+    {
+        Blob b("/tmp/testblobs/blob_span.bl", 8, 16, 12, {storage});
+        Byte key[8] = {};
+        Byte value[16] = {};
+        Byte readValue[16] = {};
+
+        const auto allocationsBefore = allocationsCount.load();
+        for (uint64_t i = 1; i < 1000; ++i)
+        {
+            // spread keys over the slots by their high bits
+            const uint64_t keyInt = i << 52 | i;
+            std::memcpy(key, &keyInt, sizeof(keyInt));
+            std::memcpy(value, &i, sizeof(i));
+            ASSERT_EQ(b.Set(key, value), BlobStatus::Ok);
+            ASSERT_EQ(b.Get(key, readValue), BlobStatus::Ok);
+            ASSERT_EQ(std::memcmp(value, readValue, 16), 0);
+        }
+        EXPECT_EQ(allocationsCount.load(), allocationsBefore);
+    }
+}
+
+TEST(BlobTest, PageProbeTest)
+{
+    // 12 byte records don't divide the page, records larger than the page are probed one by one
+    for (const auto valueLength : {7, 5000})
+    {
+        for (const auto storage : {BlobStorage::File, BlobStorage::Mmap})
+        {
+            Blob b("/tmp/testblobs/blob_page.bl", 5, valueLength, 12, {storage});
+            std::vector<Byte> value(valueLength);
+            std::vector<Byte> readValue(valueLength);
+            // small keys share the first slot, so the chain runs over many pages
+            for (uint64_t key = 1; key < 1000; ++key)
+            {
+                std::memcpy(value.data(), &key, sizeof(key));
+                ASSERT_EQ(b.Set(std::span<const Byte>(ConvertUintKeyToByteArray(key, 5).get(), 5), value), BlobStatus::Ok);
+            }
+            for (uint64_t key = 1; key < 1000; ++key)
+            {
+                ASSERT_EQ(b.Get(std::span<const Byte>(ConvertUintKeyToByteArray(key, 5).get(), 5), readValue), BlobStatus::Ok);
+                EXPECT_EQ(std::memcmp(readValue.data(), &key, sizeof(key)), 0);
+            }
+            // the chain ends at the first empty slot
+            EXPECT_EQ(b.Get(std::span<const Byte>(ConvertUintKeyToByteArray(1000, 5).get(), 5), readValue), BlobStatus::NotFound);
+        }
+    }
+}
+
+TEST(BlobTest, WrapAroundTest)
+{
+    for (const auto storage : {BlobStorage::File, BlobStorage::Mmap})
+    {
+        Blob b("/tmp/testblobs/blob_wrap.bl", 4, 4, 4, {storage});
+        Byte readValue[4] = {};
+        // all keys start at the last slot, so the chain wraps around and fills the whole blob
+        for (uint32_t key = 0xF0000001; key <= 0xF0000010; ++key)
+            ASSERT_EQ(b.Set(std::span<const Byte>(ConvertUintKeyToByteArray(key, 4).get(), 4),
+                            std::span<const Byte>(ConvertUintKeyToByteArray(~key, 4).get(), 4)), BlobStatus::Ok);
+        for (uint32_t key = 0xF0000001; key <= 0xF0000010; ++key)
+        {
+            ASSERT_EQ(b.Get(std::span<const Byte>(ConvertUintKeyToByteArray(key, 4).get(), 4), readValue), BlobStatus::Ok);
+            EXPECT_EQ(std::memcmp(readValue, ConvertUintKeyToByteArray(~key, 4).get(), 4), 0);
+        }
+        EXPECT_EQ(b.Set(std::span<const Byte>(ConvertUintKeyToByteArray(1, 4).get(), 4), readValue), BlobStatus::NoSpace);
+        EXPECT_EQ(b.Get(std::span<const Byte>(ConvertUintKeyToByteArray(1, 4).get(), 4), readValue), BlobStatus::NotFound);
+    }
+}
+
+void MultiIOTest(Blob& b, const std::vector<uint64_t>& keyInts)
+{
+    const auto keyLen = b.KeyLength();
+    const auto valueLen = b.ValueLength();
+    std::vector<Byte> keys(keyInts.size() * keyLen);
+    std::vector<Byte> values(keyInts.size() * valueLen);
+    for (size_t i = 0; i < keyInts.size(); ++i)
+    {
+        std::memcpy(&keys[i * keyLen], ConvertUintKeyToByteArray(keyInts[i], keyLen).get(), keyLen);
+        std::memcpy(&values[i * valueLen], ConvertUintKeyToByteArray(keyInts[i] + i, valueLen).get(), valueLen);
+    }
+    for (const auto& status : b.MultiSet(keys, values))
+        EXPECT_EQ(status, BlobStatus::Ok);
+
+    // duplicate keys in the batch keep the last value
+    std::vector<Byte> expected(values.size());
+    for (size_t i = 0; i < keyInts.size(); ++i)
+    {
+        const auto last = std::find(keyInts.rbegin(), keyInts.rend(), keyInts[i]).base() - keyInts.begin() - 1;
+        std::memcpy(&expected[i * valueLen], &values[last * valueLen], valueLen);
+    }
+
+    std::vector<Byte> readValues(values.size());
+    for (const auto& status : b.MultiGet(keys, readValues))
+        EXPECT_EQ(status, BlobStatus::Ok);
+    EXPECT_EQ(readValues, expected);
+    for (size_t i = 0; i < keyInts.size(); ++i)
+    {
+        const auto value = b.Get(&keys[i * keyLen]);
+        EXPECT_EQ(std::memcmp(value.get(), &expected[i * valueLen], valueLen), 0);
+    }
+}
+
+TEST(BlobTest, MultiIOTest)
+{
+    std::mt19937_64 gen(36);
+    std::uniform_int_distribution<uint32_t> dist (1, std::numeric_limits<uint32_t>::max());
+    std::vector<uint64_t> randomKeys(5000);
+    for (auto& key : randomKeys)
+        key = dist(gen);
+    // small keys all land in the first slots, so their chains run past the batch windows
+    for (uint64_t key = 1; key < 100; ++key)
+        randomKeys.push_back(key);
+    randomKeys.push_back(randomKeys[10]);
+    randomKeys.push_back(randomKeys[20]);
+
+    std::vector<uint64_t> directKeys;
+    for (uint64_t key = 0; key < 3000; key += 1 + key % 3)
+        directKeys.push_back(key);
+    directKeys.push_back(42);
+
+    for (const auto storage : {BlobStorage::File, BlobStorage::Mmap})
+    {
+        Blob shrinked("/tmp/testblobs/blob_multi.bl", 4, 5, 14, {storage});
+        MultiIOTest(shrinked, randomKeys);
+        Blob direct("/tmp/testblobs/blob_multi_direct.bl", 2, 3, 0, {storage});
+        MultiIOTest(direct, directKeys);
+    }
+}
+
+TEST(BlobTest, MultiGetMissingKeys)
+{
+    Blob b("/tmp/testblobs/blob_multi.bl", 4, 4, 10);
+    std::vector<Byte> keys(3 * 4);
+    std::vector<Byte> values(3 * 4);
+    std::memcpy(&keys[4], ConvertUintKeyToByteArray(7, 4).get(), 4);
+    std::memcpy(&keys[8], ConvertUintKeyToByteArray(8, 4).get(), 4);
+    b.Set(&keys[4], ConvertUintKeyToByteArray(70, 4).get(), 4);
+
+    const auto statuses = b.MultiGet(keys, values);
+    ASSERT_EQ(statuses.size(), 3);
+    // all zeros key matches an empty slot
+    EXPECT_EQ(statuses[0], BlobStatus::Ok);
+    EXPECT_EQ(statuses[1], BlobStatus::Ok);
+    EXPECT_EQ(statuses[2], BlobStatus::NotFound);
+    EXPECT_EQ(values[4], 70);
+
+    EXPECT_EQ(b.MultiGet(std::span<const Byte>(keys.data(), 5), values)[0], BlobStatus::InvalidLength);
+}
+
+std::span<const Byte> BytesOf(const uint64_t& number)
+{
+    return std::span<const Byte>(reinterpret_cast<const Byte*>(&number), sizeof(number));
+}
+
+std::span<Byte> BytesOf(uint64_t& number)
+{
+    return std::span<Byte>(reinterpret_cast<Byte*>(&number), sizeof(number));
+}
+
+// descriptor the process has the file open on, so a test can put a failing file under it; -1 if there is none
+int DescriptorOf(const std::string& path)
+{
+    for (const auto& fdEntry : std::filesystem::directory_iterator("/proc/self/fd"))
+    {
+        std::error_code error;
+        if (std::filesystem::read_symlink(fdEntry.path(), error) == path)
+            return std::stoi(fdEntry.path().filename());
+    }
+    return -1;
+}
+
+TEST(BlobTest, ConcurrentIOTest)
+{
+    constexpr uint64_t threadsCount = 8;
+    constexpr uint64_t keysPerThread = 1000;
+    const auto keyOf = [](const uint64_t& thread, const uint64_t& i) -> uint64_t
+    {
+        const auto n = i * threadsCount + thread + 1;
+        // odd keys are spread over the slots, even ones share the first slot, so the threads contend for one chain
+        return i % 2 ? n * 0x9E3779B97F4A7C15 : n;
+    };
+    // the last run also reads through the cache, so Set has to keep it from serving the old values
+    for (const auto& options : {BlobOptions {BlobStorage::File, 64}, BlobOptions {BlobStorage::Mmap, 64},
+                                BlobOptions {.storage = BlobStorage::Mmap, .lockStripes = 64, .cacheBytes = 64 * 1024}})
+    {
+        Blob b("/tmp/testblobs/blob_concurrent.bl", 8, 8, 16, options);
+        const uint64_t sharedKey = 0x0123456789ABCDEF;
+        std::vector<std::thread> threads;
+        for (uint64_t t = 0; t < threadsCount; ++t)
+        {
+            threads.emplace_back([&b, &keyOf, &sharedKey, t]()
+            {
+                uint64_t readValue = 0;
+                for (uint64_t i = 0; i < keysPerThread; ++i)
+                {
+                    const auto key = keyOf(t, i);
+                    EXPECT_EQ(b.Set(BytesOf(key), BytesOf(i)), BlobStatus::Ok);
+                    EXPECT_EQ(b.Set(BytesOf(sharedKey), BytesOf(t)), BlobStatus::Ok);
+                    EXPECT_EQ(b.Get(BytesOf(key), BytesOf(readValue)), BlobStatus::Ok);
+                    EXPECT_EQ(readValue, i);
+                }
+            });
+        }
+        for (auto& thread : threads)
+            thread.join();
+
+        uint64_t readValue = 0;
+        for (uint64_t t = 0; t < threadsCount; ++t)
+        {
+            for (uint64_t i = 0; i < keysPerThread; ++i)
+            {
+                const auto key = keyOf(t, i);
+                ASSERT_EQ(b.Get(BytesOf(key), BytesOf(readValue)), BlobStatus::Ok);
+                EXPECT_EQ(readValue, i);
+            }
+        }
+        ASSERT_EQ(b.Get(BytesOf(sharedKey), BytesOf(readValue)), BlobStatus::Ok);
+        EXPECT_LT(readValue, threadsCount);
+    }
+}
+
+TEST(BlobTest, GrowthTest)
+{
+    for (const auto& [storage, fingerprints] : {std::pair(BlobStorage::File, false), std::pair(BlobStorage::Mmap, false),
+                                                std::pair(BlobStorage::File, true)})
+    {
+        BlobOptions options {storage};
+        options.fingerprints = fingerprints;
+        options.growLoadFactor = 0.5;
+        options.growStepRecords = 16;
+        Blob b("/tmp/testblobs/blob_grow.bl", 8, 8, 8, options);
+        uint64_t readValue = 0;
+        for (uint64_t i = 1; i <= 3000; ++i)
+        {
+            const auto key = i * 0x9E3779B97F4A7C15;
+            ASSERT_EQ(b.Set(BytesOf(key), BytesOf(i)), BlobStatus::Ok);
+            // earlier keys stay readable while their records are moved
+            const auto earlierKey = (i / 2 + 1) * 0x9E3779B97F4A7C15;
+            ASSERT_EQ(b.Get(BytesOf(earlierKey), BytesOf(readValue)), BlobStatus::Ok);
+            EXPECT_EQ(readValue, i / 2 + 1);
+        }
+        // overwriting a key that is not moved yet keeps the new value
+        for (uint64_t i = 1; i <= 3000; i += 5)
+        {
+            const auto key = i * 0x9E3779B97F4A7C15;
+            const auto value = i + 1;
+            ASSERT_EQ(b.Set(BytesOf(key), BytesOf(value)), BlobStatus::Ok);
+        }
+        for (uint64_t i = 1; i <= 3000; ++i)
+        {
+            const auto key = i * 0x9E3779B97F4A7C15;
+            ASSERT_EQ(b.Get(BytesOf(key), BytesOf(readValue)), BlobStatus::Ok);
+            EXPECT_EQ(readValue, i % 5 == 1 ? i + 1 : i);
+        }
+        EXPECT_EQ(b.StoredCount(), 3000);
+        EXPECT_GE(b.RecordsCount(), 4096);
+        // the doubled file replaces the blob file once every record is moved
+        if (!b.IsGrowing())
+        {
+            EXPECT_FALSE(std::filesystem::exists("/tmp/testblobs/blob_grow.bl.grow"));
+        }
+    }
+}
+
+TEST(BlobTest, ReopenTest)
+{
+    const std::string path = "/tmp/testblobs/blob_reopen.bl";
+    for (const auto storage : {BlobStorage::File, BlobStorage::Mmap})
+    {
+        {
+            Blob b(path, 8, 8, 12, {storage});
+            for (uint64_t key = 1; key <= 1000; ++key)
+            {
+                const auto spreadKey = key * 0x9E3779B97F4A7C15;
+                ASSERT_EQ(b.Set(BytesOf(spreadKey), BytesOf(key)), BlobStatus::Ok);
+            }
+            // copy of the blob that is still open looks like a blob that crashed
+            std::filesystem::copy_file(path, path + ".crashed", std::filesystem::copy_options::overwrite_existing);
+        }
+
+        uint64_t readValue = 0;
+        for (const auto& reopenedPath : {path, path + ".crashed"})
+        {
+            auto b = Blob::Open(reopenedPath, {storage});
+            EXPECT_EQ(b.KeyLength(), 8);
+            EXPECT_EQ(b.ValueLength(), 8);
+            EXPECT_EQ(b.RecordsCount(), 4096);
+            EXPECT_EQ(b.StoredCount(), 1000);
+            for (uint64_t key = 1; key <= 1000; ++key)
+            {
+                const auto spreadKey = key * 0x9E3779B97F4A7C15;
+                ASSERT_EQ(b.Get(BytesOf(spreadKey), BytesOf(readValue)), BlobStatus::Ok);
+                EXPECT_EQ(readValue, key);
+            }
+        }
+
+        BlobOptions options {storage};
+        options.openMode = BlobOpenMode::Open;
+        {
+            Blob b(path, 8, 8, 12, options);
+            const uint64_t key = 1001 * 0x9E3779B97F4A7C15;
+            ASSERT_EQ(b.Set(BytesOf(key), BytesOf(key)), BlobStatus::Ok);
+        }
+        EXPECT_EQ(Blob::Open(path).StoredCount(), 1001);
+        EXPECT_THROW(Blob(path, 8, 4, 12, options), std::logic_error);
+        EXPECT_THROW(Blob(path, 8, 8, 13, options), std::logic_error);
+    }
+    {
+        std::unique_ptr<FILE, decltype(&fclose)> notBlob(fopen("/tmp/testblobs/not_blob.bl", "w"), &fclose);
+        fputs("not a blob", notBlob.get());
+    }
+    EXPECT_THROW(Blob::Open("/tmp/testblobs/not_blob.bl"), std::logic_error);
+    EXPECT_THROW(Blob::Open("/tmp/testblobs/missing_blob.bl"), std::logic_error);
+
+    // header of another format version is refused rather than misread
+    const std::string otherPath = "/tmp/testblobs/other_version.bl";
+    Blob(otherPath, 8, 8, 10);
+    {
+        std::fstream otherFile(otherPath, std::ios::binary | std::ios::in | std::ios::out);
+        const uint32_t otherVersion = BlobHeader::blobVersion + 1;
+        otherFile.seekp(offsetof(BlobHeader, version));
+        otherFile.write(reinterpret_cast<const char*>(&otherVersion), sizeof(otherVersion));
+    }
+    EXPECT_THROW(Blob::Open(otherPath), std::logic_error);
+    EXPECT_THROW(Blob(otherPath, 8, 8, 10, {.openMode = BlobOpenMode::Open}), std::logic_error);
+}
+
+TEST(BlobTest, FingerprintsTest)
+{
+    const std::string path = "/tmp/testblobs/blob_fingerprints.bl";
+    for (const auto storage : {BlobStorage::File, BlobStorage::Mmap})
+    {
+        BlobOptions options {storage};
+        options.fingerprints = true;
+        const uint64_t zeroKey = 0;
+        const uint64_t zeroKeyValue = 36;
+        uint64_t readValue = 0;
+        {
+            Blob b(path, 8, 8, 10, options);
+            // all zeros key is told from an empty slot
+            EXPECT_EQ(b.Get(BytesOf(zeroKey), BytesOf(readValue)), BlobStatus::NotFound);
+            // small keys share the first slot, so the chain is long and has to be probed through the fingerprints
+            for (uint64_t key = 1; key < 500; ++key)
+                ASSERT_EQ(b.Set(BytesOf(key), BytesOf(key)), BlobStatus::Ok);
+            ASSERT_EQ(b.Set(BytesOf(zeroKey), BytesOf(zeroKeyValue)), BlobStatus::Ok);
+            EXPECT_EQ(b.StoredCount(), 500);
+            ASSERT_EQ(b.Get(BytesOf(zeroKey), BytesOf(readValue)), BlobStatus::Ok);
+            EXPECT_EQ(readValue, zeroKeyValue);
+        }
+
+        // fingerprints are rebuilt from the records, the zero key from the header
+        options.openMode = BlobOpenMode::Open;
+        Blob b(path, 8, 8, 10, options);
+        EXPECT_EQ(b.StoredCount(), 500);
+        ASSERT_EQ(b.Get(BytesOf(zeroKey), BytesOf(readValue)), BlobStatus::Ok);
+        EXPECT_EQ(readValue, zeroKeyValue);
+        for (uint64_t key = 1; key < 500; ++key)
+        {
+            ASSERT_EQ(b.Get(BytesOf(key), BytesOf(readValue)), BlobStatus::Ok);
+            EXPECT_EQ(readValue, key);
+        }
+        const uint64_t missingKey = 500;
+        EXPECT_EQ(b.Get(BytesOf(missingKey), BytesOf(readValue)), BlobStatus::NotFound);
+        for (uint64_t key = 500; key < 1024; ++key)
+            ASSERT_EQ(b.Set(BytesOf(key), BytesOf(key)), BlobStatus::Ok);
+        EXPECT_EQ(b.Set(BytesOf(1024), BytesOf(zeroKey)), BlobStatus::NoSpace);
+    }
+}
+
+TEST(BlobTest, BloomTest)
+{
+    const std::string path = "/tmp/testblobs/blob_bloom.bl";
+    for (const auto storage : {BlobStorage::File, BlobStorage::Mmap})
+    {
+        BlobOptions options {storage};
+        options.bloomBitsPerSlot = 10;
+        uint64_t readValue = 0;
+        {
+            Blob b(path, 8, 8, 12, options);
+            for (uint64_t key = 1; key < 1000; ++key)
+                ASSERT_EQ(b.Set(BytesOf(key), BytesOf(key)), BlobStatus::Ok);
+            // batched keys are added to the filter too
+            std::vector<uint64_t> keys;
+            for (uint64_t key = 1; key < 1000; ++key)
+                keys.push_back(key * 0x9E3779B97F4A7C15);
+            const auto keyBytes = std::span<const Byte>(reinterpret_cast<const Byte*>(keys.data()), keys.size() * 8);
+            for (const auto& status : b.MultiSet(keyBytes, keyBytes))
+                ASSERT_EQ(status, BlobStatus::Ok);
+            std::vector<Byte> values(keyBytes.size());
+            for (const auto& status : b.MultiGet(keyBytes, values))
+                ASSERT_EQ(status, BlobStatus::Ok);
+            EXPECT_TRUE(std::equal(values.begin(), values.end(), keyBytes.begin()));
+        }
+
+        // filter is loaded from the file saved on close
+        options.openMode = BlobOpenMode::Open;
+        Blob b(path, 8, 8, 12, options);
+        for (uint64_t key = 1; key < 1000; ++key)
+        {
+            ASSERT_TRUE(b.TryGet(BytesOf(key).data(), BytesOf(readValue).data()));
+            EXPECT_EQ(readValue, key);
+        }
+        for (uint64_t key = 1000; key < 2000; ++key)
+            EXPECT_FALSE(b.TryGet(BytesOf(key).data(), BytesOf(readValue).data()));
+    }
+
+    // filter saved with another number of keys is not trusted, it is rebuilt from the records
+    BlobOptions options;
+    options.bloomBitsPerSlot = 10;
+    const uint64_t firstKey = 7;
+    const uint64_t secondKey = 8;
+    {
+        Blob b(path, 8, 8, 12, options);
+        ASSERT_EQ(b.Set(BytesOf(firstKey), BytesOf(firstKey)), BlobStatus::Ok);
+    }
+    std::filesystem::copy_file(path + ".bloom", path + ".saved", std::filesystem::copy_options::overwrite_existing);
+    {
+        auto b = Blob::Open(path, options);
+        ASSERT_EQ(b.Set(BytesOf(secondKey), BytesOf(secondKey)), BlobStatus::Ok);
+    }
+    std::filesystem::copy_file(path + ".saved", path + ".bloom", std::filesystem::copy_options::overwrite_existing);
+    auto b = Blob::Open(path, options);
+    uint64_t readValue = 0;
+    EXPECT_TRUE(b.TryGet(BytesOf(secondKey).data(), BytesOf(readValue).data()));
+    EXPECT_EQ(readValue, secondKey);
+}
+
+TEST(BlobTest, DeleteTest)
+{
+    const std::string path = "/tmp/testblobs/blob_delete.bl";
+    for (const auto fingerprints : {false, true})
+    {
+        for (const auto storage : {BlobStorage::File, BlobStorage::Mmap})
+        {
+            BlobOptions options {storage};
+            options.fingerprints = fingerprints;
+            uint64_t readValue = 0;
+            {
+                Blob b(path, 8, 8, 10, options);
+                // small keys share the first slot, so deleted keys sit in the middle of one long chain
+                for (uint64_t key = 1; key < 300; ++key)
+                    ASSERT_EQ(b.Set(BytesOf(key), BytesOf(key)), BlobStatus::Ok);
+                for (uint64_t key = 1; key < 300; key += 2)
+                    ASSERT_EQ(b.Delete(BytesOf(key)), BlobStatus::Ok);
+                EXPECT_EQ(b.Delete(BytesOf(1)), BlobStatus::NotFound);
+                EXPECT_EQ(b.Delete(BytesOf(std::numeric_limits<uint64_t>::max())), BlobStatus::NotFound);
+                EXPECT_EQ(b.Set(BytesOf(std::numeric_limits<uint64_t>::max()), BytesOf(readValue)), BlobStatus::InvalidLength);
+                EXPECT_EQ(b.StoredCount(), 149);
+                EXPECT_EQ(b.TombstoneCount(), 150);
+                EXPECT_DOUBLE_EQ(b.TombstoneRatio(), 150.0 / 1024);
+                for (uint64_t key = 1; key < 300; ++key)
+                    ASSERT_EQ(b.Get(BytesOf(key), BytesOf(readValue)), key % 2 ? BlobStatus::NotFound : BlobStatus::Ok);
+
+                // new key takes the first tombstone of its chain
+                const uint64_t newKey = 1000;
+                ASSERT_EQ(b.Set(BytesOf(newKey), BytesOf(newKey)), BlobStatus::Ok);
+                EXPECT_EQ(b.TombstoneCount(), 149);
+                EXPECT_EQ(b.StoredCount(), 150);
+            }
+
+            // tombstones are kept over reopening, then compaction moves the chain back over them
+            options.openMode = BlobOpenMode::Open;
+            Blob b(path, 8, 8, 10, options);
+            EXPECT_EQ(b.TombstoneCount(), 149);
+            uint64_t reclaimed = 0;
+            for (uint64_t step = 0; step < 8; ++step)
+                reclaimed += b.Compact(b.RecordsCount() / 8);
+            EXPECT_EQ(reclaimed, 149);
+            EXPECT_EQ(b.TombstoneCount(), 0);
+            EXPECT_EQ(b.StoredCount(), 150);
+            for (uint64_t key = 2; key < 300; key += 2)
+            {
+                ASSERT_EQ(b.Get(BytesOf(key), BytesOf(readValue)), BlobStatus::Ok);
+                EXPECT_EQ(readValue, key);
+            }
+            ASSERT_EQ(b.Get(BytesOf(1000), BytesOf(readValue)), BlobStatus::Ok);
+            EXPECT_EQ(readValue, 1000);
+            EXPECT_EQ(b.Get(BytesOf(1), BytesOf(readValue)), BlobStatus::NotFound);
+        }
+    }
+
+    // readers keep finding the records while compaction moves them
+    BlobOptions options {BlobStorage::Mmap, 64};
+    options.compactTombstoneRatio = 0.01;
+    Blob b(path, 8, 8, 12, options);
+    for (uint64_t key = 1; key < 2000; ++key)
+        ASSERT_EQ(b.Set(BytesOf(key), BytesOf(key)), BlobStatus::Ok);
+    std::atomic<bool> isDone = false;
+    std::vector<std::thread> readers;
+    for (uint64_t t = 0; t < 4; ++t)
+    {
+        readers.emplace_back([&b, &isDone]()
+        {
+            uint64_t readValue = 0;
+            while (!isDone)
+            {
+                for (uint64_t key = 2; key < 2000; key += 2)
+                {
+                    ASSERT_EQ(b.Get(BytesOf(key), BytesOf(readValue)), BlobStatus::Ok);
+                    ASSERT_EQ(readValue, key);
+                }
+            }
+        });
+    }
+    for (uint64_t key = 1; key < 2000; key += 2)
+        ASSERT_EQ(b.Delete(BytesOf(key)), BlobStatus::Ok);
+    while (b.Compact(b.RecordsCount()) != 0)
+        ;
+    isDone = true;
+    for (auto& reader : readers)
+        reader.join();
+    EXPECT_EQ(b.TombstoneCount(), 0);
+    EXPECT_EQ(b.StoredCount(), 999);
+}
+
+TEST(BlobTest, CacheTest)
+{
+    for (const auto capacity : {0, 12})
+    {
+        BlobOptions options;
+        options.cacheBytes = 64 * 1024;
+        Blob b("/tmp/testblobs/blob_cache.bl", capacity ? 8 : 2, 8, capacity, options);
+        const auto keyLength = b.KeyLength();
+        uint64_t readValue = 0;
+        for (uint64_t key = 1; key < 1000; ++key)
+            ASSERT_EQ(b.Set(std::span<const Byte>(BytesOf(key).data(), keyLength), BytesOf(key)), BlobStatus::Ok);
+        const uint64_t hotKey = 7;
+        const auto hotKeyBytes = std::span<const Byte>(BytesOf(hotKey).data(), keyLength);
+        for (int i = 0; i < 100; ++i)
+        {
+            ASSERT_EQ(b.Get(hotKeyBytes, BytesOf(readValue)), BlobStatus::Ok);
+            EXPECT_EQ(readValue, hotKey);
+        }
+        // values written by Set are read back from the cache too
+        EXPECT_EQ(b.CacheHits(), 100);
+        EXPECT_EQ(b.CacheMisses(), 0);
+
+        // whole value is written through, a shorter one drops the key, so the tail is read from the record
+        const uint64_t newValue = 0x1111111111111111;
+        ASSERT_EQ(b.Set(hotKeyBytes, BytesOf(newValue)), BlobStatus::Ok);
+        ASSERT_EQ(b.Get(hotKeyBytes, BytesOf(readValue)), BlobStatus::Ok);
+        EXPECT_EQ(readValue, newValue);
+        const Byte shortValue[2] = {0x22, 0x22};
+        ASSERT_EQ(b.Set(hotKeyBytes, shortValue), BlobStatus::Ok);
+        ASSERT_EQ(b.Get(hotKeyBytes, BytesOf(readValue)), BlobStatus::Ok);
+        EXPECT_EQ(readValue, 0x1111111111112222);
+        EXPECT_EQ(b.CacheMisses(), 1);
+
+        ASSERT_EQ(b.Delete(hotKeyBytes), BlobStatus::Ok);
+        EXPECT_EQ(b.Get(hotKeyBytes, BytesOf(readValue)), capacity ? BlobStatus::NotFound : BlobStatus::Ok);
+        if (!capacity)
+        {
+            EXPECT_EQ(readValue, 0);
+        }
+
+        // batches are answered from the cache and drop the keys they write
+        std::vector<uint64_t> keys(100);
+        std::iota(keys.begin(), keys.end(), 100);
+        std::vector<Byte> keyBytes;
+        for (const auto& key : keys)
+            keyBytes.insert(keyBytes.end(), BytesOf(key).begin(), BytesOf(key).begin() + keyLength);
+        std::vector<uint64_t> values(keys.size());
+        const auto valueBytes = std::span<Byte>(reinterpret_cast<Byte*>(values.data()), values.size() * 8);
+        for (const auto& status : b.MultiGet(keyBytes, valueBytes))
+            ASSERT_EQ(status, BlobStatus::Ok);
+        EXPECT_EQ(values, keys);
+        std::fill(values.begin(), values.end(), 36);
+        for (const auto& status : b.MultiSet(keyBytes, valueBytes))
+            ASSERT_EQ(status, BlobStatus::Ok);
+        ASSERT_EQ(b.Get(std::span<const Byte>(BytesOf(keys[0]).data(), keyLength), BytesOf(readValue)), BlobStatus::Ok);
+        EXPECT_EQ(readValue, 36);
+    }
+
+    // budget smaller than the keys read keeps the recently hit ones
+    BlobOptions options;
+    options.cacheBytes = 4096;
+    Blob b("/tmp/testblobs/blob_cache.bl", 8, 8, 16, options);
+    for (uint64_t i = 1; i < 10000; ++i)
+    {
+        const auto key = i * 0x9E3779B97F4A7C15;
+        ASSERT_EQ(b.Set(BytesOf(key), BytesOf(i)), BlobStatus::Ok);
+    }
+    uint64_t readValue = 0;
+    for (uint64_t i = 1; i < 10000; ++i)
+    {
+        const auto key = i * 0x9E3779B97F4A7C15;
+        ASSERT_EQ(b.Get(BytesOf(key), BytesOf(readValue)), BlobStatus::Ok);
+        EXPECT_EQ(readValue, i);
+    }
+    EXPECT_GT(b.CacheMisses(), 9000);
+    const uint64_t lastKey = 9999 * 0x9E3779B97F4A7C15;
+    const auto hits = b.CacheHits();
+    ASSERT_EQ(b.Get(BytesOf(lastKey), BytesOf(readValue)), BlobStatus::Ok);
+    EXPECT_EQ(b.CacheHits(), hits + 1);
+}
+
+TEST(BlobTest, WalTest)
+{
+    const std::string path = "/tmp/testblobs/blob_wal.bl";
+    const auto copyOptions = std::filesystem::copy_options::overwrite_existing;
+    for (const auto durability : {BlobDurability::Periodic, BlobDurability::PerBatch, BlobDurability::PerOp})
+    {
+        for (const auto storage : {BlobStorage::File, BlobStorage::Mmap})
+        {
+            BlobOptions options {storage};
+            options.durability = durability;
+            options.walSyncIntervalMs = 1;
+            {
+                Blob b(path, 8, 8, 12, options);
+                for (uint64_t key = 1; key < 100; ++key)
+                    ASSERT_EQ(b.Set(BytesOf(key), BytesOf(key)), BlobStatus::Ok);
+            }
+            // blob as it was at the last checkpoint, the log has every update since then
+            std::filesystem::copy_file(path, path + ".base", copyOptions);
+            options.openMode = BlobOpenMode::Open;
+            {
+                Blob b(path, 8, 8, 12, options);
+                for (uint64_t key = 100; key < 200; ++key)
+                    ASSERT_EQ(b.Set(BytesOf(key), BytesOf(key)), BlobStatus::Ok);
+                for (uint64_t key = 1; key < 50; ++key)
+                    ASSERT_EQ(b.Delete(BytesOf(key)), BlobStatus::Ok);
+                std::vector<uint64_t> keys(100);
+                std::iota(keys.begin(), keys.end(), 200);
+                const auto keyBytes = std::span<const Byte>(reinterpret_cast<const Byte*>(keys.data()), keys.size() * 8);
+                for (const auto& status : b.MultiSet(keyBytes, keyBytes))
+                    ASSERT_EQ(status, BlobStatus::Ok);
+                if (durability == BlobDurability::Periodic)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                std::filesystem::copy_file(path + ".wal", path + ".crashed", copyOptions);
+            }
+
+            // crash lost the records written since the checkpoint and tore the last log entry
+            std::filesystem::copy_file(path + ".base", path, copyOptions);
+            std::filesystem::copy_file(path + ".crashed", path + ".wal", copyOptions);
+            {
+                std::ofstream walFile(path + ".wal", std::ios::binary | std::ios::app);
+                walFile << "torn entry";
+            }
+            Blob b(path, 8, 8, 12, options);
+            uint64_t readValue = 0;
+            for (uint64_t key = 1; key < 300; ++key)
+            {
+                ASSERT_EQ(b.Get(BytesOf(key), BytesOf(readValue)), key < 50 ? BlobStatus::NotFound : BlobStatus::Ok);
+                if (key >= 50)
+                {
+                    EXPECT_EQ(readValue, key);
+                }
+            }
+            EXPECT_EQ(b.StoredCount(), 250);
+        }
+    }
+
+    // concurrent updates share the syncs and every one of them is replayed
+    constexpr uint64_t threadsCount = 4;
+    BlobOptions options {BlobStorage::File, 64};
+    options.durability = BlobDurability::PerOp;
+    {
+        Blob b(path, 8, 8, 12, options);
+    }
+    std::filesystem::copy_file(path, path + ".base", copyOptions);
+    options.openMode = BlobOpenMode::Open;
+    {
+        Blob b(path, 8, 8, 12, options);
+        std::vector<std::thread> threads;
+        for (uint64_t t = 0; t < threadsCount; ++t)
+        {
+            threads.emplace_back([&b, t]()
+            {
+                for (uint64_t key = t * 1000 + 1; key < t * 1000 + 200; ++key)
+                    EXPECT_EQ(b.Set(BytesOf(key), BytesOf(key)), BlobStatus::Ok);
+            });
+        }
+        for (auto& thread : threads)
+            thread.join();
+        std::filesystem::copy_file(path + ".wal", path + ".crashed", copyOptions);
+    }
+    std::filesystem::copy_file(path + ".base", path, copyOptions);
+    std::filesystem::copy_file(path + ".crashed", path + ".wal", copyOptions);
+    {
+        Blob b(path, 8, 8, 12, options);
+        EXPECT_EQ(b.StoredCount(), threadsCount * 199);
+    }
+
+    // crash in Reset between the truncation and the header leaves an empty log, a log of other lengths is still refused
+    for (const auto& walBytes : {std::string(), std::string(10, 'x'), std::string(24, '\0')})
+    {
+        std::ofstream(path + ".wal", std::ios::binary | std::ios::trunc) << walBytes;
+        Blob b(path, 8, 8, 12, options);
+        EXPECT_EQ(b.StoredCount(), threadsCount * 199);
+    }
+    WalHeader otherHeader {};
+    std::memcpy(otherHeader.magic, WalHeader::walMagic, sizeof(otherHeader.magic));
+    otherHeader.keyLength = 8;
+    otherHeader.valueLength = 16;
+    std::ofstream(path + ".wal", std::ios::binary | std::ios::trunc).write(reinterpret_cast<const char*>(&otherHeader), sizeof(otherHeader));
+    EXPECT_THROW(Blob(path, 8, 8, 12, options), std::logic_error);
+
+    // group write that fails loses the entries of every thread waiting on them, not only of the one that wrote,
+    // so a later write that succeeds doesn't make them durable
+    const std::string walPath = "/tmp/testblobs/blob_wal_fault.wal";
+    BlobWal wal(walPath, 8, 8, std::chrono::milliseconds(0));
+    const auto walFd = DescriptorOf(walPath);
+    ASSERT_GE(walFd, 0);
+    const auto savedFd = dup(walFd);
+    const auto fullFd = open("/dev/full", O_WRONLY);
+    ASSERT_EQ(dup2(fullFd, walFd), walFd);
+    const auto lostLsn = wal.Append(WalOperation::Set, BytesOf(uint64_t(1)).data(), BytesOf(uint64_t(1)).data(), 8);
+    EXPECT_FALSE(wal.Sync(lostLsn));
+    ASSERT_EQ(dup2(savedFd, walFd), walFd);
+    const auto laterLsn = wal.Append(WalOperation::Set, BytesOf(uint64_t(2)).data(), BytesOf(uint64_t(2)).data(), 8);
+    EXPECT_FALSE(wal.Sync(laterLsn));
+    EXPECT_FALSE(wal.Sync(lostLsn));
+    // reset after the blob is synced starts the log over
+    EXPECT_TRUE(wal.Reset());
+    EXPECT_TRUE(wal.Sync(wal.Append(WalOperation::Delete, BytesOf(uint64_t(1)).data(), nullptr, 0)));
+    close(fullFd);
+    close(savedFd);
+}
+
+TEST(BlobTest, WalCheckpointTest)
+{
+    // direct addressed blob with lock stripes: checkpoints drop the log while Sets are between their entry and their record
+    const std::string path = "/tmp/testblobs/blob_wal_checkpoint.bl";
+    const auto copyOptions = std::filesystem::copy_options::overwrite_existing;
+    constexpr uint64_t threadsCount = 4;
+    constexpr uint64_t keysPerThread = 2000;
+    BlobOptions options {BlobStorage::File, 64};
+    options.durability = BlobDurability::PerOp;
+    {
+        Blob b(path, 2, 8, 0, options);
+        std::atomic<uint64_t> settingThreads = threadsCount;
+        std::vector<std::thread> threads;
+        for (uint64_t t = 0; t < threadsCount; ++t)
+        {
+            threads.emplace_back([&b, &settingThreads, t]()
+            {
+                for (uint64_t key = t * keysPerThread + 1; key <= (t + 1) * keysPerThread; ++key)
+                    EXPECT_EQ(b.Set(std::span<const Byte>(BytesOf(key).data(), 2), BytesOf(key + 1)), BlobStatus::Ok);
+                --settingThreads;
+            });
+        }
+        // blob as the last checkpoint left it on the disk, records written after it are only in the log
+        do
+        {
+            ASSERT_TRUE(b.Checkpoint());
+            std::filesystem::copy_file(path, path + ".base", copyOptions);
+        } while (settingThreads != 0);
+        for (auto& thread : threads)
+            thread.join();
+        std::filesystem::copy_file(path + ".wal", path + ".crashed", copyOptions);
+    }
+    std::filesystem::copy_file(path + ".base", path, copyOptions);
+    std::filesystem::copy_file(path + ".crashed", path + ".wal", copyOptions);
+    options.openMode = BlobOpenMode::Open;
+    Blob b(path, 2, 8, 0, options);
+    uint64_t readValue = 0;
+    for (uint64_t key = 1; key <= threadsCount * keysPerThread; ++key)
+    {
+        ASSERT_EQ(b.Get(std::span<const Byte>(BytesOf(key).data(), 2), BytesOf(readValue)), BlobStatus::Ok);
+        ASSERT_EQ(readValue, key + 1);
+    }
+
+    // long log is checkpointed by the updates themselves, without the threshold it keeps every entry
+    const uint64_t entryLength = sizeof(WalEntry) + 8 + 8;
+    for (const uint64_t checkpointBytes : {uint64_t(4096), uint64_t(0)})
+    {
+        BlobOptions logOptions {BlobStorage::File};
+        logOptions.durability = BlobDurability::PerOp;
+        logOptions.walCheckpointBytes = checkpointBytes;
+        Blob logged(path, 8, 8, 12, logOptions);
+        for (uint64_t key = 1; key <= 1000; ++key)
+        {
+            ASSERT_EQ(logged.Set(BytesOf(key), BytesOf(key)), BlobStatus::Ok);
+            ASSERT_EQ(logged.Delete(BytesOf(key)), BlobStatus::Ok);
+        }
+        const auto walLength = std::filesystem::file_size(path + ".wal");
+        if (checkpointBytes != 0)
+            EXPECT_LT(walLength, sizeof(WalHeader) + checkpointBytes);
+        else
+            EXPECT_GE(walLength, sizeof(WalHeader) + 1000 * (entryLength + sizeof(WalEntry) + 8));
+    }
+}
+
+std::span<const Byte, 8> FixedBytesOf(const uint64_t& number)
+{
+    return std::span<const Byte, 8>(reinterpret_cast<const Byte*>(&number), 8);
+}
+
+std::span<Byte, 8> FixedBytesOf(uint64_t& number)
+{
+    return std::span<Byte, 8>(reinterpret_cast<Byte*>(&number), 8);
+}
+
+TEST(BlobTest, FixedBlobTest)
+{
+    const std::string path = "/tmp/testblobs/blob_fixed.bl";
+    uint64_t readValue = 0;
+    {
+        FixedBlob<8, 8, 12> b(path);
+        EXPECT_EQ(b.RecordsCount(), 4096);
+        for (uint64_t key = 1; key < 3000; ++key)
+            ASSERT_EQ(b.Set(FixedBytesOf(key * 0x9E3779B97F4A7C15), FixedBytesOf(key)), BlobStatus::Ok);
+        for (uint64_t key = 1; key < 3000; key += 3)
+            ASSERT_EQ(b.Delete(FixedBytesOf(key * 0x9E3779B97F4A7C15)), BlobStatus::Ok);
+        EXPECT_EQ(b.Delete(FixedBytesOf(uint64_t(1) * 0x9E3779B97F4A7C15)), BlobStatus::NotFound);
+        EXPECT_EQ(b.Set(FixedBytesOf(std::numeric_limits<uint64_t>::max()), FixedBytesOf(1)), BlobStatus::InvalidLength);
+        EXPECT_EQ(b.StoredCount(), 1999);
+        EXPECT_EQ(b.TombstoneCount(), 1000);
+        // new key takes a tombstone, so it is found before the empty slot ending the chain
+        ASSERT_EQ(b.Set(FixedBytesOf(uint64_t(1) * 0x9E3779B97F4A7C15), FixedBytesOf(42)), BlobStatus::Ok);
+        EXPECT_EQ(b.TombstoneCount(), 999);
+    }
+    {
+        // files are the same as the ones of Blob both ways
+        BlobOptions options {BlobStorage::Mmap};
+        options.openMode = BlobOpenMode::Open;
+        Blob b(path, 8, 8, 12, options);
+        EXPECT_EQ(b.StoredCount(), 2000);
+        EXPECT_EQ(b.TombstoneCount(), 999);
+        for (uint64_t key = 1; key < 3000; ++key)
+        {
+            const auto status = b.Get(BytesOf(key * 0x9E3779B97F4A7C15), BytesOf(readValue));
+            if (key % 3 == 1 && key != 1)
+                EXPECT_EQ(status, BlobStatus::NotFound);
+            else
+            {
+                ASSERT_EQ(status, BlobStatus::Ok);
+                EXPECT_EQ(readValue, key == 1 ? 42 : key);
+            }
+        }
+        for (uint64_t key = 3000; key < 3500; ++key)
+            ASSERT_EQ(b.Set(BytesOf(key * 0x9E3779B97F4A7C15), BytesOf(key)), BlobStatus::Ok);
+    }
+    {
+        FixedBlob<8, 8, 12> b(path, BlobOpenMode::Open);
+        EXPECT_EQ(b.StoredCount(), 2500);
+        for (uint64_t key = 2; key < 3500; key += 3)
+        {
+            ASSERT_EQ(b.Get(FixedBytesOf(key * 0x9E3779B97F4A7C15), FixedBytesOf(readValue)), BlobStatus::Ok);
+            EXPECT_EQ(readValue, key);
+        }
+    }
+    EXPECT_THROW((FixedBlob<8, 4, 12>(path, BlobOpenMode::Open)), std::logic_error);
+
+    FixedBlob<2, 8, 0> direct("/tmp/testblobs/blob_fixed_direct.bl");
+    const uint16_t directKey = 500;
+    const auto directKeyBytes = std::span<const Byte, 2>(reinterpret_cast<const Byte*>(&directKey), 2);
+    ASSERT_EQ(direct.Set(directKeyBytes, FixedBytesOf(7)), BlobStatus::Ok);
+    ASSERT_EQ(direct.Get(directKeyBytes, FixedBytesOf(readValue)), BlobStatus::Ok);
+    EXPECT_EQ(readValue, 7);
+    ASSERT_EQ(direct.Delete(directKeyBytes), BlobStatus::Ok);
+    ASSERT_EQ(direct.Get(directKeyBytes, FixedBytesOf(readValue)), BlobStatus::Ok);
+    EXPECT_EQ(readValue, 0);
+}
+
+TEST(BlobTest, AsyncTest)
+{
+    for (const bool fingerprints : {false, true})
+    {
+        BlobOptions options;
+        options.fingerprints = fingerprints;
+        options.asyncQueueDepth = 16;
+        Blob b("/tmp/testblobs/blob_async.bl", 8, 8, 12, options);
+        // small keys share the first slot and the large ones wrap around the end, so probes span pages
+        std::vector<uint64_t> keys;
+        for (uint64_t i = 1; i < 600; ++i)
+        {
+            keys.push_back(i);
+            keys.push_back(std::numeric_limits<uint64_t>::max() - 1 - i);
+        }
+        for (const auto& key : keys)
+            ASSERT_EQ(b.Set(BytesOf(key), BytesOf(key / 2)), BlobStatus::Ok);
+        for (uint64_t i = 0; i < keys.size(); i += 5)
+            ASSERT_EQ(b.Delete(BytesOf(keys[i])), BlobStatus::Ok);
+
+        std::vector<uint64_t> values(keys.size() + 1);
+        std::vector<std::future<BlobStatus>> futures;
+        for (uint64_t i = 0; i < keys.size(); ++i)
+        {
+            futures.push_back(b.GetAsync(BytesOf(keys[i]), BytesOf(values[i])));
+            // compaction moves records under the reads in flight
+            if (i == 100)
+                b.Compact(b.RecordsCount());
+        }
+        const uint64_t missingKey = 5000;
+        futures.push_back(b.GetAsync(BytesOf(missingKey), BytesOf(values.back())));
+        for (uint64_t i = 0; i < keys.size(); ++i)
+        {
+            if (i % 5 == 0)
+                EXPECT_EQ(futures[i].get(), BlobStatus::NotFound);
+            else
+            {
+                ASSERT_EQ(futures[i].get(), BlobStatus::Ok);
+                EXPECT_EQ(values[i], keys[i] / 2);
+            }
+        }
+        EXPECT_EQ(futures.back().get(), BlobStatus::NotFound);
+    }
+
+    BlobOptions options;
+    options.asyncQueueDepth = 8;
+    Blob direct("/tmp/testblobs/blob_async_direct.bl", 2, 8, 0, options);
+    std::vector<uint64_t> values(1000);
+    std::vector<std::future<BlobStatus>> futures;
+    for (uint16_t key = 0; key < 1000; ++key)
+    {
+        values[key] = key * 3;
+        futures.push_back(direct.SetAsync(std::span<const Byte>(reinterpret_cast<const Byte*>(&key), 2), BytesOf(values[key])));
+    }
+    for (auto& future : futures)
+        ASSERT_EQ(future.get(), BlobStatus::Ok);
+    futures.clear();
+    std::vector<uint64_t> readValues(1000);
+    for (uint16_t key = 0; key < 1000; ++key)
+        futures.push_back(direct.GetAsync(std::span<const Byte>(reinterpret_cast<const Byte*>(&key), 2), BytesOf(readValues[key])));
+    for (auto& future : futures)
+        ASSERT_EQ(future.get(), BlobStatus::Ok);
+    EXPECT_EQ(readValues, values);
+
+    // mapped blob answers right away
+    Blob mapped("/tmp/testblobs/blob_async_mmap.bl", 8, 8, 12, {.storage = BlobStorage::Mmap, .asyncQueueDepth = 8});
+    uint64_t readValue = 0;
+    ASSERT_EQ(mapped.SetAsync(BytesOf(uint64_t(7)), BytesOf(uint64_t(8))).get(), BlobStatus::Ok);
+    ASSERT_EQ(mapped.GetAsync(BytesOf(uint64_t(7)), BytesOf(readValue)).get(), BlobStatus::Ok);
+    EXPECT_EQ(readValue, 8);
+}
+
+// value of the key whose length and bytes follow from the key
+std::vector<Byte> LoggedValueOf(const uint64_t& key, const uint64_t& maxLength)
+{
+    std::vector<Byte> value(key * 37 % (maxLength + 1));
+    for (uint64_t i = 0; i < value.size(); ++i)
+        value[i] = Byte(key + i);
+    return value;
+}
+
+TEST(BlobTest, ValueLogTest)
+{
+    const std::string path = "/tmp/testblobs/blob_vlog.bl";
+    const uint64_t valueLength = 1024;
+    for (const auto storage : {BlobStorage::File, BlobStorage::Mmap})
+    {
+        BlobOptions options {storage};
+        options.valueLogThreshold = 16;
+        options.cacheBytes = 16 * 1024;
+        {
+            Blob b(path, 8, valueLength, 10, options);
+            // slots keep the length and 16 inline bytes, not the whole value
+            EXPECT_EQ(std::filesystem::file_size(path), 4096 + 1024 * (8 + 4 + 16));
+            for (uint64_t key = 1; key <= 500; ++key)
+                ASSERT_EQ(b.Set(BytesOf(key), LoggedValueOf(key, valueLength)), BlobStatus::Ok);
+            EXPECT_EQ(b.ValueLogGarbageRatio(), 0);
+            EXPECT_GT(b.ValueLogBytes(), 0);
+            // overwritten and deleted long values are garbage
+            for (uint64_t key = 1; key <= 200; ++key)
+                ASSERT_EQ(b.Set(BytesOf(key), LoggedValueOf(key * 3, valueLength)), BlobStatus::Ok);
+            for (uint64_t key = 201; key <= 300; ++key)
+                ASSERT_EQ(b.Delete(BytesOf(key)), BlobStatus::Ok);
+            EXPECT_GT(b.ValueLogGarbageRatio(), 0.3);
+
+            std::vector<Byte> value(valueLength);
+            uint64_t valueLen = 0;
+            for (uint64_t key = 1; key <= 500; ++key)
+            {
+                const auto status = b.Get(BytesOf(key), value, valueLen);
+                if (key > 200 && key <= 300)
+                {
+                    EXPECT_EQ(status, BlobStatus::NotFound);
+                    continue;
+                }
+                ASSERT_EQ(status, BlobStatus::Ok);
+                const auto expected = LoggedValueOf(key <= 200 ? key * 3 : key, valueLength);
+                ASSERT_EQ(valueLen, expected.size());
+                EXPECT_TRUE(std::equal(expected.begin(), expected.end(), value.begin()));
+                EXPECT_TRUE(std::all_of(value.begin() + valueLen, value.end(), [](const Byte b) { return b == 0; }));
+            }
+
+            // collection drops the garbage and keeps the live values readable
+            const auto logBytes = b.ValueLogBytes();
+            // live entries are appended again, so the log is collected once over
+            uint64_t collected = 0;
+            while (collected < logBytes)
+            {
+                const auto step = b.CollectValueLog(64 * 1024);
+                ASSERT_GT(step, 0);
+                collected += step;
+            }
+            EXPECT_LT(b.ValueLogBytes(), logBytes);
+            EXPECT_EQ(b.ValueLogGarbageRatio(), 0);
+            for (uint64_t key = 301; key <= 500; ++key)
+            {
+                ASSERT_EQ(b.Get(BytesOf(key), value, valueLen), BlobStatus::Ok);
+                const auto expected = LoggedValueOf(key, valueLength);
+                ASSERT_EQ(valueLen, expected.size());
+                EXPECT_TRUE(std::equal(expected.begin(), expected.end(), value.begin()));
+            }
+        }
+
+        std::vector<Byte> value(valueLength);
+        uint64_t valueLen = 0;
+        {
+            // reopened blob takes the threshold from its header and finds the collected log
+            auto b = Blob::Open(path, {storage});
+            for (uint64_t key = 1; key <= 200; ++key)
+            {
+                ASSERT_EQ(b.Get(BytesOf(key), value, valueLen), BlobStatus::Ok);
+                const auto expected = LoggedValueOf(key * 3, valueLength);
+                ASSERT_EQ(valueLen, expected.size());
+                EXPECT_TRUE(std::equal(expected.begin(), expected.end(), value.begin()));
+            }
+            EXPECT_EQ(b.ValueLogGarbageRatio(), 0);
+        }
+
+        // log opened with the tail it had before the collection skips the punched pages to the entries after them
+        {
+            std::fstream log(path + ".vlog", std::ios::binary | std::ios::in | std::ios::out);
+            const uint64_t staleTail = 4096;
+            log.seekp(offsetof(ValueLogHeader, tail));
+            log.write(reinterpret_cast<const char*>(&staleTail), sizeof(staleTail));
+        }
+        auto b = Blob::Open(path, {storage});
+        const auto logBytes = b.ValueLogBytes();
+        EXPECT_GT(b.CollectValueLog(logBytes), 0);
+        EXPECT_LT(b.ValueLogBytes(), logBytes);
+        for (uint64_t key = 1; key <= 500; ++key)
+        {
+            if (key > 200 && key <= 300)
+                continue;
+            ASSERT_EQ(b.Get(BytesOf(key), value, valueLen), BlobStatus::Ok);
+            const auto expected = LoggedValueOf(key <= 200 ? key * 3 : key, valueLength);
+            ASSERT_EQ(valueLen, expected.size());
+            EXPECT_TRUE(std::equal(expected.begin(), expected.end(), value.begin()));
+        }
+    }
+
+    // direct addressed blob clears the slot, batches are set and read one by one
+    BlobOptions options;
+    options.valueLogThreshold = 8;
+    options.valueLogGarbageRatio = 0.5;
+    Blob direct("/tmp/testblobs/blob_vlog_direct.bl", 2, 64, 0, options);
+    std::vector<Byte> keys;
+    std::vector<Byte> values;
+    for (uint16_t key = 0; key < 100; ++key)
+    {
+        keys.insert(keys.end(), reinterpret_cast<Byte*>(&key), reinterpret_cast<Byte*>(&key) + 2);
+        const auto value = LoggedValueOf(key, 64);
+        values.insert(values.end(), value.begin(), value.end());
+        values.resize(keys.size() / 2 * 64);
+    }
+    for (const auto& status : direct.MultiSet(keys, values))
+        ASSERT_EQ(status, BlobStatus::Ok);
+    for (int round = 0; round < 20; ++round)
+    {
+        for (uint16_t key = 0; key < 100; ++key)
+            ASSERT_EQ(direct.Set(std::span<const Byte>(keys.data() + key * 2, 2), LoggedValueOf(key + round, 64)), BlobStatus::Ok);
+    }
+    // Set collects once half of the log is garbage
+    EXPECT_LT(direct.ValueLogGarbageRatio(), 0.5);
+    std::vector<Byte> readValues(values.size());
+    for (const auto& status : direct.MultiGet(keys, readValues))
+        ASSERT_EQ(status, BlobStatus::Ok);
+    for (uint16_t key = 0; key < 100; ++key)
+    {
+        auto expected = LoggedValueOf(key + 19, 64);
+        expected.resize(64);
+        EXPECT_TRUE(std::equal(expected.begin(), expected.end(), readValues.begin() + key * 64));
+    }
+    ASSERT_EQ(direct.Delete(std::span<const Byte>(keys.data(), 2)), BlobStatus::Ok);
+    uint64_t valueLen = 1;
+    ASSERT_EQ(direct.Get(std::span<const Byte>(keys.data(), 2), std::span<Byte>(readValues.data(), 64), valueLen), BlobStatus::Ok);
+    EXPECT_EQ(valueLen, 0);
+
+    options.valueLogThreshold = 64;
+    EXPECT_THROW(Blob("/tmp/testblobs/blob_vlog_direct.bl", 2, 64, 0, options), std::logic_error);
+    options.valueLogThreshold = 8;
+    options.growLoadFactor = 0.5;
+    EXPECT_THROW(Blob("/tmp/testblobs/blob_vlog_direct.bl", 8, 64, 10, options), std::logic_error);
+
+    // append that fails leaves its range behind the head, collection steps over it instead of stopping there
+    {
+        const std::string failPath = "/tmp/testblobs/blob_vlog_fail.bl";
+        BlobOptions failOptions;
+        failOptions.valueLogThreshold = 16;
+        Blob failing(failPath, 8, 256, 10, failOptions);
+        for (uint64_t key = 1; key <= 50; ++key)
+            ASSERT_EQ(failing.Set(BytesOf(key), LoggedValueOf(key, 256)), BlobStatus::Ok);
+        const auto logFd = DescriptorOf(failPath + ".vlog");
+        ASSERT_GE(logFd, 0);
+        const auto savedFd = dup(logFd);
+        const auto fullFd = open("/dev/full", O_WRONLY);
+        ASSERT_EQ(dup2(fullFd, logFd), logFd);
+        EXPECT_EQ(failing.Set(BytesOf(uint64_t(51)), std::vector<Byte>(256, 1)), BlobStatus::IOError);
+        ASSERT_EQ(dup2(savedFd, logFd), logFd);
+        close(fullFd);
+        close(savedFd);
+        for (uint64_t key = 1; key <= 100; ++key)
+            ASSERT_EQ(failing.Set(BytesOf(key), std::vector<Byte>(256, Byte(key))), BlobStatus::Ok);
+        // one pass over the whole log drops the first values, the failed range and the long values it moved
+        EXPECT_GT(failing.ValueLogGarbageRatio(), 0);
+        EXPECT_GT(failing.CollectValueLog(failing.ValueLogBytes()), 0);
+        EXPECT_EQ(failing.ValueLogGarbageRatio(), 0);
+        std::vector<Byte> failValue(256);
+        for (uint64_t key = 1; key <= 100; ++key)
+        {
+            ASSERT_EQ(failing.Get(BytesOf(key), failValue), BlobStatus::Ok);
+            EXPECT_EQ(failValue, std::vector<Byte>(256, Byte(key)));
+        }
+    }
+
+    // collection running next to the Sets never drops an entry appended before its slot points at it
+    BlobOptions striped;
+    striped.valueLogThreshold = 16;
+    striped.lockStripes = 64;
+    Blob shared("/tmp/testblobs/blob_vlog_striped.bl", 8, 256, 12, striped);
+    std::atomic<bool> isSetting = true;
+    std::vector<std::thread> setters;
+    for (uint64_t t = 0; t < 4; ++t)
+    {
+        setters.emplace_back([&shared, t]()
+        {
+            for (uint64_t round = 0; round < 10; ++round)
+            {
+                for (uint64_t key = 1 + t * 200; key <= (t + 1) * 200; ++key)
+                    ASSERT_EQ(shared.Set(BytesOf(key), LoggedValueOf(key + round, 256)), BlobStatus::Ok);
+            }
+        });
+    }
+    std::thread collector([&]()
+    {
+        while (isSetting)
+            shared.CollectValueLog(16 * 1024);
+    });
+    for (auto& thread : setters)
+        thread.join();
+    isSetting = false;
+    collector.join();
+    std::vector<Byte> sharedValue(256);
+    for (uint64_t key = 1; key <= 800; ++key)
+    {
+        ASSERT_EQ(shared.Get(BytesOf(key), sharedValue, valueLen), BlobStatus::Ok);
+        const auto expected = LoggedValueOf(key + 9, 256);
+        ASSERT_EQ(valueLen, expected.size());
+        EXPECT_TRUE(std::equal(expected.begin(), expected.end(), sharedValue.begin()));
+    }
+}
+
+TEST(BlobTest, StatsTest)
+{
+    // counters stay zeros unless the options ask for them
+    Blob plain("/tmp/testblobs/blob_stats.bl", 8, 8, 10);
+    ASSERT_EQ(plain.Set(BytesOf(uint64_t(1)), BytesOf(uint64_t(2))), BlobStatus::Ok);
+    auto stats = plain.Stats();
+    EXPECT_EQ(stats.storedRecords, 1);
+    EXPECT_EQ(stats.Count(BlobCount::WriteCalls), 0);
+    EXPECT_EQ(stats.Latency(BlobOperation::Set).count, 0);
+    EXPECT_EQ(stats.probeLengths.count, 0);
+
+    BlobOptions options;
+    options.stats = true;
+    Blob b("/tmp/testblobs/blob_stats.bl", 8, 8, 10, options);
+    for (uint64_t key = 1; key <= 512; ++key)
+        ASSERT_EQ(b.Set(BytesOf(key), BytesOf(key)), BlobStatus::Ok);
+    uint64_t readValue = 0;
+    for (uint64_t key = 1; key <= 512; ++key)
+        ASSERT_EQ(b.Get(BytesOf(key), BytesOf(readValue)), BlobStatus::Ok);
+    for (uint64_t key = 1; key <= 64; ++key)
+        ASSERT_EQ(b.Delete(BytesOf(key)), BlobStatus::Ok);
+    std::vector<uint64_t> keys(16);
+    std::iota(keys.begin(), keys.end(), 100);
+    std::vector<uint64_t> values(keys.size());
+    b.MultiGet(std::span<const Byte>(reinterpret_cast<const Byte*>(keys.data()), keys.size() * 8),
+               std::span<Byte>(reinterpret_cast<Byte*>(values.data()), values.size() * 8));
+
+    stats = b.Stats();
+    EXPECT_EQ(stats.recordsCount, 1024);
+    EXPECT_EQ(stats.storedRecords, 448);
+    EXPECT_EQ(stats.tombstoneRecords, 64);
+    EXPECT_DOUBLE_EQ(stats.loadFactor, 0.5);
+    EXPECT_EQ(stats.Latency(BlobOperation::Set).count, 512);
+    EXPECT_EQ(stats.Latency(BlobOperation::Get).count, 512);
+    EXPECT_EQ(stats.Latency(BlobOperation::Delete).count, 64);
+    EXPECT_EQ(stats.Latency(BlobOperation::MultiGet).count, 1);
+    EXPECT_EQ(stats.Latency(BlobOperation::MultiSet).count, 0);
+    const auto& getLatency = stats.Latency(BlobOperation::Get);
+    EXPECT_LE(getLatency.Percentile(0.5), getLatency.Percentile(0.99));
+    EXPECT_LE(getLatency.Percentile(0.99), getLatency.max);
+    // every file Set writes its record and every Get reads at least one
+    EXPECT_GE(stats.Count(BlobCount::WriteCalls), 512);
+    EXPECT_GE(stats.Count(BlobCount::ReadCalls), 512);
+    EXPECT_GE(stats.Count(BlobCount::BytesWritten), 512 * 16);
+    EXPECT_GE(stats.Count(BlobCount::BytesRead), 512 * 16);
+    // small keys share the first slot, so their chains grow with every Set
+    EXPECT_GE(stats.probeLengths.count, 512 + 512 + 64);
+    EXPECT_GE(stats.probeLengths.Percentile(0.5), 1);
+    EXPECT_LE(stats.probeLengths.max, 1024);
+    EXPECT_GT(stats.probeLengths.Mean(), 1);
+
+    // histogram buckets cover the values they count
+    for (const uint64_t value : std::initializer_list<uint64_t> {0, 3, 4, 7, 100, 1000000, std::numeric_limits<uint64_t>::max()})
+    {
+        const auto bucket = BlobHistogram::BucketOf(value);
+        EXPECT_LT(bucket, BlobHistogram::bucketsCount);
+        EXPECT_GE(BlobHistogram::BucketTop(bucket), value);
+        EXPECT_LE(BlobHistogram::BucketTop(bucket) - value, value / 4);
+    }
+}
+
+TEST(BlobTest, BuilderTest)
+{
+    const std::string path = "/tmp/testblobs/blob_build.bl";
+    std::mt19937_64 random(7);
+    std::vector<uint64_t> keys(900);
+    for (auto& key : keys)
+        key = random();
+    keys[0] = 0;
+    for (const auto storage : {BlobStorage::File, BlobStorage::Mmap})
+    {
+        for (const bool isFingerprinted : {false, true})
+        {
+            BlobOptions options {storage};
+            options.fingerprints = isFingerprinted;
+            options.bloomBitsPerSlot = 8;
+            std::unordered_map<uint64_t, uint64_t> expected;
+            {
+                // a budget of a few kilobytes spills runs, so the merge sees the rewritten keys in several of them
+                BlobBuilder builder(path, 8, 8, 10, options, 4096);
+                for (uint64_t i = 0; i < keys.size(); ++i)
+                {
+                    ASSERT_EQ(builder.Add(BytesOf(keys[i]), BytesOf(i)), BlobStatus::Ok);
+                    expected[keys[i]] = i;
+                }
+                for (uint64_t i = 0; i < keys.size(); i += 7)
+                {
+                    const uint64_t value = i + 1000;
+                    ASSERT_EQ(builder.Add(BytesOf(keys[i]), BytesOf(value)), BlobStatus::Ok);
+                    expected[keys[i]] = value;
+                }
+                EXPECT_EQ(builder.Add(BytesOf(keys[0]), std::vector<Byte>(9)), BlobStatus::InvalidLength);
+                EXPECT_EQ(builder.Add(std::vector<Byte>(8, 0xFF), BytesOf(keys[0])), BlobStatus::InvalidLength);
+                auto b = builder.Finish();
+                EXPECT_THROW(builder.Finish(), std::logic_error);
+                EXPECT_FALSE(std::filesystem::exists(path + ".run0"));
+                // without fingerprints the all zeros key isn't counted, like Set doesn't count it
+                EXPECT_EQ(b.StoredCount(), int64_t(keys.size()) - (isFingerprinted ? 0 : 1));
+                // and its slot looks empty to the chains wrapping around, so only fingerprints keep its value
+                if (!isFingerprinted)
+                    expected.erase(0);
+                for (const auto& [key, value] : expected)
+                {
+                    uint64_t stored = 0;
+                    ASSERT_EQ(b.Get(BytesOf(key), BytesOf(stored)), BlobStatus::Ok);
+                    EXPECT_EQ(stored, value);
+                }
+                // built blob takes Set and Delete like any other
+                const uint64_t value = 1;
+                ASSERT_EQ(b.Set(BytesOf(keys[1]), BytesOf(value)), BlobStatus::Ok);
+                ASSERT_EQ(b.Delete(BytesOf(keys[2])), BlobStatus::Ok);
+                expected[keys[1]] = value;
+                expected.erase(keys[2]);
+            }
+            auto b = Blob::Open(path, options);
+            for (const auto& [key, value] : expected)
+            {
+                uint64_t stored = 0;
+                ASSERT_EQ(b.Get(BytesOf(key), BytesOf(stored)), BlobStatus::Ok);
+                EXPECT_EQ(stored, value);
+            }
+            uint64_t stored = 0;
+            EXPECT_EQ(b.Get(BytesOf(keys[2]), BytesOf(stored)), BlobStatus::NotFound);
+        }
+    }
+
+    // more keys than slots
+    BlobBuilder small(path, 8, 8, 4);
+    for (uint64_t key = 1; key <= 20; ++key)
+        ASSERT_EQ(small.Add(BytesOf(key), BytesOf(key)), BlobStatus::Ok);
+    EXPECT_THROW(small.Finish(), std::logic_error);
+
+    // long values go to the value log, direct addressed blob writes the values only
+    BlobOptions options;
+    options.valueLogThreshold = 8;
+    BlobBuilder direct("/tmp/testblobs/blob_build_direct.bl", 2, 64, 0, options, 1024);
+    for (uint16_t key = 0; key < 300; key += 3)
+        ASSERT_EQ(direct.Add(std::span<const Byte>(reinterpret_cast<const Byte*>(&key), 2), LoggedValueOf(key, 64)), BlobStatus::Ok);
+    auto b = direct.Finish();
+    std::vector<Byte> value(64);
+    uint64_t valueLen = 0;
+    for (uint16_t key = 0; key < 300; ++key)
+    {
+        ASSERT_EQ(b.Get(std::span<const Byte>(reinterpret_cast<const Byte*>(&key), 2), value, valueLen), BlobStatus::Ok);
+        auto expected = key % 3 == 0 ? LoggedValueOf(key, 64) : std::vector<Byte>();
+        ASSERT_EQ(valueLen, expected.size());
+        EXPECT_TRUE(std::equal(expected.begin(), expected.end(), value.begin()));
+    }
+}
+
+// keys and values the scan returned, failing if a key came twice
+std::unordered_map<uint64_t, uint64_t> ScannedOf(BlobScanner scanner)
+{
+    std::unordered_map<uint64_t, uint64_t> scanned;
+    while (scanner.Next())
+    {
+        uint64_t key = 0;
+        uint64_t value = 0;
+        std::memcpy(&key, scanner.Key().data(), scanner.Key().size());
+        std::memcpy(&value, scanner.Value().data(), sizeof(value));
+        EXPECT_TRUE(scanned.emplace(key, value).second);
+    }
+    EXPECT_EQ(scanner.Status(), BlobStatus::Ok);
+    return scanned;
+}
+
+TEST(BlobTest, ScanTest)
+{
+    std::mt19937_64 random(11);
+    for (const auto storage : {BlobStorage::File, BlobStorage::Mmap})
+    {
+        for (const bool isFingerprinted : {false, true})
+        {
+            BlobOptions options {storage};
+            options.fingerprints = isFingerprinted;
+            Blob b("/tmp/testblobs/blob_scan.bl", 8, 8, 10, options);
+            std::unordered_map<uint64_t, uint64_t> expected;
+            for (uint64_t i = 0; i < 700; ++i)
+            {
+                // keys of the last slots, so their chains wrap around to the first ones
+                const uint64_t key = i < 20 ? UINT64_MAX - 2 - i : random();
+                ASSERT_EQ(b.Set(BytesOf(key), BytesOf(i)), BlobStatus::Ok);
+                expected[key] = i;
+            }
+            for (auto it = expected.begin(); it != expected.end() && expected.size() > 600;)
+            {
+                ASSERT_EQ(b.Delete(BytesOf(it->first)), BlobStatus::Ok);
+                it = expected.erase(it);
+            }
+            EXPECT_EQ(ScannedOf(b.Scan()), expected);
+
+            // ranges read only the slots of their keys and the chains going on from them
+            const std::pair<uint64_t, uint64_t> ranges[] = {{0, UINT64_MAX}, {uint64_t(1) << 62, uint64_t(1) << 63},
+                                                            {UINT64_MAX - 100, UINT64_MAX}, {100, 50}};
+            for (const auto& [first, last] : ranges)
+            {
+                std::unordered_map<uint64_t, uint64_t> inRange;
+                for (const auto& [key, value] : expected)
+                {
+                    if (key >= first && key <= last)
+                        inRange.emplace(key, value);
+                }
+                EXPECT_EQ(ScannedOf(b.Scan(BytesOf(first), BytesOf(last))), inRange);
+            }
+            EXPECT_EQ(b.Scan(BytesOf(uint64_t(0)), std::vector<Byte>(4)).Status(), BlobStatus::InvalidLength);
+        }
+    }
+
+    // scan runs while a writer updates the values, every record is read whole
+    {
+        BlobOptions options;
+        options.lockStripes = 16;
+        Blob b("/tmp/testblobs/blob_scan_concurrent.bl", 8, 512, 12, options);
+        std::vector<Byte> value(512);
+        for (uint64_t key = 1; key <= 2000; ++key)
+        {
+            std::fill(value.begin(), value.end(), Byte(key));
+            ASSERT_EQ(b.Set(BytesOf(key << 40), value), BlobStatus::Ok);
+        }
+        std::atomic<bool> isDone = false;
+        std::thread writer([&]()
+        {
+            std::vector<Byte> update(512);
+            for (uint64_t round = 1; !isDone; ++round)
+            {
+                const auto key = round % 2000 + 1;
+                std::fill(update.begin(), update.end(), Byte(key + round));
+                b.Set(BytesOf(key << 40), update);
+            }
+        });
+        for (int round = 0; round < 5; ++round)
+        {
+            auto scanner = b.Scan();
+            uint64_t count = 0;
+            while (scanner.Next())
+            {
+                ++count;
+                const auto scanned = scanner.Value();
+                EXPECT_TRUE(std::all_of(scanned.begin(), scanned.end(), [&](const Byte v) { return v == scanned[0]; }));
+            }
+            EXPECT_EQ(count, 2000);
+        }
+        isDone = true;
+        writer.join();
+    }
+
+    // direct addressed blob has no keys in its slots, the slot is the key; long values come from the value log
+    BlobOptions options;
+    options.valueLogThreshold = 8;
+    Blob direct("/tmp/testblobs/blob_scan_direct.bl", 2, 64, 0, options);
+    for (uint16_t key = 1; key < 1000; key += 3)
+        ASSERT_EQ(direct.Set(std::span<const Byte>(reinterpret_cast<const Byte*>(&key), 2), LoggedValueOf(key, 64)), BlobStatus::Ok);
+    const uint16_t from = 100;
+    const uint16_t to = 200;
+    auto scanner = direct.Scan(std::span<const Byte>(reinterpret_cast<const Byte*>(&from), 2),
+                               std::span<const Byte>(reinterpret_cast<const Byte*>(&to), 2));
+    for (uint16_t key = 100; key <= 200; ++key)
+    {
+        // empty value clears the slot like Delete does, so the scan can't tell it was set
+        if (key % 3 != 1 || LoggedValueOf(key, 64).empty())
+            continue;
+        ASSERT_TRUE(scanner.Next());
+        uint16_t scannedKey = 0;
+        std::memcpy(&scannedKey, scanner.Key().data(), 2);
+        EXPECT_EQ(scannedKey, key);
+        const auto expected = LoggedValueOf(key, 64);
+        ASSERT_EQ(scanner.ValueLen(), expected.size());
+        EXPECT_TRUE(std::equal(expected.begin(), expected.end(), scanner.Value().begin()));
+    }
+    EXPECT_FALSE(scanner.Next());
+
+    // growing blob is read from the doubled blob and the records not moved yet
+    BlobOptions growOptions;
+    growOptions.growLoadFactor = 0.5;
+    growOptions.growStepRecords = 16;
+    Blob growing("/tmp/testblobs/blob_scan_grow.bl", 8, 8, 8, growOptions);
+    std::unordered_map<uint64_t, uint64_t> expected;
+    for (uint64_t i = 1; i <= 140; ++i)
+    {
+        const auto key = i * 0x9E3779B97F4A7C15;
+        ASSERT_EQ(growing.Set(BytesOf(key), BytesOf(i)), BlobStatus::Ok);
+        expected[key] = i;
+    }
+    ASSERT_TRUE(growing.IsGrowing());
+    EXPECT_EQ(ScannedOf(growing.Scan()), expected);
+}
+
+TEST(BlobTest, KeyHashTest)
+{
+    const std::string path = "/tmp/testblobs/blob_hash.bl";
+    for (const auto keyHash : {BlobKeyHash::Raw, BlobKeyHash::Mixed})
+    {
+        BlobOptions options;
+        options.keyHash = keyHash;
+        options.stats = true;
+        {
+            // sequential keys differ only in their low bits, raw slots put all of them on one chain
+            Blob b(path, 8, 8, 12, options);
+            for (uint64_t key = 1; key <= 2000; ++key)
+                ASSERT_EQ(b.Set(BytesOf(key), BytesOf(key)), BlobStatus::Ok);
+            uint64_t value = 0;
+            for (uint64_t key = 1; key <= 2000; ++key)
+            {
+                ASSERT_EQ(b.Get(BytesOf(key), BytesOf(value)), BlobStatus::Ok);
+                EXPECT_EQ(value, key);
+            }
+            const auto probes = b.Stats().probeLengths;
+            if (keyHash == BlobKeyHash::Mixed)
+                EXPECT_LT(probes.Mean(), 4);
+            else
+                EXPECT_GT(probes.Mean(), 500);
+            // ranges still find their keys, the mixed blob reads all of its slots for them
+            std::unordered_map<uint64_t, uint64_t> inRange;
+            for (uint64_t key = 100; key <= 300; ++key)
+                inRange.emplace(key, key);
+            EXPECT_EQ(ScannedOf(b.Scan(BytesOf(uint64_t(100)), BytesOf(uint64_t(300)))), inRange);
+        }
+        // the hash comes from the header, a blob opened with the other one is refused
+        auto reopened = Blob::Open(path);
+        uint64_t value = 0;
+        ASSERT_EQ(reopened.Get(BytesOf(uint64_t(1234)), BytesOf(value)), BlobStatus::Ok);
+        EXPECT_EQ(value, 1234);
+        options.openMode = BlobOpenMode::Open;
+        options.keyHash = keyHash == BlobKeyHash::Raw ? BlobKeyHash::Mixed : BlobKeyHash::Raw;
+        EXPECT_THROW(Blob(path, 8, 8, 12, options), std::logic_error);
+    }
+
+    BlobOptions options;
+    options.keyHash = BlobKeyHash::Mixed;
+    EXPECT_THROW(Blob("/tmp/testblobs/blob_hash_direct.bl", 2, 8, 0, options), std::logic_error);
+}
+
+TEST(BlobTest, PoolTest)
+{
+    const std::string path = "/tmp/testblobs/blob_pool.bl";
+    BlobOptions options;
+    options.storage = BlobStorage::Pool;
+    options.poolBytes = 16 * BlobPool::pageLength;
+    options.keyHash = BlobKeyHash::Mixed;
+    {
+        // 1 MiB of slots through 64 KiB of pages
+        Blob b(path, 8, 8, 16, options);
+        EXPECT_EQ(b.PoolBytes(), 16 * BlobPool::pageLength);
+        for (uint64_t key = 1; key <= 20000; ++key)
+            ASSERT_EQ(b.Set(BytesOf(key), BytesOf(key * 3)), BlobStatus::Ok);
+        for (uint64_t key = 1; key <= 20000; key += 2)
+            ASSERT_EQ(b.Delete(BytesOf(key)), BlobStatus::Ok);
+        uint64_t value = 0;
+        for (uint64_t key = 1; key <= 20000; ++key)
+        {
+            ASSERT_EQ(b.Get(BytesOf(key), BytesOf(value)), key % 2 ? BlobStatus::NotFound : BlobStatus::Ok);
+            if (key % 2 == 0)
+            {
+                EXPECT_EQ(value, key * 3);
+            }
+        }
+        // pages of the few hot keys stay while the cold ones keep going through the frames
+        const auto missesBefore = b.PoolMisses();
+        const auto hitsBefore = b.PoolHits();
+        std::mt19937_64 random(7);
+        for (uint64_t i = 0; i < 20000; ++i)
+        {
+            const uint64_t key = i % 4 == 0 ? 2 * (1 + random() % 10000) : 2 * (1 + i % 4);
+            ASSERT_EQ(b.Get(BytesOf(key), BytesOf(value)), BlobStatus::Ok);
+            EXPECT_EQ(value, key * 3);
+        }
+        EXPECT_GT(b.PoolHits() - hitsBefore, b.PoolMisses() - missesBefore);
+        EXPECT_EQ(b.Stats().poolHits, b.PoolHits());
+
+        // batches and scans see the records written through the pool
+        std::vector<uint64_t> keys = {2, 4, 5, 19998, 30000};
+        std::vector<uint64_t> values(keys.size());
+        const auto keyBytes = std::span<const Byte>(reinterpret_cast<const Byte*>(keys.data()), keys.size() * 8);
+        const auto statuses = b.MultiGet(keyBytes, std::span<Byte>(reinterpret_cast<Byte*>(values.data()), values.size() * 8));
+        EXPECT_EQ(statuses, std::vector<BlobStatus>({BlobStatus::Ok, BlobStatus::Ok, BlobStatus::NotFound, BlobStatus::Ok, BlobStatus::NotFound}));
+        EXPECT_EQ(values[3], 19998 * 3);
+        std::vector<uint64_t> setValues = {1, 2, 3, 4, 5};
+        for (const auto& status : b.MultiSet(keyBytes, std::span<const Byte>(reinterpret_cast<const Byte*>(setValues.data()), setValues.size() * 8)))
+            EXPECT_EQ(status, BlobStatus::Ok);
+        const auto scanned = ScannedOf(b.Scan());
+        EXPECT_EQ(scanned.size(), 10000 + 2);
+        EXPECT_EQ(scanned.at(5), 3);
+        EXPECT_EQ(scanned.at(30000), 5);
+        EXPECT_EQ(scanned.at(19996), 19996 * 3);
+    }
+    {
+        // records written around the page cache are there for the buffered reader
+        auto reopened = Blob::Open(path);
+        EXPECT_EQ(reopened.StoredCount(), 10000 + 2);
+        uint64_t value = 0;
+        ASSERT_EQ(reopened.Get(BytesOf(uint64_t(19998)), BytesOf(value)), BlobStatus::Ok);
+        EXPECT_EQ(value, 4);
+    }
+
+    // threads share the frames of the direct addressed blob, the pages their slots share are written whole
+    options.lockStripes = 64;
+    options.keyHash = BlobKeyHash::Raw;
+    Blob direct("/tmp/testblobs/blob_pool_direct.bl", 2, 6, 0, options);
+    std::vector<std::thread> threads;
+    for (uint64_t thread = 0; thread < 4; ++thread)
+    {
+        threads.emplace_back([&direct, thread]()
+        {
+            std::array<Byte, 6> value {};
+            for (uint64_t key = thread; key < 65536; key += 4)
+            {
+                const uint16_t shortKey = key;
+                std::memcpy(value.data(), &key, sizeof(uint32_t));
+                value[5] = 1;
+                ASSERT_EQ(direct.Set(std::span<const Byte>(reinterpret_cast<const Byte*>(&shortKey), 2), value), BlobStatus::Ok);
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    std::array<Byte, 6> value {};
+    for (uint64_t key = 0; key < 65536; ++key)
+    {
+        const uint16_t shortKey = key;
+        ASSERT_EQ(direct.Get(std::span<const Byte>(reinterpret_cast<const Byte*>(&shortKey), 2), value), BlobStatus::Ok);
+        uint32_t stored = 0;
+        std::memcpy(&stored, value.data(), sizeof(stored));
+        EXPECT_EQ(stored, key);
+        EXPECT_EQ(value[5], 1);
+    }
+}
+
+TEST(BlobTest, SparseTest)
+{
+    const std::string path = "/tmp/testblobs/blob_sparse.bl";
+    // 8 bytes keys can't be addressed directly, 6 bytes ones can only be sparse in practice: the flat layout is 2 PiB
+    EXPECT_THROW(Blob(path, 8, 8, 0), std::logic_error);
+    BlobOptions options;
+    options.sparse = true;
+    EXPECT_THROW(Blob(path, 8, 8, 12, options), std::logic_error);
+
+    const auto keyBytes = [](const uint64_t& key) { return std::span<const Byte>(reinterpret_cast<const Byte*>(&key), 6); };
+    std::unordered_map<uint64_t, uint64_t> expected;
+    for (const auto storage : {BlobStorage::File, BlobStorage::Pool})
+    {
+        options.storage = storage;
+        expected.clear();
+        {
+            Blob b(path, 6, 8, 0, options);
+            EXPECT_EQ(b.RecordsCount(), int64_t(1) << 48);
+            // keys far apart take a page each, the run of sequential ones takes pages one after another
+            for (uint64_t i = 1; i <= 1000; ++i)
+            {
+                const auto key = i * 0x3F1234567;
+                ASSERT_EQ(b.Set(keyBytes(key), BytesOf(i)), BlobStatus::Ok);
+                expected[key] = i;
+            }
+            for (uint64_t key = 1 << 20; key < (1 << 20) + 2000; ++key)
+            {
+                ASSERT_EQ(b.Set(keyBytes(key), BytesOf(key)), BlobStatus::Ok);
+                expected[key] = key;
+            }
+            // deleting a key never written appends no page
+            ASSERT_EQ(b.Delete(keyBytes(uint64_t(123456789))), BlobStatus::Ok);
+            EXPECT_EQ(b.SparsePagesCount(), 1000 + 2000 * 8 / 4096 + 1);
+            EXPECT_LE(std::filesystem::file_size(path), (b.SparsePagesCount() + 1) * 4096);
+
+            uint64_t value = 0;
+            for (const auto& [key, stored] : expected)
+            {
+                ASSERT_EQ(b.Get(keyBytes(key), BytesOf(value)), BlobStatus::Ok);
+                EXPECT_EQ(value, stored);
+            }
+            ASSERT_EQ(b.Get(keyBytes(uint64_t(987654321)), BytesOf(value)), BlobStatus::Ok);
+            EXPECT_EQ(value, 0);
+
+            // batches cross pages that follow each other in the file and ones that don't
+            std::vector<uint64_t> keys = {(1 << 20) + 10, (1 << 20) + 600, 5 * 0x3F1234567, 42};
+            std::vector<Byte> packedKeys(keys.size() * 6);
+            for (size_t i = 0; i < keys.size(); ++i)
+                std::memcpy(packedKeys.data() + i * 6, &keys[i], 6);
+            std::vector<uint64_t> values = {7, 8, 9, 10};
+            for (const auto& status : b.MultiSet(packedKeys, std::span<const Byte>(reinterpret_cast<const Byte*>(values.data()), 32)))
+                EXPECT_EQ(status, BlobStatus::Ok);
+            std::vector<uint64_t> readValues(keys.size());
+            for (const auto& status : b.MultiGet(packedKeys, std::span<Byte>(reinterpret_cast<Byte*>(readValues.data()), 32)))
+                EXPECT_EQ(status, BlobStatus::Ok);
+            EXPECT_EQ(readValues, values);
+            for (size_t i = 0; i < keys.size(); ++i)
+                expected[keys[i]] = values[i];
+
+            // scans jump over the pages never written
+            std::unordered_map<uint64_t, uint64_t> scanned;
+            auto scanner = b.Scan();
+            while (scanner.Next())
+            {
+                uint64_t key = 0;
+                uint64_t scannedValue = 0;
+                std::memcpy(&key, scanner.Key().data(), 6);
+                std::memcpy(&scannedValue, scanner.Value().data(), 8);
+                ASSERT_TRUE(scanned.emplace(key, scannedValue).second);
+            }
+            EXPECT_EQ(scanner.Status(), BlobStatus::Ok);
+            EXPECT_EQ(scanned, expected);
+        }
+        // pages are found again through the directory left next to the blob
+        auto reopened = Blob::Open(path, {storage});
+        EXPECT_EQ(reopened.SparsePagesCount(), 1000 + 2000 * 8 / 4096 + 1 + 1);
+        uint64_t value = 0;
+        for (const auto& [key, stored] : expected)
+        {
+            ASSERT_EQ(reopened.Get(keyBytes(key), BytesOf(value)), BlobStatus::Ok);
+            EXPECT_EQ(value, stored);
+        }
+    }
+}
+
+TEST(BlobTest, SharedTest)
+{
+    const std::string path = "/tmp/testblobs/blob_shared.bl";
+    constexpr uint64_t keysCount = 64;
+    constexpr uint64_t valueLength = 16 * 1024;
+    BlobOptions options;
+    options.storage = BlobStorage::Mmap;
+    options.keyHash = BlobKeyHash::Mixed;
+    options.sharedReaders = true;
+    BlobOptions readerOptions;
+    readerOptions.storage = BlobStorage::Mmap;
+    readerOptions.openMode = BlobOpenMode::ReadShared;
+    std::error_code error;
+    std::filesystem::remove(path + ".versions", error);
+    {
+        Blob plain(path, 8, valueLength, 10, {BlobStorage::Mmap});
+    }
+    // readers need the counters of a writer and a mapped blob nobody else keeps state of
+    EXPECT_THROW(Blob::Open(path, readerOptions), std::logic_error);
+    EXPECT_THROW(Blob(path, 8, valueLength, 10, {.storage = BlobStorage::File, .sharedReaders = true}), std::logic_error);
+    readerOptions.cacheBytes = 4096;
+    EXPECT_THROW(Blob::Open(path, readerOptions), std::logic_error);
+    readerOptions.cacheBytes = 0;
+
+    Blob writer(path, 8, valueLength, 10, options);
+    // a value is a single byte repeated, so a read overlapping its write shows up as mixed bytes
+    const auto write = [&writer](const uint64_t& key, const Byte& fill)
+    {
+        std::vector<Byte> value(valueLength, fill);
+        return writer.Set(BytesOf(key), value);
+    };
+    const auto isReadWhole = [](const Blob& reader, const uint64_t& key)
+    {
+        std::vector<Byte> value(valueLength);
+        return reader.Get(BytesOf(key), value) == BlobStatus::Ok && value[0] != 0
+            && std::all_of(value.begin(), value.end(), [&value](const Byte& b) { return b == value[0]; });
+    };
+    for (uint64_t key = 1; key <= keysCount; ++key)
+        ASSERT_EQ(write(key, 1), BlobStatus::Ok);
+
+    auto reader = Blob::Open(path, readerOptions);
+    std::vector<Byte> value(valueLength);
+    EXPECT_EQ(reader.Set(BytesOf(uint64_t(1)), value), BlobStatus::ReadOnly);
+    EXPECT_EQ(reader.Delete(BytesOf(uint64_t(1))), BlobStatus::ReadOnly);
+    EXPECT_EQ(reader.Compact(1024), 0);
+    EXPECT_EQ(reader.Get(BytesOf(uint64_t(keysCount + 1)), value), BlobStatus::NotFound);
+
+    // keys set and deleted around the stable ones make compaction move them while the readers probe
+    std::atomic<bool> isWriting = true;
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 2; ++t)
+    {
+        readers.emplace_back([&]()
+        {
+            auto threadReader = Blob::Open(path, readerOptions);
+            while (isWriting)
+            {
+                for (uint64_t key = 1; key <= keysCount; ++key)
+                    ASSERT_TRUE(isReadWhole(threadReader, key));
+            }
+        });
+    }
+    const auto churn = [&](const uint64_t& round)
+    {
+        for (uint64_t key = 1; key <= keysCount; ++key)
+        {
+            EXPECT_EQ(write(key, Byte(round % 255 + 1)), BlobStatus::Ok);
+            EXPECT_EQ(write(key * 1000 + round % 7, 1), BlobStatus::Ok);
+            EXPECT_NE(writer.Delete(BytesOf(key * 1000 + (round + 3) % 7)), BlobStatus::IOError);
+        }
+        writer.Compact(256);
+    };
+    for (uint64_t round = 0; round < 100; ++round)
+        churn(round);
+    isWriting = false;
+    for (auto& thread : readers)
+        thread.join();
+
+    // reader process maps the blob on its own and checks it while this one keeps writing
+    const auto child = fork();
+    ASSERT_GE(child, 0);
+    if (child == 0)
+    {
+        auto processReader = Blob::Open(path, readerOptions);
+        for (int i = 0; i < 50; ++i)
+        {
+            for (uint64_t key = 1; key <= keysCount; ++key)
+            {
+                if (!isReadWhole(processReader, key))
+                    _exit(1);
+            }
+        }
+        _exit(0);
+    }
+    int childStatus = 0;
+    for (uint64_t round = 0; waitpid(child, &childStatus, WNOHANG) == 0; ++round)
+        churn(round);
+    ASSERT_TRUE(WIFEXITED(childStatus));
+    EXPECT_EQ(WEXITSTATUS(childStatus), 0);
+    EXPECT_TRUE(isReadWhole(reader, keysCount));
+}
+
+TEST(BlobTest, ServerTest)
+{
+    const std::string socketPath = "/tmp/testblobs/blob_server.sock";
+    Blob b("/tmp/testblobs/blob_server.bl", 8, 16, 12, {.storage = BlobStorage::Mmap, .lockStripes = 64});
+    EXPECT_THROW(BlobServer(b, socketPath, 0), std::logic_error);
+    BlobServer server(b, socketPath, 4);
+    std::thread loop([&server]() { server.Run(); });
+    const auto valueOf = [](const uint64_t& key)
+    {
+        std::vector<Byte> value(16);
+        std::memcpy(value.data(), &key, sizeof(key));
+        std::memcpy(value.data() + sizeof(key), &key, sizeof(key));
+        return value;
+    };
+    {
+        BlobClient client(socketPath);
+        EXPECT_EQ(client.Lengths(), std::make_pair(uint64_t(8), uint64_t(16)));
+
+        // the whole pipeline goes out at once and is answered in order
+        constexpr uint64_t keysCount = 2000;
+        std::vector<uint64_t> ids;
+        for (uint64_t key = 1; key <= keysCount; ++key)
+            ids.push_back(client.Send(BlobOpcode::Set, BytesOf(key), valueOf(key)));
+        for (uint64_t key = 1; key <= keysCount; ++key)
+            ids.push_back(client.Send(BlobOpcode::Get, BytesOf(key)));
+        ASSERT_TRUE(client.Flush());
+        BlobClient::Response response {};
+        for (uint64_t i = 0; i < ids.size(); ++i)
+        {
+            ASSERT_TRUE(client.Receive(response));
+            EXPECT_EQ(response.header.id, ids[i]);
+            EXPECT_EQ(response.header.status, uint8_t(BlobStatus::Ok));
+            if (i < keysCount)
+                EXPECT_TRUE(response.body.empty());
+            else
+                EXPECT_TRUE(std::ranges::equal(response.body, valueOf(i - keysCount + 1)));
+        }
+        std::vector<Byte> value(16);
+        EXPECT_EQ(b.Get(BytesOf(uint64_t(7)), value), BlobStatus::Ok);
+        EXPECT_EQ(value, valueOf(7));
+
+        // statuses of the batch come first, missing keys are zeros among the values
+        const std::vector<uint64_t> keys = {3, keysCount + 5, 11};
+        client.Send(BlobOpcode::MultiGet, std::span<const Byte>(reinterpret_cast<const Byte*>(keys.data()), 24));
+        client.Send(BlobOpcode::Get, BytesOf(uint64_t(keysCount + 5)));
+        client.Send(BlobOpcode::Get, std::span<const Byte>(BytesOf(uint64_t(1)).data(), 4));
+        client.Send(static_cast<BlobOpcode>(42));
+        ASSERT_TRUE(client.Flush());
+        ASSERT_TRUE(client.Receive(response));
+        ASSERT_EQ(response.body.size(), 3 + 3 * 16);
+        EXPECT_EQ(response.body[0], uint8_t(BlobStatus::Ok));
+        EXPECT_EQ(response.body[1], uint8_t(BlobStatus::NotFound));
+        EXPECT_EQ(response.body[2], uint8_t(BlobStatus::Ok));
+        EXPECT_TRUE(std::ranges::equal(response.body.subspan(3, 16), valueOf(3)));
+        EXPECT_TRUE(std::ranges::equal(response.body.subspan(3 + 32, 16), valueOf(11)));
+        ASSERT_TRUE(client.Receive(response));
+        EXPECT_EQ(response.header.status, uint8_t(BlobStatus::NotFound));
+        EXPECT_TRUE(response.body.empty());
+        ASSERT_TRUE(client.Receive(response));
+        EXPECT_EQ(response.header.status, uint8_t(BlobStatus::InvalidLength));
+        ASSERT_TRUE(client.Receive(response));
+        EXPECT_EQ(response.header.status, uint8_t(BlobStatus::InvalidLength));
+    }
+
+    // connections are served by the workers side by side
+    std::vector<std::thread> clients;
+    for (uint64_t c = 0; c < 4; ++c)
+    {
+        clients.emplace_back([&, c]()
+        {
+            BlobClient client(socketPath);
+            BlobClient::Response response {};
+            for (uint64_t round = 0; round < 50; ++round)
+            {
+                const auto key = 10000 + c * 1000 + round;
+                client.Send(BlobOpcode::Set, BytesOf(key), valueOf(key));
+                client.Send(BlobOpcode::Get, BytesOf(key));
+                ASSERT_TRUE(client.Flush());
+                ASSERT_TRUE(client.Receive(response));
+                EXPECT_EQ(response.header.status, uint8_t(BlobStatus::Ok));
+                ASSERT_TRUE(client.Receive(response));
+                EXPECT_TRUE(std::ranges::equal(response.body, valueOf(key)));
+            }
+        });
+    }
+    for (auto& thread : clients)
+        thread.join();
+    EXPECT_EQ(server.RequestsCount(), 1 + 4000 + 4 + 4 * 100);
+
+    // request longer than the queue limit is still read to its end
+    {
+        BlobClient client(socketPath);
+        client.Send(BlobOpcode::Set, BytesOf(uint64_t(1)), std::vector<Byte>(5 << 20));
+        ASSERT_TRUE(client.Flush());
+        BlobClient::Response response {};
+        ASSERT_TRUE(client.Receive(response));
+        EXPECT_EQ(response.header.status, uint8_t(BlobStatus::InvalidLength));
+
+        // MultiGet whose values wouldn't fit in a response frame is refused
+        client.Send(BlobOpcode::MultiGet, std::vector<Byte>((maxBodyLength / 17 + 1) * 8, 1));
+        ASSERT_TRUE(client.Flush());
+        ASSERT_TRUE(client.Receive(response));
+        EXPECT_EQ(response.header.status, uint8_t(BlobStatus::InvalidLength));
+        std::vector<Byte> frame;
+        EXPECT_THROW(AppendResponse(frame, BlobOpcode::Get, 0, 1, maxBodyLength + 1), std::length_error);
+    }
+
+    // raw connection, so a test can shut it down half way or stop reading it
+    const auto connectRaw = [&socketPath]()
+    {
+        sockaddr_un address {};
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size());
+        const auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        EXPECT_EQ(connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)), 0);
+        return fd;
+    };
+
+    // pipeline sent before the client shuts its writes down is answered whole, then the server hangs up
+    {
+        std::vector<Byte> requests;
+        for (uint64_t key = 1; key <= 1000; ++key)
+            AppendRequest(requests, BlobOpcode::Get, key, BytesOf(key));
+        const auto fd = connectRaw();
+        ASSERT_EQ(send(fd, requests.data(), requests.size(), MSG_NOSIGNAL), ssize_t(requests.size()));
+        ASSERT_EQ(shutdown(fd, SHUT_WR), 0);
+        std::vector<Byte> responses;
+        Byte buffer[64 * 1024];
+        for (ssize_t len = 0; (len = recv(fd, buffer, sizeof(buffer), 0)) > 0;)
+            responses.insert(responses.end(), buffer, buffer + len);
+        close(fd);
+        uint64_t id = 1;
+        for (uint64_t offset = 0; offset < responses.size(); ++id)
+        {
+            const auto frameLength = FrameLength(std::span<const Byte>(responses).subspan(offset));
+            ASSERT_GT(frameLength, 0);
+            ResponseHeader header {};
+            std::memcpy(&header, responses.data() + offset, sizeof(header));
+            EXPECT_EQ(header.id, id);
+            EXPECT_EQ(header.status, uint8_t(BlobStatus::Ok));
+            offset += frameLength;
+        }
+        EXPECT_EQ(id, 1001);
+    }
+
+    // client that sends without reading isn't read once its responses pile up, and hanging up then closes it
+    // instead of waking the loop until the responses drain, which they never do
+    {
+        std::vector<Byte> requests;
+        for (uint64_t key = 1; key <= 10000; ++key)
+            AppendRequest(requests, BlobOpcode::Get, key, BytesOf(key));
+        const auto fd = connectRaw();
+        for (int idleTries = 0; idleTries < 20;)
+        {
+            if (send(fd, requests.data(), requests.size(), MSG_DONTWAIT | MSG_NOSIGNAL) > 0)
+                idleTries = 0;
+            else
+            {
+                ++idleTries;
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        }
+        close(fd);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    clockid_t loopClock {};
+    ASSERT_EQ(pthread_getcpuclockid(loop.native_handle(), &loopClock), 0);
+    const auto loopTime = [&loopClock]()
+    {
+        timespec time {};
+        clock_gettime(loopClock, &time);
+        return time.tv_sec * 1000000000 + time.tv_nsec;
+    };
+    const auto idleStart = loopTime();
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    EXPECT_LT(loopTime() - idleStart, 50000000);
+    EXPECT_EQ(BlobClient(socketPath).Lengths(), std::make_pair(uint64_t(8), uint64_t(16)));
+    server.Stop();
+    loop.join();
+}
+
+std::vector<std::string> ShardPaths(const uint64_t& shardsCount)
+{
+    std::vector<std::string> paths;
+    for (uint64_t shard = 0; shard < shardsCount; ++shard)
+        paths.push_back("/tmp/testblobs/blob_shard" + std::to_string(shard) + ".bl");
+    return paths;
+}
+
+TEST(ShardedBlobTest, RoutingTest)
+{
+    ShardedBlob b(ShardPaths(4), 8, 8, 12);
+    EXPECT_EQ(b.ShardsCount(), 4);
+    EXPECT_EQ(b.RecordsCount(), 4 * 4096);
+    // sequential keys differ only in the low bits and still reach every shard
+    std::vector<uint64_t> keysInShard(4);
+    for (uint64_t key = 0; key < 1000; ++key)
+        ++keysInShard[b.ShardOf(BytesOf(key).data())];
+    for (const auto& keysCount : keysInShard)
+        EXPECT_GT(keysCount, 150);
+
+    // cache of a shard picks the set from the key hash too, its keys still spread over every set
+    std::vector<uint64_t> keysInSet(4);
+    for (uint64_t key = 0; key < 4000; ++key)
+    {
+        const auto keyBytes = BytesOf(key);
+        if (b.ShardOf(keyBytes.data()) == 0)
+            ++keysInSet[HashKey(keyBytes.data(), 8) % keysInSet.size()];
+    }
+    for (const auto& keysCount : keysInSet)
+        EXPECT_GT(keysCount, 150);
+}
+
+TEST(ShardedBlobTest, IOTest)
+{
+    for (const auto storage : {BlobStorage::File, BlobStorage::Mmap})
+    {
+        ShardedBlob b(ShardPaths(3), 8, 8, 12, {storage});
+        uint64_t readValue = 0;
+        for (uint64_t key = 1; key < 2000; ++key)
+        {
+            const auto value = key * 7;
+            ASSERT_EQ(b.Set(BytesOf(key), BytesOf(value)), BlobStatus::Ok);
+        }
+        for (uint64_t key = 1; key < 2000; ++key)
+        {
+            ASSERT_EQ(b.Get(BytesOf(key), BytesOf(readValue)), BlobStatus::Ok);
+            EXPECT_EQ(readValue, key * 7);
+        }
+        const uint64_t missingKey = 5000;
+        EXPECT_EQ(b.Get(BytesOf(missingKey), BytesOf(readValue)), BlobStatus::NotFound);
+        EXPECT_EQ(b.Get(std::span<const Byte>(BytesOf(missingKey).data(), 4), BytesOf(readValue)), BlobStatus::InvalidLength);
+    }
+}
+
+TEST(ShardedBlobTest, MultiIOTest)
+{
+    ShardedBlob b(ShardPaths(4), 8, 8, 14);
+    std::vector<uint64_t> keys;
+    std::vector<uint64_t> values;
+    for (uint64_t key = 1; key < 5000; ++key)
+    {
+        keys.push_back(key * 0x9E3779B97F4A7C15);
+        values.push_back(key);
+    }
+    // the last of equal keys wins
+    keys.push_back(keys[10]);
+    values.push_back(42);
+    const auto keyBytes = std::span<const Byte>(reinterpret_cast<const Byte*>(keys.data()), keys.size() * 8);
+    const auto valueBytes = std::span<const Byte>(reinterpret_cast<const Byte*>(values.data()), values.size() * 8);
+    for (const auto& status : b.MultiSet(keyBytes, valueBytes))
+        EXPECT_EQ(status, BlobStatus::Ok);
+
+    std::vector<uint64_t> readValues(keys.size());
+    for (const auto& status : b.MultiGet(keyBytes, std::span<Byte>(reinterpret_cast<Byte*>(readValues.data()), readValues.size() * 8)))
+        EXPECT_EQ(status, BlobStatus::Ok);
+    values[10] = 42;
+    EXPECT_EQ(readValues, values);
+}
+
 TEST(BlobTest, MillionRecords)
 {
     Blob b("/tmp/testblobs/blob.bl", 4, 4, 21);